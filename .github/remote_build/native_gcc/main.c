@@ -5,8 +5,18 @@
  * LICENSE file in the root directory of this source tree.
  **/
 
-#include "psm.h"
+#include <pthread.h>
+#include <sched.h>
+
 #include "hsm.h"
+#include "psm.h"
+#include "fsm_timer.h"
+#include "fsm_queue.h"
+#include "fsm_profile.h"
+#include "fsm_arena.h"
+#include "fsm_pool.h"
+#include "fsm_executor.h"
+#include "psm_fleet.h"
 
 /* The PSM user specific signal */
 enum {
@@ -43,7 +53,92 @@ enum {
     HSM_INST_NUM,
 };
 
-static void* psm_state_1(psm_state_input_t input);
+/* The timeout regression signal */
+enum {
+    TMO_SIGNAL_TIMEOUT = HSM_SIGNAL_USER_DEFINE,
+};
+
+/* The timeout regression state instance id */
+enum {
+    TMO_INST_P = 0,
+    TMO_INST_C,
+    TMO_INST_X,
+    TMO_INST_NUM,
+};
+
+/* The arena regression signal */
+enum {
+    ARENA_SIGNAL_NEXT = PSM_SIGNAL_USER_DEFINE,
+};
+
+/* The arena regression state instance id */
+enum {
+    ARENA_INST_IDLE = 0,
+    ARENA_INST_BUSY,
+    ARENA_INST_NUM,
+};
+
+/* The inbox regression signal */
+enum {
+    MPSC_SIGNAL_POST = HSM_SIGNAL_USER_DEFINE,
+};
+
+/* Inbox regression producers, events per producer and inbox capacity, smaller than the total so producers wrap it */
+#define MPSC_PRODUCER_NUM (4u)
+#define MPSC_EVENT_NUM    (2000u)
+#define MPSC_INBOX_SIZE   (256u)
+
+/* The executor regression signal */
+enum {
+    EXEC_SIGNAL_TOGGLE = PSM_SIGNAL_USER_DEFINE,
+};
+
+/* The executor regression state instance id */
+enum {
+    EXEC_INST_A = 0,
+    EXEC_INST_B,
+    EXEC_INST_NUM,
+};
+
+/* Executor regression workers, machines, events per machine and per-machine inbox capacity */
+#define EXEC_WORKER_NUM  (4u)
+#define EXEC_MACHINE_NUM (32u)
+#define EXEC_EVENT_NUM   (400u)
+#define EXEC_INBOX_SIZE  (64u)
+
+/* Fleet regression states, signals in the table, instances (not a multiple of the 8 vector lanes) and steps */
+#define FLEET_STATE_NUM    (7u)
+#define FLEET_SIGNAL_NUM   (5u)
+#define FLEET_INSTANCE_NUM (1003u)
+#define FLEET_STEP_NUM     (16u)
+
+/* The defer regression signals */
+enum {
+    DEFER_SIGNAL_DATA = HSM_SIGNAL_USER_DEFINE,
+    DEFER_SIGNAL_GO,
+    DEFER_SIGNAL_BACK,
+};
+
+/* The defer regression state instance id */
+enum {
+    DEFER_INST_WAIT = 0,
+    DEFER_INST_READY,
+    DEFER_INST_NUM,
+};
+
+/* Defer regression pool capacity, DATA events held back while waiting and queue and defer ring capacity */
+#define DEFER_POOL_SIZE (8u)
+#define DEFER_EVENT_NUM (5u)
+#define DEFER_RING_SIZE (8u)
+
+/* Defer regression WAIT and READY rounds, enough for the defer ring to wrap */
+#define DEFER_ROUND_NUM (3u)
+
+/* Arena regression slots and per-slot queue depth */
+#define ARENA_SLOT_NUM    (3u)
+#define ARENA_QUEUE_DEPTH (4u)
+
+static void* psm_state_1(psm_state_manager_t *pManager, psm_state_input_t input);
 static void* psm_state_2(psm_state_input_t input);
 static void* psm_state_3(psm_state_input_t input);
 static signed int psm_transducer_handler(const psm_state_t *pStateContext, psm_instance_t from, psm_instance_t to, psm_state_input_t input);
@@ -53,17 +148,42 @@ static signed int hsm_state_1(hsm_state_input_t input);
 static signed int hsm_state_2(hsm_state_input_t input);
 static signed int hsm_state_20(hsm_state_input_t input);
 static signed int hsm_state_21(hsm_state_input_t input);
-static signed int hsm_state_210(hsm_state_input_t input);
+static signed int hsm_state_210(hsm_state_manager_t *pManager, hsm_state_input_t input);
 static signed int hsm_state_10(hsm_state_input_t input);
 static signed int hsm_state_100(hsm_state_input_t input);
 static signed int hsm_transducer_handler(const hsm_state_t *pStateContext, hsm_instance_t from, hsm_instance_t to, hsm_state_input_t input);
 
+static signed int tmo_state_p(hsm_state_manager_t *pManager, hsm_state_input_t input);
+static signed int tmo_state_c(hsm_state_manager_t *pManager, hsm_state_input_t input);
+static signed int tmo_state_x(hsm_state_manager_t *pManager, hsm_state_input_t input);
+static bool tmo_batch_rearm_check(void);
+
+static signed int mpsc_state_sink(hsm_state_input_t input);
+static void *mpsc_producer(void *pArg);
+static bool mpsc_inbox_drain_check(void);
+
+static void* exec_state_toggle(psm_state_manager_t *pManager, psm_state_input_t input);
+static bool exec_exclusive_check(void);
+
+static void* fleet_state_count(psm_state_input_t input);
+static unsigned int fleet_random(void);
+static bool fleet_vector_check(void);
+
+static signed int defer_state_wait(hsm_state_manager_t *pManager, hsm_state_input_t input);
+static signed int defer_state_ready(hsm_state_manager_t *pManager, hsm_state_input_t input);
+static bool defer_pool_release_check(void);
+static bool defer_recall_order_check(void);
+
+static void* arena_state_idle(psm_state_manager_t *pManager, psm_state_input_t input);
+static void* arena_state_busy(psm_state_input_t input);
+static bool arena_reuse_check(void);
+
 /* The PSM states' init tables */
 static psm_state_t g_psm_state_init[] = {
     [PSM_INST_0] = {.instance = PSM_INST_0,
                     .id = 0u,
                     .pName = "psm_state_1",
-                    .pEntryFunc = psm_state_1 },
+                    .pEntryExFunc = psm_state_1 },
 
     [PSM_INST_1] = {.instance = PSM_INST_1,
                     .id = 1u,
@@ -107,7 +227,7 @@ static hsm_state_t g_hsm_state_init[] = {
                      .instance = HSM_INST_210,
                      .id = 210,
                      .pName = "hsm_state_210",
-                     .pEntryFunc = hsm_state_210 },
+                     .pHandlerEx = hsm_state_210 },
     [HSM_INST_10] = {.pMasterState = &g_hsm_state_init[HSM_INST_1],
                      .instance = HSM_INST_10,
                      .id = 10,
@@ -121,6 +241,105 @@ static hsm_state_t g_hsm_state_init[] = {
 
 };
 
+/* The timeout regression states, C nested in P and X at the top level */
+static hsm_state_t g_tmo_state_init[] = {
+    [TMO_INST_P] = {.pMasterState = NULL,
+                    .instance = TMO_INST_P,
+                    .id = 0,
+                    .pName = "tmo_state_p",
+                    .pHandlerEx = tmo_state_p },
+    [TMO_INST_C] = {.pMasterState = &g_tmo_state_init[TMO_INST_P],
+                    .instance = TMO_INST_C,
+                    .id = 1,
+                    .pName = "tmo_state_c",
+                    .pHandlerEx = tmo_state_c },
+    [TMO_INST_X] = {.pMasterState = NULL,
+                    .instance = TMO_INST_X,
+                    .id = 2,
+                    .pName = "tmo_state_x",
+                    .pHandlerEx = tmo_state_x },
+};
+
+/* The inbox regression state, a single sink */
+static hsm_state_t g_mpsc_state_init[] = {
+    [0] = {.pMasterState = NULL,
+           .instance = 0,
+           .id = 0,
+           .pName = "mpsc_state_sink",
+           .pEntryFunc = mpsc_state_sink },
+};
+
+/* The inbox regression manager, events dispatched and events out of their producer's order */
+static hsm_state_manager_t g_mpsc_manager = {0u};
+static unsigned int g_mpsc_next[MPSC_PRODUCER_NUM];
+static unsigned int g_mpsc_received = 0u;
+static unsigned int g_mpsc_disorder = 0u;
+
+/* The executor regression states, TOGGLE moves between A and B */
+static psm_state_t g_exec_state_init[] = {
+    [EXEC_INST_A] = {.instance = EXEC_INST_A,
+                     .id = 0u,
+                     .pName = "exec_state_a",
+                     .pEntryExFunc = exec_state_toggle },
+    [EXEC_INST_B] = {.instance = EXEC_INST_B,
+                     .id = 1u,
+                     .pName = "exec_state_b",
+                     .pEntryExFunc = exec_state_toggle },
+};
+
+/* The executor regression machines, their in-flight flags and event counts */
+static psm_state_manager_t g_exec_managers[EXEC_MACHINE_NUM];
+static atomic_bool g_exec_inFlight[EXEC_MACHINE_NUM];
+static unsigned int g_exec_handled[EXEC_MACHINE_NUM];
+static atomic_uint g_exec_done;
+static atomic_uint g_exec_overlaps;
+
+/* The fleet regression states, all counting their ENTRY and EXIT calls */
+static psm_state_t g_fleet_state_init[FLEET_STATE_NUM];
+
+/* ENTRY and EXIT calls of one fleet instance */
+typedef struct {
+    unsigned int entries;
+    unsigned int exits;
+} fleet_calls_t;
+
+/* The fleet regression random sequence */
+static unsigned int g_fleet_seed = 12345u;
+
+/* The defer regression states, WAIT defers DATA until GO moves it to READY, BACK returns to WAIT */
+static hsm_state_t g_defer_state_init[] = {
+    [DEFER_INST_WAIT] = {.pMasterState = NULL,
+                         .instance = DEFER_INST_WAIT,
+                         .id = 0,
+                         .pName = "defer_state_wait",
+                         .pHandlerEx = defer_state_wait },
+    [DEFER_INST_READY] = {.pMasterState = NULL,
+                          .instance = DEFER_INST_READY,
+                          .id = 1,
+                          .pName = "defer_state_ready",
+                          .pHandlerEx = defer_state_ready },
+};
+
+/* DATA events READY received and their payload values in arrival order */
+static unsigned int g_defer_received = 0u;
+static unsigned int g_defer_order[DEFER_ROUND_NUM * DEFER_EVENT_NUM];
+
+/* The arena regression states, NEXT moves IDLE to BUSY */
+static psm_state_t g_arena_state_init[] = {
+    [ARENA_INST_IDLE] = {.instance = ARENA_INST_IDLE,
+                         .id = 0u,
+                         .pName = "arena_state_idle",
+                         .pEntryExFunc = arena_state_idle },
+    [ARENA_INST_BUSY] = {.instance = ARENA_INST_BUSY,
+                         .id = 1u,
+                         .pName = "arena_state_busy",
+                         .pEntryFunc = arena_state_busy },
+};
+
+/* Ticks X received its timeout at */
+static uint64_t g_tmo_now = 0u;
+static uint64_t g_tmo_x_fired = 0u;
+
 /* The PSM state manager */
 static psm_state_manager_t g_psm_mngr_context = {0u};
 
@@ -135,7 +354,7 @@ int main(void)
     data.signal = PSM_SIGNAL_1;
     psm_activities(&g_psm_mngr_context, data);
 
-    hsm_init(&g_hsm_mngr_context, &g_hsm_state_init[0], HSM_INST_NUM, HSM_INST_210, hsm_transducer_handler);
+    hsm_init(&g_hsm_mngr_context, &g_hsm_state_init[0], HSM_INST_NUM, HSM_INST_210, true, hsm_transducer_handler);
 
     hsm_state_input_t input = {0};
     input.signal = HSM_SIGNAL_INIT;
@@ -144,6 +363,41 @@ int main(void)
     input.signal = HSM_SIGNAL_1;
     hsm_activities(&g_hsm_mngr_context, input);
 
+    if (!tmo_batch_rearm_check()) {
+        printf("timeout batch re-arm check failed\n");
+        return 1;
+    }
+
+    if (!mpsc_inbox_drain_check()) {
+        printf("inbox multi-producer drain check failed\n");
+        return 1;
+    }
+
+    if (!exec_exclusive_check()) {
+        printf("executor exclusive run check failed\n");
+        return 1;
+    }
+
+    if (!fleet_vector_check()) {
+        printf("fleet vector step check failed\n");
+        return 1;
+    }
+
+    if (!defer_pool_release_check()) {
+        printf("defer pool release check failed\n");
+        return 1;
+    }
+
+    if (!defer_recall_order_check()) {
+        printf("defer recall order check failed\n");
+        return 1;
+    }
+
+    if (!arena_reuse_check()) {
+        printf("arena reuse check failed\n");
+        return 1;
+    }
+
     while(1) {};
 }
 
@@ -155,7 +409,7 @@ static signed int psm_transducer_handler(const psm_state_t *pStateContext, psm_i
     return 0;
 }
 
-static void* psm_state_1(psm_state_input_t input)
+static void* psm_state_1(psm_state_manager_t *pManager, psm_state_input_t input)
 {
     switch(input.signal)
     {
@@ -169,7 +423,7 @@ static void* psm_state_1(psm_state_input_t input)
         }
         case PSM_SIGNAL_1:
         {
-            return psm_transition(&g_psm_mngr_context, PSM_INST_1);
+            return psm_transition(pManager, PSM_INST_1);
         }
         case PSM_SIGNAL_2:
         {
@@ -432,7 +686,7 @@ static signed int hsm_state_21(hsm_state_input_t input)
     return 0;
 }
 
-static signed int hsm_state_210(hsm_state_input_t input)
+static signed int hsm_state_210(hsm_state_manager_t *pManager, hsm_state_input_t input)
 {
     switch(input.signal)
     {
@@ -450,7 +704,7 @@ static signed int hsm_state_210(hsm_state_input_t input)
         }
         case HSM_SIGNAL_1:
         {
-            return hsm_transition(&g_hsm_mngr_context, HSM_INST_100);
+            return hsm_transition(pManager, HSM_INST_100);
         }
         case HSM_SIGNAL_2:
         {
@@ -536,3 +790,579 @@ static signed int hsm_state_100(hsm_state_input_t input)
 
     return 0;
 }
+
+static signed int tmo_state_p(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    hsm_state_input_t timeout = {.signal = TMO_SIGNAL_TIMEOUT, .pUserContext = NULL};
+
+    switch(input.signal)
+    {
+        case HSM_SIGNAL_ENTRY:
+        {
+            return hsm_armTimeout(pManager, 5u, timeout);
+        }
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static signed int tmo_state_c(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    hsm_state_input_t timeout = {.signal = TMO_SIGNAL_TIMEOUT, .pUserContext = NULL};
+
+    switch(input.signal)
+    {
+        case HSM_SIGNAL_ENTRY:
+        {
+            return hsm_armTimeout(pManager, 5u, timeout);
+        }
+        case TMO_SIGNAL_TIMEOUT:
+        {
+            return hsm_transition(pManager, TMO_INST_X);
+        }
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static signed int tmo_state_x(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    hsm_state_input_t timeout = {.signal = TMO_SIGNAL_TIMEOUT, .pUserContext = NULL};
+
+    switch(input.signal)
+    {
+        case HSM_SIGNAL_ENTRY:
+        {
+            return hsm_armTimeout(pManager, 100u, timeout);
+        }
+        case TMO_SIGNAL_TIMEOUT:
+        {
+            g_tmo_x_fired = g_tmo_now;
+            break;
+        }
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief P and C both time out at tick 5, C's timeout moves to X which arms a new timeout
+ *        while P's expired timer is still waiting later in the same batch.
+ *
+ * @return true if X's timeout arrives 100 ticks after its ENTRY, and only once.
+ */
+static bool tmo_batch_rearm_check(void)
+{
+    static hsm_state_manager_t manager = {0u};
+    static hsm_extension_t extension;
+    static fsm_timer_wheel_t wheel;
+    static fsm_timer_t timers[3];
+    hsm_state_input_t input = {.signal = HSM_SIGNAL_INIT, .pUserContext = NULL};
+    unsigned int delivered = 0u;
+
+    hsm_init(&manager, &g_tmo_state_init[0], TMO_INST_NUM, TMO_INST_C, false, NULL);
+    hsm_setExtension(&manager, &extension);
+    fsm_timer_wheel_init(&wheel, 0u);
+    hsm_setTimers(&manager, &wheel, timers, 3u);
+    hsm_dispatch(&manager, input);
+
+    for (g_tmo_now = 1u; g_tmo_now <= 200u; g_tmo_now++) {
+        signed int ret = hsm_dispatchTimeouts(fsm_timer_advance(&wheel, g_tmo_now));
+
+        if (ret < 0) {
+            return false;
+        }
+        delivered += (unsigned int)ret;
+    }
+
+    return (manager.currentState == TMO_INST_X) && (g_tmo_x_fired == 105u) && (delivered == 2u) && (fsm_timer_pending(&wheel) == 0u);
+}
+
+static signed int mpsc_state_sink(hsm_state_input_t input)
+{
+    if (input.signal == MPSC_SIGNAL_POST) {
+        uintptr_t tag = (uintptr_t)input.pUserContext;
+        unsigned int producer = (unsigned int)(tag >> 16u);
+        unsigned int sequence = (unsigned int)(tag & 0xFFFFu);
+
+        if ((producer >= MPSC_PRODUCER_NUM) || (sequence != g_mpsc_next[producer])) {
+            g_mpsc_disorder++;
+        } else {
+            g_mpsc_next[producer]++;
+        }
+        g_mpsc_received++;
+    }
+
+    return 0;
+}
+
+static void *mpsc_producer(void *pArg)
+{
+    uintptr_t producer = (uintptr_t)pArg;
+
+    for (uintptr_t sequence = 0u; sequence < MPSC_EVENT_NUM; sequence++) {
+        hsm_state_input_t input = {.signal = MPSC_SIGNAL_POST, .pUserContext = (void *)((producer << 16u) | sequence)};
+
+        while (hsm_postInbox(&g_mpsc_manager, input) == EOR_FAULT_ERROR) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Producer threads post to one HSM manager's inbox, wrapping it, while the main thread drains it.
+ *
+ * @return true if every posted event is dispatched exactly once, each producer's events in posting order.
+ */
+static bool mpsc_inbox_drain_check(void)
+{
+    static hsm_extension_t extension;
+    static hsm_state_input_t buffer[MPSC_INBOX_SIZE];
+    static atomic_uint sequence[MPSC_INBOX_SIZE];
+    static fsm_mpsc_t inbox;
+    pthread_t producers[MPSC_PRODUCER_NUM];
+    hsm_state_input_t input = {.signal = HSM_SIGNAL_INIT, .pUserContext = NULL};
+    unsigned int drained = 0u;
+
+    hsm_init(&g_mpsc_manager, &g_mpsc_state_init[0], 1u, 0u, false, NULL);
+    hsm_setExtension(&g_mpsc_manager, &extension);
+    if ((fsm_mpsc_init(&inbox, buffer, sequence, MPSC_INBOX_SIZE, sizeof(hsm_state_input_t))) ||
+        (hsm_setInbox(&g_mpsc_manager, &inbox))) {
+        return false;
+    }
+    hsm_dispatch(&g_mpsc_manager, input);
+
+    for (uintptr_t i = 0u; i < MPSC_PRODUCER_NUM; i++) {
+        if (pthread_create(&producers[i], NULL, mpsc_producer, (void *)i)) {
+            return false;
+        }
+    }
+
+    while (drained < MPSC_PRODUCER_NUM * MPSC_EVENT_NUM) {
+        signed int ret = hsm_drainInbox(&g_mpsc_manager, MPSC_INBOX_SIZE);
+
+        if (ret < 0) {
+            return false;
+        }
+        drained += (unsigned int)ret;
+    }
+
+    for (unsigned int i = 0u; i < MPSC_PRODUCER_NUM; i++) {
+        pthread_join(producers[i], NULL);
+    }
+
+    return (hsm_drainInbox(&g_mpsc_manager, MPSC_INBOX_SIZE) == 0) && (g_mpsc_received == drained) && (g_mpsc_disorder == 0u) &&
+           (fsm_mpsc_count(&inbox) == 0u);
+}
+
+static void* exec_state_toggle(psm_state_manager_t *pManager, psm_state_input_t input)
+{
+    size_t machine = (size_t)(pManager - &g_exec_managers[0]);
+
+    if (input.signal != EXEC_SIGNAL_TOGGLE) {
+        return PSM_ACTION_DONE;
+    }
+
+    if (atomic_exchange(&g_exec_inFlight[machine], true)) {
+        atomic_fetch_add(&g_exec_overlaps, 1u);
+    }
+
+    /* Widen the window another worker would have to run this machine in */
+    for (volatile unsigned int spin = 0u; spin < 200u; spin++) {
+    }
+    g_exec_handled[machine]++;
+
+    atomic_store(&g_exec_inFlight[machine], false);
+    atomic_fetch_add(&g_exec_done, 1u);
+    return psm_transition(pManager, (psm_inst_current_get(pManager) == EXEC_INST_A) ? (EXEC_INST_B) : (EXEC_INST_A));
+}
+
+/**
+ * @brief Events for many PSM machines are posted to a work-stealing executor while its workers run them.
+ *
+ * @return true if no machine's handler ever runs on two workers at once, flagged per machine, and
+ *         every event is run exactly once.
+ */
+static bool exec_exclusive_check(void)
+{
+    static fsm_executor_t executor;
+    static fsm_worker_t workers[EXEC_WORKER_NUM];
+    static fsm_active_slot_t slots[EXEC_WORKER_NUM * EXEC_MACHINE_NUM];
+    static fsm_active_t actives[EXEC_MACHINE_NUM];
+    static fsm_mpsc_t inboxes[EXEC_MACHINE_NUM];
+    static psm_state_input_t buffers[EXEC_MACHINE_NUM][EXEC_INBOX_SIZE];
+    static atomic_uint sequences[EXEC_MACHINE_NUM][EXEC_INBOX_SIZE];
+    psm_state_input_t input = {.signal = EXEC_SIGNAL_TOGGLE, .pUserContext = NULL};
+
+    if (fsm_executor_init(&executor, workers, EXEC_WORKER_NUM, slots, EXEC_MACHINE_NUM)) {
+        return false;
+    }
+    for (unsigned int i = 0u; i < EXEC_MACHINE_NUM; i++) {
+        psm_init(&g_exec_managers[i], &g_exec_state_init[0], EXEC_INST_NUM, EXEC_INST_A, NULL);
+        if ((fsm_mpsc_init(&inboxes[i], buffers[i], sequences[i], EXEC_INBOX_SIZE, sizeof(psm_state_input_t))) ||
+            (fsm_active_init(&actives[i], &executor, &g_exec_managers[i], psm_activities_event, &inboxes[i]))) {
+            return false;
+        }
+    }
+    if (fsm_executor_start(&executor)) {
+        return false;
+    }
+
+    for (unsigned int event = 0u; event < EXEC_EVENT_NUM; event++) {
+        for (unsigned int i = 0u; i < EXEC_MACHINE_NUM; i++) {
+            while (fsm_active_post(&actives[i], &input) == EOR_FAULT_ERROR) {
+                sched_yield();
+            }
+        }
+    }
+
+    while (atomic_load(&g_exec_done) < EXEC_MACHINE_NUM * EXEC_EVENT_NUM) {
+        sched_yield();
+    }
+    fsm_executor_stop(&executor);
+
+    for (unsigned int i = 0u; i < EXEC_MACHINE_NUM; i++) {
+        if ((g_exec_handled[i] != EXEC_EVENT_NUM) || (atomic_load(&actives[i].lastError))) {
+            return false;
+        }
+    }
+    return (atomic_load(&g_exec_overlaps) == 0u) && (atomic_load(&g_exec_done) == EXEC_MACHINE_NUM * EXEC_EVENT_NUM);
+}
+
+static void* fleet_state_count(psm_state_input_t input)
+{
+    fleet_calls_t *pCalls = (fleet_calls_t *)input.pUserContext;
+
+    if (input.signal == PSM_SIGNAL_ENTRY) {
+        pCalls->entries++;
+    } else if (input.signal == PSM_SIGNAL_EXIT) {
+        pCalls->exits++;
+    }
+
+    return PSM_ACTION_DONE;
+}
+
+static unsigned int fleet_random(void)
+{
+    g_fleet_seed = g_fleet_seed * 1103515245u + 12345u;
+    return (g_fleet_seed >> 16u) & 0x7FFFu;
+}
+
+/**
+ * @brief A random fleet table stepped over random states and signals, some out of range, by psm_fleet_step()
+ *        over the whole array, with the AVX2 kernel where the CPU has it, and one instance at a time,
+ *        which only takes the scalar loop.
+ *
+ * @return true if both leave every instance in the same state, after the same handler calls, and
+ *         report the same number of changed instances at every step.
+ */
+static bool fleet_vector_check(void)
+{
+    static psm_rule_t rules[FLEET_STATE_NUM * FLEET_SIGNAL_NUM];
+    static psm_instance_t table[FLEET_STATE_NUM * FLEET_SIGNAL_NUM + PSM_FLEET_TABLE_PAD];
+    static psm_instance_t vector[FLEET_INSTANCE_NUM];
+    static psm_instance_t scalar[FLEET_INSTANCE_NUM];
+    static psm_signal_t signals[FLEET_INSTANCE_NUM];
+    static fleet_calls_t vectorCalls[FLEET_INSTANCE_NUM];
+    static fleet_calls_t scalarCalls[FLEET_INSTANCE_NUM];
+    static void *vectorContexts[FLEET_INSTANCE_NUM];
+    static void *scalarContexts[FLEET_INSTANCE_NUM];
+    psm_fleet_t fleet;
+    unsigned short ruleNumber = 0u;
+
+    for (unsigned int state = 0u; state < FLEET_STATE_NUM; state++) {
+        g_fleet_state_init[state].instance = (psm_instance_t)state;
+        g_fleet_state_init[state].id = state;
+        g_fleet_state_init[state].pName = "fleet_state";
+        g_fleet_state_init[state].pEntryFunc = fleet_state_count;
+        for (unsigned int signal = 0u; signal < FLEET_SIGNAL_NUM; signal++) {
+            if ((fleet_random() % 3u) != 0u) {
+                rules[ruleNumber].current = (psm_instance_t)state;
+                rules[ruleNumber].signal = PSM_SIGNAL_USER_DEFINE + signal;
+                rules[ruleNumber].next = (psm_instance_t)(fleet_random() % FLEET_STATE_NUM);
+                ruleNumber++;
+            }
+        }
+    }
+    if (psm_fleet_compile(&fleet, &g_fleet_state_init[0], FLEET_STATE_NUM, rules, ruleNumber, table,
+                          sizeof(table) / sizeof(table[0]), NULL)) {
+        return false;
+    }
+
+    for (unsigned int i = 0u; i < FLEET_INSTANCE_NUM; i++) {
+        vector[i] = (psm_instance_t)(fleet_random() % (FLEET_STATE_NUM + 1u));
+        scalar[i] = vector[i];
+        vectorContexts[i] = &vectorCalls[i];
+        scalarContexts[i] = &scalarCalls[i];
+    }
+
+    for (unsigned int step = 0u; step < FLEET_STEP_NUM; step++) {
+        signed int changed = 0;
+
+        for (unsigned int i = 0u; i < FLEET_INSTANCE_NUM; i++) {
+            signals[i] = PSM_SIGNAL_USER_DEFINE - 1u + fleet_random() % (FLEET_SIGNAL_NUM + 2u);
+        }
+        for (unsigned int i = 0u; i < FLEET_INSTANCE_NUM; i++) {
+            changed += psm_fleet_step(&fleet, &scalar[i], &signals[i], &scalarContexts[i], 1u);
+        }
+        if (psm_fleet_step(&fleet, vector, signals, vectorContexts, FLEET_INSTANCE_NUM) != changed) {
+            return false;
+        }
+        for (unsigned int i = 0u; i < FLEET_INSTANCE_NUM; i++) {
+            if ((vector[i] != scalar[i]) || (vectorCalls[i].entries != scalarCalls[i].entries) ||
+                (vectorCalls[i].exits != scalarCalls[i].exits)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static signed int defer_state_wait(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    switch(input.signal)
+    {
+        case DEFER_SIGNAL_DATA:
+        {
+            return hsm_defer(pManager, input);
+        }
+        case DEFER_SIGNAL_GO:
+        {
+            return hsm_transition(pManager, DEFER_INST_READY);
+        }
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+static signed int defer_state_ready(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    switch(input.signal)
+    {
+        case DEFER_SIGNAL_DATA:
+        {
+            if (g_defer_received < DEFER_ROUND_NUM * DEFER_EVENT_NUM) {
+                g_defer_order[g_defer_received] = *(const unsigned int *)input.pUserContext;
+            }
+            g_defer_received++;
+            break;
+        }
+        case DEFER_SIGNAL_BACK:
+        {
+            return hsm_transition(pManager, DEFER_INST_WAIT);
+        }
+        default:
+            break;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Queue pooled DATA events to an HSM manager whose WAIT state defers them, then queue GO
+ *        so the transition to READY recalls them.
+ *
+ * @return true if the deferred events hold their payloads until the recall, and the pool is back
+ *         to its capacity once every recalled event is dispatched.
+ */
+static bool defer_pool_release_check(void)
+{
+    static _Alignas(FSM_POOL_ALIGN) unsigned char storage[FSM_POOL_STORAGE_SIZE(sizeof(unsigned int), DEFER_POOL_SIZE)];
+    static hsm_state_manager_t manager = {0u};
+    static hsm_extension_t extension;
+    static hsm_state_input_t queueBuffer[DEFER_RING_SIZE];
+    static hsm_state_input_t deferBuffer[DEFER_RING_SIZE];
+    static fsm_spsc_t queue;
+    static fsm_spsc_t deferred;
+    static fsm_pool_t pool;
+    hsm_state_input_t input = {.signal = HSM_SIGNAL_INIT, .pUserContext = NULL};
+
+    hsm_init(&manager, &g_defer_state_init[0], DEFER_INST_NUM, DEFER_INST_WAIT, false, NULL);
+    hsm_setExtension(&manager, &extension);
+    if ((fsm_pool_init(&pool, storage, sizeof(unsigned int), DEFER_POOL_SIZE)) ||
+        (fsm_spsc_init(&queue, queueBuffer, DEFER_RING_SIZE, sizeof(hsm_state_input_t))) ||
+        (fsm_spsc_init(&deferred, deferBuffer, DEFER_RING_SIZE, sizeof(hsm_state_input_t))) || (hsm_setPool(&manager, &pool)) ||
+        (hsm_setQueue(&manager, &queue)) || (hsm_setDeferQueue(&manager, &deferred))) {
+        return false;
+    }
+    hsm_dispatch(&manager, input);
+
+    for (unsigned int i = 0u; i < DEFER_EVENT_NUM; i++) {
+        unsigned int *pValue = (unsigned int *)fsm_pool_alloc(&pool);
+
+        if (!pValue) {
+            return false;
+        }
+        *pValue = i;
+        input.signal = DEFER_SIGNAL_DATA;
+        input.pUserContext = pValue;
+        if (hsm_post(&manager, input)) {
+            return false;
+        }
+    }
+
+    if ((hsm_drain(&manager, DEFER_RING_SIZE) != (signed int)DEFER_EVENT_NUM) || (g_defer_received != 0u) ||
+        (fsm_pool_available(&pool) != DEFER_POOL_SIZE - DEFER_EVENT_NUM)) {
+        return false;
+    }
+
+    input.signal = DEFER_SIGNAL_GO;
+    input.pUserContext = NULL;
+    if ((hsm_post(&manager, input)) || (hsm_drain(&manager, DEFER_RING_SIZE) != 1)) {
+        return false;
+    }
+
+    return (manager.currentState == DEFER_INST_READY) && (g_defer_received == DEFER_EVENT_NUM) &&
+           (fsm_spsc_count(&deferred) == 0u) && (fsm_pool_available(&pool) == DEFER_POOL_SIZE);
+}
+
+/**
+ * @brief Dispatch numbered DATA events to an HSM manager in WAIT, which defers them, then GO
+ *        to recall them in READY and BACK to wait again, for rounds enough to wrap the defer ring.
+ *
+ * @return true if each round's events reach READY only after GO, all of them and in the order
+ *         they were deferred.
+ */
+static bool defer_recall_order_check(void)
+{
+    static hsm_state_manager_t manager = {0u};
+    static hsm_extension_t extension;
+    static hsm_state_input_t deferBuffer[DEFER_RING_SIZE];
+    static fsm_spsc_t deferred;
+    static unsigned int values[DEFER_ROUND_NUM * DEFER_EVENT_NUM];
+    hsm_state_input_t input = {.signal = HSM_SIGNAL_INIT, .pUserContext = NULL};
+
+    hsm_init(&manager, &g_defer_state_init[0], DEFER_INST_NUM, DEFER_INST_WAIT, false, NULL);
+    hsm_setExtension(&manager, &extension);
+    if ((fsm_spsc_init(&deferred, deferBuffer, DEFER_RING_SIZE, sizeof(hsm_state_input_t))) ||
+        (hsm_setDeferQueue(&manager, &deferred))) {
+        return false;
+    }
+    hsm_dispatch(&manager, input);
+    g_defer_received = 0u;
+
+    for (unsigned int round = 0u; round < DEFER_ROUND_NUM; round++) {
+        for (unsigned int i = 0u; i < DEFER_EVENT_NUM; i++) {
+            unsigned int number = round * DEFER_EVENT_NUM + i;
+
+            values[number] = number;
+            input.signal = DEFER_SIGNAL_DATA;
+            input.pUserContext = &values[number];
+            if (hsm_dispatch(&manager, input)) {
+                return false;
+            }
+        }
+
+        if (g_defer_received != round * DEFER_EVENT_NUM) {
+            return false;
+        }
+
+        input.signal = DEFER_SIGNAL_GO;
+        input.pUserContext = NULL;
+        if ((hsm_dispatch(&manager, input)) || (manager.currentState != DEFER_INST_READY) ||
+            (g_defer_received != (round + 1u) * DEFER_EVENT_NUM)) {
+            return false;
+        }
+
+        input.signal = DEFER_SIGNAL_BACK;
+        if ((hsm_dispatch(&manager, input)) || (manager.currentState != DEFER_INST_WAIT)) {
+            return false;
+        }
+    }
+
+    for (unsigned int i = 0u; i < DEFER_ROUND_NUM * DEFER_EVENT_NUM; i++) {
+        if (g_defer_order[i] != i) {
+            return false;
+        }
+    }
+
+    return (fsm_spsc_count(&deferred) == 0u);
+}
+
+static void* arena_state_idle(psm_state_manager_t *pManager, psm_state_input_t input)
+{
+    switch(input.signal)
+    {
+        case ARENA_SIGNAL_NEXT:
+        {
+            return psm_transition(pManager, ARENA_INST_BUSY);
+        }
+        default:
+            break;
+    }
+
+    return PSM_ACTION_DONE;
+}
+
+static void* arena_state_busy(psm_state_input_t input)
+{
+    (void)input;
+
+    return PSM_ACTION_DONE;
+}
+
+/**
+ * @brief Two slots from a PSM prototype with a profile: run one through its carved queue,
+ *        free it and allocate again, then move both on and reset the arena.
+ *
+ * @return true if every slot has its own extension without the prototype's profile, a freed
+ *         slot is handed out again from its initial state, and reset brings live slots back to it.
+ */
+static bool arena_reuse_check(void)
+{
+    static _Alignas(FSM_ARENA_ALIGN) unsigned char storage[FSM_ARENA_STORAGE_SIZE(sizeof(psm_state_manager_t),
+                                                                                  PSM_ARENA_EXTRA_SIZE(ARENA_QUEUE_DEPTH), ARENA_SLOT_NUM)];
+    static psm_state_manager_t prototype = {0u};
+    static psm_extension_t extension;
+    static fsm_profile_t profile;
+    psm_state_input_t next = {.signal = ARENA_SIGNAL_NEXT, .pUserContext = NULL};
+    fsm_arena_t arena;
+
+    psm_init(&prototype, &g_arena_state_init[0], ARENA_INST_NUM, ARENA_INST_IDLE, NULL);
+    psm_extension_attach(&prototype, &extension);
+    psm_profile_attach(&prototype, &profile);
+    if (fsm_arena_init(&arena, storage, sizeof(psm_state_manager_t), PSM_ARENA_EXTRA_SIZE(ARENA_QUEUE_DEPTH), ARENA_SLOT_NUM,
+                       &prototype, psm_arena_construct)) {
+        return false;
+    }
+
+    psm_state_manager_t *pFirst = (psm_state_manager_t *)fsm_arena_alloc(&arena);
+    psm_state_manager_t *pSecond = (psm_state_manager_t *)fsm_arena_alloc(&arena);
+    if ((!pFirst) || (!pSecond) || (!pFirst->pExtension) || (!pSecond->pExtension)) {
+        return false;
+    }
+    if ((pFirst->pExtension == &extension) || (pFirst->pExtension == pSecond->pExtension) || (pFirst->pExtension->pProfile) ||
+        (pSecond->pExtension->pProfile)) {
+        return false;
+    }
+
+    if ((psm_queue_post(pFirst, next)) || (psm_queue_drain(pFirst, ARENA_QUEUE_DEPTH) != 1) || (pFirst->current != ARENA_INST_BUSY)) {
+        return false;
+    }
+
+    if ((!fsm_arena_free(&arena, pFirst)) || (fsm_arena_free(&arena, pFirst)) || (fsm_arena_used(&arena) != 1u)) {
+        return false;
+    }
+    psm_state_manager_t *pReused = (psm_state_manager_t *)fsm_arena_alloc(&arena);
+    if ((pReused != pFirst) || (pReused->current != ARENA_INST_IDLE) || (pReused->previous != PSM_STATE_INSTANCE_INVALID)) {
+        return false;
+    }
+
+    psm_activities(pReused, next);
+    psm_activities(pSecond, next);
+    fsm_arena_reset(&arena);
+
+    return (fsm_arena_used(&arena) == 2u) && (pReused->current == ARENA_INST_IDLE) && (pSecond->current == ARENA_INST_IDLE) &&
+           (pReused->previous == PSM_STATE_INSTANCE_INVALID) && (pSecond->previous == PSM_STATE_INSTANCE_INVALID);
+}
@@ -0,0 +1,306 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+
+#include <cstdio>
+#include <vector>
+
+#include "hsm.hpp"
+#include "psm.hpp"
+
+/*
+ * Randomized equivalence of the C++ front ends with the C kernel. The same
+ * state types run on hsm::machine and on hsm::manager, which dispatches
+ * through hsm_dispatch(), then on psm::machine and on psm::manager, which
+ * runs psm_activities(). Every handler call, transition and result must match.
+ */
+
+/* User signals in the scripts */
+constexpr unsigned int SCRIPT_SIGNALS = 6u;
+
+/* Events per run */
+constexpr unsigned int SCRIPT_EVENTS = 600u;
+
+/* Seeds, each one a new transition script */
+constexpr unsigned int SCRIPT_SEEDS = 40u;
+
+/* Script targets that aren't states */
+constexpr int TARGET_NONE = -1;
+constexpr int TARGET_FAULT = -2;
+constexpr int TARGET_AGAIN = -3;
+
+/* Transitions and results a handler may take per event, so every script ends */
+constexpr unsigned int EVENT_BUDGET = 3u;
+
+/* Random transition script shared by both sides of a comparison */
+struct script {
+    unsigned int seed;
+    int target[10][HSM_SIGNAL_USER_DEFINE + SCRIPT_SIGNALS];
+
+    unsigned int random()
+    {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 16) & 0x7FFFu;
+    }
+
+    void build(unsigned int states, unsigned int signalBase)
+    {
+        for (unsigned int state = 0u; state < states; state++) {
+            for (unsigned int signal = 0u; signal < signalBase + SCRIPT_SIGNALS; signal++) {
+                const unsigned int roll = random() % 100u;
+
+                if (signal < signalBase) {
+                    target[state][signal] = (roll < 8u) ? static_cast<int>(random() % states) : TARGET_NONE;
+                } else if (roll < 30u) {
+                    target[state][signal] = static_cast<int>(random() % states);
+                } else if (roll < 32u) {
+                    target[state][signal] = TARGET_FAULT;
+                } else if (roll < 35u) {
+                    target[state][signal] = TARGET_AGAIN;
+                } else {
+                    target[state][signal] = TARGET_NONE;
+                }
+            }
+        }
+    }
+};
+
+/* Handler context, logs every call; the observed variant adds a transducer */
+class recorder
+{
+  public:
+    explicit recorder(const script &rules) : rules_(rules), budget_(0u)
+    {
+    }
+
+    void begin(unsigned int signal)
+    {
+        budget_ = EVENT_BUDGET;
+        log_.push_back(0xE0000000u | signal);
+    }
+
+    void end(signed int ret, unsigned int state)
+    {
+        log_.push_back(0xF0000000u | (static_cast<unsigned int>(ret) & 0xFFFu) << 16u | state);
+    }
+
+    /* Script entry for a call, TARGET_NONE once the event's budget is spent */
+    int react(unsigned int state, unsigned int signal)
+    {
+        log_.push_back((state << 16u) | signal);
+
+        const int target = rules_.target[state][signal];
+        if ((target == TARGET_NONE) || (budget_ == 0u)) {
+            return TARGET_NONE;
+        }
+
+        budget_--;
+        return target;
+    }
+
+    const std::vector<unsigned int> &log() const
+    {
+        return log_;
+    }
+
+  protected:
+    signed int observe(unsigned int from, unsigned int to, unsigned int signal)
+    {
+        log_.push_back(0xD0000000u | (from & 0xFFFu) << 16u | (to & 0xFFFu) << 4u | signal);
+        return (((from ^ to) % 11u) == 3u) ? -1 : 0;
+    }
+
+  private:
+    const script &rules_;
+    unsigned int budget_;
+    std::vector<unsigned int> log_;
+};
+
+class observed : public recorder
+{
+  public:
+    using recorder::recorder;
+
+    signed int onTransition(hsm::instance_t from, hsm::instance_t to, const hsm_state_input_t &input)
+    {
+        return observe(from, to, input.signal);
+    }
+
+    signed int onTransition(psm::instance_t from, psm::instance_t to, const psm_state_input_t &input)
+    {
+        return observe(from, to, input.signal);
+    }
+};
+
+/* HSM state I, a child of Parent */
+template <unsigned int I, class Parent>
+struct hstate : hsm::state<Parent> {
+    template <class Machine>
+    static signed int handle(Machine &machine, const typename Machine::input_type &input)
+    {
+        if (machine.getProcessingState() != I) {
+            return hsm::FAULT_ERROR;
+        }
+
+        const int target = machine.context().react(I, input.signal);
+        if (target == TARGET_FAULT) {
+            return hsm::FAULT_ERROR;
+        }
+        if (target >= 0) {
+            return machine.transition(static_cast<hsm::instance_t>(target));
+        }
+        return hsm::OK;
+    }
+};
+
+struct H0 : hstate<0u, hsm::top> {
+};
+struct H1 : hstate<1u, H0> {
+};
+struct H2 : hstate<2u, H0> {
+};
+struct H3 : hstate<3u, H1> {
+};
+struct H4 : hstate<4u, H1> {
+};
+struct H5 : hstate<5u, hsm::top> {
+};
+struct H6 : hstate<6u, H5> {
+};
+struct H7 : hstate<7u, H6> {
+};
+struct H8 : hstate<8u, H3> {
+};
+struct H9 : hstate<9u, H2> {
+};
+
+/* PSM state I */
+template <unsigned int I>
+struct pstate {
+    template <class Machine>
+    static psm::action handle(Machine &machine, const typename Machine::input_type &input)
+    {
+        const int target = machine.context().react(I, input.signal);
+        if (target == TARGET_FAULT) {
+            return psm::action::fault;
+        }
+        if (target == TARGET_AGAIN) {
+            return psm::action::next;
+        }
+        if (target >= 0) {
+            return machine.transition(static_cast<psm::instance_t>(target));
+        }
+        return psm::action::done;
+    }
+};
+
+struct P0 : pstate<0u> {
+};
+struct P1 : pstate<1u> {
+};
+struct P2 : pstate<2u> {
+};
+struct P3 : pstate<3u> {
+};
+struct P4 : pstate<4u> {
+};
+struct P5 : pstate<5u> {
+};
+
+/* Event stream of a run, the first one may be INIT */
+static unsigned int hsm_event(script &events, unsigned int index)
+{
+    if (index == 0u) {
+        return (events.random() % 2u) ? static_cast<unsigned int>(HSM_SIGNAL_INIT)
+                                      : (HSM_SIGNAL_USER_DEFINE + events.random() % SCRIPT_SIGNALS);
+    }
+    return ((events.random() % 10u) == 0u) ? (events.random() % HSM_SIGNAL_USER_DEFINE)
+                                            : (HSM_SIGNAL_USER_DEFINE + events.random() % SCRIPT_SIGNALS);
+}
+
+static unsigned int psm_event(script &events)
+{
+    return ((events.random() % 10u) == 0u) ? (events.random() % PSM_SIGNAL_USER_DEFINE)
+                                            : (PSM_SIGNAL_USER_DEFINE + events.random() % SCRIPT_SIGNALS);
+}
+
+template <class Context, hsm::mode Mode, class Initial>
+static bool hsm_compare(unsigned int seed)
+{
+    script rules = {seed, {}};
+    rules.build(10u, HSM_SIGNAL_USER_DEFINE);
+
+    Context cxxSide(rules);
+    Context cSide(rules);
+    hsm::machine<Context, Mode, hsm_state_input_t, Initial, H0, H1, H2, H3, H4, H5, H6, H7, H8, H9> machine(cxxSide);
+    hsm::manager<Context, Mode, Initial, H0, H1, H2, H3, H4, H5, H6, H7, H8, H9> manager(cSide);
+    script events = {seed ^ 0x5A5Au, {}};
+
+    for (unsigned int i = 0u; i < SCRIPT_EVENTS; i++) {
+        hsm_state_input_t input = {};
+
+        input.signal = hsm_event(events, i);
+        cxxSide.begin(input.signal);
+        cxxSide.end(machine.dispatch(input), machine.getTargetState());
+        cSide.begin(input.signal);
+        cSide.end(manager.dispatch(input), manager.getTargetState());
+    }
+
+    return (cxxSide.log() == cSide.log());
+}
+
+template <class Context, class Initial>
+static bool psm_compare(unsigned int seed)
+{
+    script rules = {seed, {}};
+    rules.build(6u, PSM_SIGNAL_USER_DEFINE);
+
+    Context cxxSide(rules);
+    Context cSide(rules);
+    psm::machine<Context, psm_state_input_t, Initial, P0, P1, P2, P3, P4, P5> machine(cxxSide);
+    psm::manager<Context, Initial, P0, P1, P2, P3, P4, P5> manager(cSide);
+    script events = {seed ^ 0xA5A5u, {}};
+
+    for (unsigned int i = 0u; i < SCRIPT_EVENTS; i++) {
+        psm_state_input_t input = {};
+
+        input.signal = psm_event(events);
+        cxxSide.begin(input.signal);
+        cxxSide.end(machine.activities(input), machine.getCurrentState());
+        cSide.begin(input.signal);
+        cSide.end(manager.activities(input), manager.getCurrentState());
+    }
+
+    return (cxxSide.log() == cSide.log());
+}
+
+int main(void)
+{
+    unsigned int runs = 0u;
+    unsigned int failures = 0u;
+
+    for (unsigned int seed = 1u; seed <= SCRIPT_SEEDS; seed++) {
+        const bool results[] = {
+            hsm_compare<recorder, hsm::mode::pass_through, H0>(seed),
+            hsm_compare<recorder, hsm::mode::current_node, H8>(seed),
+            hsm_compare<observed, hsm::mode::pass_through, H7>(seed),
+            hsm_compare<observed, hsm::mode::current_node, H4>(seed),
+            psm_compare<recorder, P0>(seed),
+            psm_compare<observed, P3>(seed),
+        };
+
+        for (unsigned int i = 0u; i < sizeof(results) / sizeof(results[0]); i++) {
+            runs++;
+            if (!results[i]) {
+                std::printf("mismatch: seed %u, run %u\n", seed, i);
+                failures++;
+            }
+        }
+    }
+
+    std::printf("%u of %u runs match the C kernel\n", runs - failures, runs);
+    return (failures == 0u) ? 0 : 1;
+}
@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Hierarchy depths and flat state counts swept by the suites */
+#define BENCH_DEPTH_MAX  (32u)
+#define BENCH_FANOUT_MAX (10000u)
+
+/* Running measurement, started by bench_begin() and closed by bench_end() */
+typedef struct {
+    uint64_t startNs;
+    uint64_t startCycles;
+} bench_clock_t;
+
+/* Options shared by all suites */
+typedef struct {
+    unsigned long events; /* Operations timed per measurement */
+    bool json;            /* Emit JSON instead of a text table */
+} bench_config_t;
+
+extern bench_config_t g_benchConfig;
+
+void bench_begin(bench_clock_t *pClock);
+void bench_end(const bench_clock_t *pClock,
+               const char *pName,
+               const char *pMode,
+               unsigned int depth,
+               unsigned int states,
+               unsigned long ops);
+
+void bench_psm_run(void);
+void bench_hsm_run(void);
+
+#endif /* _BENCH_H_ */
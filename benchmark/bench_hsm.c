@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include "hsm.h"
+#include "bench.h"
+
+enum {
+    BENCH_HSM_SIGNAL_IDLE = HSM_SIGNAL_USER_DEFINE, /* Handled, no transition */
+    BENCH_HSM_SIGNAL_NEXT,                          /* Leaf transitions to its partner state */
+};
+
+/* Transition cache slots for the compiled runs */
+#define BENCH_HSM_CACHE_SIZE (8u)
+
+static hsm_state_t s_hsmStates[BENCH_FANOUT_MAX];
+static hsm_instance_t s_hsmPartner[BENCH_FANOUT_MAX];
+static hsm_state_path_t s_hsmPaths[2u * BENCH_DEPTH_MAX];
+static hsm_transition_path_t s_hsmCache[BENCH_HSM_CACHE_SIZE];
+
+/**
+ * @brief Handler shared by every benchmark state.
+ *
+ * Only the active leaf reacts to NEXT, so in pass-through mode the ancestors
+ * are visited but don't transition.
+ */
+static signed int bench_hsm_handler(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    if ((input.signal == BENCH_HSM_SIGNAL_NEXT) && (pManager->processingState == pManager->currentState)) {
+        return hsm_transition(pManager, s_hsmPartner[pManager->currentState]);
+    }
+    return HSM_OK;
+}
+
+/**
+ * @brief Build two disjoint chains of depth levels: 0..depth-1 and depth..2*depth-1.
+ *
+ * The two leaves are partners, so NEXT exits one whole chain and enters the
+ * other.
+ */
+static unsigned short bench_hsm_buildChains(unsigned int depth)
+{
+    for (unsigned int chain = 0u; chain < 2u; chain++) {
+        for (unsigned int level = 0u; level < depth; level++) {
+            unsigned int i = chain * depth + level;
+
+            s_hsmStates[i].pParent = (level != 0u) ? &s_hsmStates[i - 1u] : NULL;
+            s_hsmStates[i].instance = (hsm_instance_t)i;
+            s_hsmStates[i].id = i;
+            s_hsmStates[i].pName = "bench";
+            s_hsmStates[i].pHandler = NULL;
+            s_hsmStates[i].pHandlerEx = bench_hsm_handler;
+        }
+    }
+    s_hsmPartner[depth - 1u] = (hsm_instance_t)(2u * depth - 1u);
+    s_hsmPartner[2u * depth - 1u] = (hsm_instance_t)(depth - 1u);
+
+    return (unsigned short)(2u * depth);
+}
+
+/**
+ * @brief Build count top-level states, NEXT moves each one to the following state.
+ */
+static unsigned short bench_hsm_buildFlat(unsigned int count)
+{
+    for (unsigned int i = 0u; i < count; i++) {
+        s_hsmStates[i].pParent = NULL;
+        s_hsmStates[i].instance = (hsm_instance_t)i;
+        s_hsmStates[i].id = i;
+        s_hsmStates[i].pName = "bench";
+        s_hsmStates[i].pHandler = NULL;
+        s_hsmStates[i].pHandlerEx = bench_hsm_handler;
+        s_hsmPartner[i] = (hsm_instance_t)((i + 1u) % count);
+    }
+
+    return (unsigned short)count;
+}
+
+/**
+ * @brief Time a run of identical signals through one HSM manager.
+ */
+static void bench_hsm_measure(const char *pName,
+                              const char *pMode,
+                              unsigned int depth,
+                              unsigned short stateCount,
+                              hsm_instance_t initialState,
+                              bool passThrough,
+                              bool compiled,
+                              hsm_signal_t signal)
+{
+    hsm_machine_t machine;
+    hsm_extension_t extension;
+    hsm_state_manager_t manager;
+    hsm_state_input_t input = {.signal = HSM_SIGNAL_INIT, .pUserContext = NULL};
+    bench_clock_t clock;
+
+    hsm_init(&manager, s_hsmStates, stateCount, initialState, passThrough, NULL);
+    if (compiled) {
+        hsm_defineMachine(&machine, s_hsmStates, stateCount, initialState, passThrough, NULL);
+        if (hsm_compile(&machine, s_hsmPaths) != HSM_OK) {
+            return;
+        }
+        hsm_initMachine(&manager, &machine);
+        hsm_setExtension(&manager, &extension);
+        hsm_setTransitionCache(&manager, s_hsmCache, BENCH_HSM_CACHE_SIZE);
+    }
+
+    /* Enter the initial state before timing, the first dispatch also replays its signal */
+    hsm_dispatch(&manager, input);
+    input.signal = signal;
+
+    bench_begin(&clock);
+    for (unsigned long i = 0u; i < g_benchConfig.events; i++) {
+        hsm_dispatch(&manager, input);
+    }
+    bench_end(&clock, pName, pMode, depth, stateCount, g_benchConfig.events);
+}
+
+/**
+ * @brief Run the HSM suite in both signal modes: depth scaling and wide fan-outs.
+ *
+ * The compiled runs use hsm_compile() and a transition cache, and are skipped
+ * for hierarchies deeper than HSM_DEPTH_MAX.
+ */
+void bench_hsm_run(void)
+{
+    static const unsigned int depths[] = {1u, 2u, 4u, 8u, 16u, 24u, BENCH_DEPTH_MAX};
+    static const unsigned int fanouts[] = {10u, 100u, 1000u, BENCH_FANOUT_MAX};
+
+    for (unsigned int mode = 0u; mode < 2u; mode++) {
+        bool passThrough = (mode == 0u);
+        const char *pMode = passThrough ? "pass_through" : "current_node";
+        const char *pCompiledMode = passThrough ? "pass_through+compiled" : "current_node+compiled";
+
+        for (unsigned int i = 0u; i < sizeof(depths) / sizeof(depths[0]); i++) {
+            unsigned int depth = depths[i];
+            unsigned short stateCount = bench_hsm_buildChains(depth);
+            hsm_instance_t leaf = (hsm_instance_t)(depth - 1u);
+
+            bench_hsm_measure("hsm_dispatch/event", pMode, depth, stateCount, leaf, passThrough, false, BENCH_HSM_SIGNAL_IDLE);
+            bench_hsm_measure("hsm_dispatch/transition", pMode, depth, stateCount, leaf, passThrough, false, BENCH_HSM_SIGNAL_NEXT);
+            if (depth <= HSM_DEPTH_MAX) {
+                bench_hsm_measure("hsm_dispatch/transition", pCompiledMode, depth, stateCount, leaf, passThrough, true,
+                                  BENCH_HSM_SIGNAL_NEXT);
+            }
+        }
+
+        for (unsigned int i = 0u; i < sizeof(fanouts) / sizeof(fanouts[0]); i++) {
+            unsigned short stateCount = bench_hsm_buildFlat(fanouts[i]);
+
+            bench_hsm_measure("hsm_dispatch/fanout", pMode, 1u, stateCount, 0u, passThrough, false, BENCH_HSM_SIGNAL_NEXT);
+        }
+    }
+}
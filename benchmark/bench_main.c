@@ -0,0 +1,146 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "bench.h"
+
+bench_config_t g_benchConfig = {
+    .events = 1000000ul,
+    .json = false,
+};
+
+/* Results printed so far, used to place JSON separators */
+static unsigned int s_resultCount = 0u;
+
+/**
+ * @brief Read the monotonic clock in nanoseconds.
+ */
+static uint64_t bench_nowNs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * @brief Read the cycle counter, 0 where none is available.
+ *
+ * On x86 this is the TSC, which counts reference cycles at a fixed rate.
+ */
+static uint64_t bench_nowCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return 0u;
+#endif
+}
+
+void bench_begin(bench_clock_t *pClock)
+{
+    pClock->startNs = bench_nowNs();
+    pClock->startCycles = bench_nowCycles();
+}
+
+void bench_end(const bench_clock_t *pClock,
+               const char *pName,
+               const char *pMode,
+               unsigned int depth,
+               unsigned int states,
+               unsigned long ops)
+{
+    uint64_t cycles = bench_nowCycles() - pClock->startCycles;
+    uint64_t elapsedNs = bench_nowNs() - pClock->startNs;
+    double nsPerOp = (ops != 0u) ? (double)elapsedNs / (double)ops : 0.0;
+    double cyclesPerOp = (ops != 0u) ? (double)cycles / (double)ops : 0.0;
+
+    if (g_benchConfig.json) {
+        printf("%s\n    {\"name\": \"%s\", \"mode\": \"%s\", \"depth\": %u, \"states\": %u, \"ops\": %lu, "
+               "\"ns_per_op\": %.3f, \"cycles_per_op\": %.1f}",
+               (s_resultCount != 0u) ? "," : "",
+               pName,
+               pMode,
+               depth,
+               states,
+               ops,
+               nsPerOp,
+               cyclesPerOp);
+    } else {
+        printf("%-26s %-22s %5u %6u %10lu %10.2f %10.1f\n", pName, pMode, depth, states, ops, nsPerOp, cyclesPerOp);
+    }
+    s_resultCount++;
+}
+
+/**
+ * @brief Print usage.
+ */
+static void bench_usage(const char *pProgram)
+{
+    fprintf(stderr,
+            "usage: %s [--json] [--events N] [--suite psm|hsm|all]\n"
+            "  --json      print results as JSON\n"
+            "  --events N  operations per measurement (default %lu)\n"
+            "  --suite S   run only the psm or hsm suite\n",
+            pProgram,
+            g_benchConfig.events);
+}
+
+int main(int argc, char **argv)
+{
+    const char *pSuite = "all";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            g_benchConfig.json = true;
+        } else if ((strcmp(argv[i], "--events") == 0) && (i + 1 < argc)) {
+            g_benchConfig.events = strtoul(argv[++i], NULL, 10);
+        } else if ((strcmp(argv[i], "--suite") == 0) && (i + 1 < argc)) {
+            pSuite = argv[++i];
+        } else {
+            bench_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (g_benchConfig.events == 0u) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    if (g_benchConfig.json) {
+        printf("{\n  \"benchmark\": \"fsm\",\n  \"events\": %lu,\n  \"cycle_counter\": %s,\n  \"results\": [",
+               g_benchConfig.events,
+               (bench_nowCycles() != 0u) ? "true" : "false");
+    } else {
+        printf("%-26s %-22s %5s %6s %10s %10s %10s\n", "benchmark", "mode", "depth", "states", "ops", "ns/op", "cycles/op");
+    }
+
+    if ((strcmp(pSuite, "all") == 0) || (strcmp(pSuite, "psm") == 0)) {
+        bench_psm_run();
+    }
+    if ((strcmp(pSuite, "all") == 0) || (strcmp(pSuite, "hsm") == 0)) {
+        bench_hsm_run();
+    }
+
+    if (g_benchConfig.json) {
+        printf("\n  ]\n}\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include "psm.h"
+#include "bench.h"
+
+enum {
+    BENCH_PSM_SIGNAL_IDLE = PSM_SIGNAL_USER_DEFINE, /* Handled, no transition */
+    BENCH_PSM_SIGNAL_NEXT,                          /* Transition to the following state */
+};
+
+static psm_state_t s_psmStates[BENCH_FANOUT_MAX];
+
+/**
+ * @brief Entry shared by every benchmark state, NEXT moves to the following state.
+ */
+static void *bench_psm_entry(psm_state_manager_t *pManager, psm_state_input_t input)
+{
+    if (input.signal == BENCH_PSM_SIGNAL_NEXT) {
+        return psm_transition(pManager, (psm_instance_t)((pManager->current + 1u) % pManager->number));
+    }
+    return PSM_ACTION_DONE;
+}
+
+/**
+ * @brief Time a run of identical signals through one PSM manager.
+ */
+static void bench_psm_measure(const char *pName, unsigned short number, psm_signal_t signal)
+{
+    psm_state_manager_t manager;
+    psm_state_input_t input = {.signal = BENCH_PSM_SIGNAL_IDLE, .pUserContext = NULL};
+    bench_clock_t clock;
+
+    psm_init(&manager, s_psmStates, number, 0u, NULL);
+    psm_activities(&manager, input);
+    input.signal = signal;
+
+    bench_begin(&clock);
+    for (unsigned long i = 0u; i < g_benchConfig.events; i++) {
+        psm_activities(&manager, input);
+    }
+    bench_end(&clock, pName, "flat", 1u, number, g_benchConfig.events);
+}
+
+/**
+ * @brief Run the PSM suite: plain events, two-state ping-pong and wide fan-outs.
+ */
+void bench_psm_run(void)
+{
+    static const unsigned short fanouts[] = {2u, 10u, 100u, 1000u, BENCH_FANOUT_MAX};
+
+    for (unsigned short i = 0u; i < BENCH_FANOUT_MAX; i++) {
+        s_psmStates[i].instance = i;
+        s_psmStates[i].id = i;
+        s_psmStates[i].pName = "bench";
+        s_psmStates[i].pEntryFunc = NULL;
+        s_psmStates[i].pEntryExFunc = bench_psm_entry;
+    }
+
+    bench_psm_measure("psm_activities/event", 2u, BENCH_PSM_SIGNAL_IDLE);
+    for (unsigned int i = 0u; i < sizeof(fanouts) / sizeof(fanouts[0]); i++) {
+        bench_psm_measure("psm_activities/transition", fanouts[i], BENCH_PSM_SIGNAL_NEXT);
+    }
+}
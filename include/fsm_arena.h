@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_ARENA_H_
+#define _FSM_ARENA_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fsm_error.h"
+#include "fsm_queue.h"
+
+/* Alignment of every slot, instances never share a cache line */
+#define FSM_ARENA_ALIGN FSM_CACHE_LINE_SIZE
+
+#define FSM_ARENA_ROUND(size) ((((size_t)(size)) + FSM_ARENA_ALIGN - 1u) & ~((size_t)FSM_ARENA_ALIGN - 1u))
+
+/* Link of a slot in use */
+#define FSM_ARENA_LIVE (0xFFFFFFFFu)
+
+/* Bytes of one slot: the object, then its per-instance storage */
+#define FSM_ARENA_STRIDE(objectSize, extraSize) (FSM_ARENA_ROUND(objectSize) + FSM_ARENA_ROUND(extraSize))
+
+/* Bytes of storage for capacity slots, to pass to fsm_arena_init() */
+#define FSM_ARENA_STORAGE_SIZE(objectSize, extraSize, capacity)                                                                            \
+    (FSM_ARENA_ROUND(sizeof(unsigned int) * (size_t)(capacity)) + FSM_ARENA_STRIDE(objectSize, extraSize) * (size_t)(capacity))
+
+/* Per-instance storage holding an event ring of capacity elements, for fsm_arena_carveQueue() */
+#define FSM_ARENA_QUEUE_SIZE(elemSize, capacity) (FSM_ARENA_ROUND(sizeof(fsm_spsc_t)) + (size_t)(elemSize) * (size_t)(capacity))
+
+/* Per-instance storage holding a manager extension, then an event ring of capacity elements */
+#define FSM_ARENA_EXTENSION_SIZE(extensionSize, elemSize, capacity)                                                                        \
+    (FSM_ARENA_ROUND(extensionSize) + FSM_ARENA_QUEUE_SIZE(elemSize, capacity))
+
+/* Puts a slot's object in its initial state, from the prototype, on allocation and reset */
+typedef void (*fsm_arena_construct_t)(void *pObject, void *pExtra, size_t extraSize, const void *pPrototype);
+
+/* Slab of fixed-size machine instances, owned by one thread */
+typedef struct {
+    unsigned char *pSlots;             /* capacity slots of stride bytes */
+    unsigned int *pLinks;              /* Per slot: next free slot index + 1 (0 ends the list), FSM_ARENA_LIVE in use */
+    size_t stride;                     /* Bytes per slot */
+    size_t objectSize;                 /* Bytes of the object, rounded */
+    size_t extraSize;                  /* Bytes of per-instance storage after the object, rounded */
+    unsigned int capacity;             /* Number of slots */
+    unsigned int freeHead;             /* First free slot index + 1, 0 when full */
+    unsigned int used;                 /* Slots in use */
+    const void *pPrototype;            /* Initial state copied into new objects */
+    fsm_arena_construct_t pConstruct;  /* Constructor, NULL to copy objectSize bytes of the prototype */
+} fsm_arena_t;
+
+signed int fsm_arena_init(fsm_arena_t *pArena,
+                          void *pStorage,
+                          size_t objectSize,
+                          size_t extraSize,
+                          unsigned int capacity,
+                          const void *pPrototype,
+                          fsm_arena_construct_t pConstruct);
+void *fsm_arena_alloc(fsm_arena_t *pArena);
+bool fsm_arena_free(fsm_arena_t *pArena, void *pObject);
+void fsm_arena_reset(fsm_arena_t *pArena);
+void fsm_arena_clear(fsm_arena_t *pArena);
+void *fsm_arena_extra(const fsm_arena_t *pArena, const void *pObject);
+unsigned int fsm_arena_used(const fsm_arena_t *pArena);
+fsm_spsc_t *fsm_arena_carveQueue(void *pExtra, size_t extraSize, size_t elemSize);
+
+#endif /* _FSM_ARENA_H_ */
@@ -0,0 +1,16 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_ERROR_H_
+#define _FSM_ERROR_H_
+
+/* Error codes shared by every kernel module */
+#define FSM_OK               (0)
+#define EOR_INVALID_ARGUMENT (-1)
+#define EOR_INVALID_DATA     (-2)
+#define EOR_FAULT_ERROR      (-3)
+
+#endif /* _FSM_ERROR_H_ */
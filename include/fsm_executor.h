@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_EXECUTOR_H_
+#define _FSM_EXECUTOR_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "fsm_queue.h"
+
+/* Events an active object runs before yielding its worker */
+#ifndef FSM_EXECUTOR_BATCH
+#define FSM_EXECUTOR_BATCH (64u)
+#endif
+
+/* Machine dispatch adapter, hsm_dispatchEvent() or psm_activities_event() */
+typedef signed int (*fsm_dispatch_t)(void *pMachine, const void *pEvent);
+
+struct fsm_executor;
+
+/* Active object: one state machine, its inbox and its scheduling state */
+typedef struct fsm_active {
+    void *pMachine;                     /* hsm_state_manager_t or psm_state_manager_t */
+    fsm_dispatch_t pDispatch;           /* Adapter running one event on pMachine */
+    fsm_mpsc_t *pInbox;                 /* Pending events, element type matches the adapter */
+    struct fsm_executor *pExecutor;     /* Executor running this object */
+    struct fsm_active *pNext;           /* Injection list link */
+    atomic_bool isScheduled;            /* Queued or running on a worker */
+    atomic_int lastError;               /* Last failed dispatch result, 0 if none */
+} fsm_active_t;
+
+/* Work-stealing deque slot */
+typedef _Atomic(fsm_active_t *) fsm_active_slot_t;
+
+/* Worker thread with its Chase-Lev deque */
+typedef struct {
+    _Alignas(FSM_CACHE_LINE_SIZE) atomic_long top;    /* Steal end, advanced by thieves */
+    _Alignas(FSM_CACHE_LINE_SIZE) atomic_long bottom; /* Owner end */
+    fsm_active_slot_t *pSlots;                        /* Deque storage */
+    long mask;                                        /* Capacity - 1 */
+    struct fsm_executor *pExecutor;
+    unsigned int index;                               /* Position in the executor */
+    unsigned int victim;                              /* Next worker to steal from */
+    pthread_t thread;
+} fsm_worker_t;
+
+/* Executor owning a pool of workers */
+typedef struct fsm_executor {
+    fsm_worker_t *pWorkers;
+    unsigned int workerCount;
+    _Atomic(fsm_active_t *) pInjected; /* Objects made ready outside any worker */
+    atomic_bool isRunning;
+    atomic_uint sleepers;              /* Workers parked on wakeup */
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+} fsm_executor_t;
+
+signed int fsm_executor_init(fsm_executor_t *pExecutor,
+                             fsm_worker_t *pWorkers,
+                             unsigned int workerCount,
+                             fsm_active_slot_t *pSlots,
+                             unsigned int slotsPerWorker);
+signed int fsm_executor_start(fsm_executor_t *pExecutor);
+signed int fsm_executor_stop(fsm_executor_t *pExecutor);
+signed int fsm_active_init(fsm_active_t *pActive,
+                           fsm_executor_t *pExecutor,
+                           void *pMachine,
+                           fsm_dispatch_t pDispatch,
+                           fsm_mpsc_t *pInbox);
+signed int fsm_active_post(fsm_active_t *pActive, const void *pEvent);
+
+#endif /* _FSM_EXECUTOR_H_ */
@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_INDEX_H_
+#define _FSM_INDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "fsm_error.h"
+
+/* No row matches the (state, signal) key */
+#define FSM_INDEX_NONE (0xFFFFu)
+
+/* Widest signal range compiled into a dense array, wider ranges use a perfect hash */
+#ifndef FSM_INDEX_DENSE_SPAN_MAX
+#define FSM_INDEX_DENSE_SPAN_MAX (32u)
+#endif
+
+/* Key every indexed row starts with (psm_rule_t and hsm_rule_t share this layout) */
+typedef struct {
+    unsigned short state;
+    unsigned int signal;
+} fsm_index_key_t;
+
+/* Compiled (state, signal) -> first matching row lookup */
+typedef struct {
+    unsigned short *pSlots;    /* Slot storage, each slot holds a row index or FSM_INDEX_NONE */
+    unsigned int slotCount;    /* Capacity of pSlots */
+    bool dense;                /* true: state * signalSpan array, false: perfect hash */
+    unsigned short stateCount; /* Dense: number of states */
+    unsigned int signalBase;   /* Dense: smallest indexed signal */
+    unsigned int signalSpan;   /* Dense: signals per state */
+    unsigned int bucketMask;   /* Hash: number of displacement buckets - 1 */
+    unsigned int hashMask;     /* Hash: number of row slots - 1 */
+} fsm_index_t;
+
+signed int fsm_index_build(fsm_index_t *pIndex,
+                           unsigned short *pSlots,
+                           unsigned int slotCount,
+                           const void *pRows,
+                           unsigned short rowCount,
+                           size_t rowSize,
+                           unsigned short stateCount);
+
+/**
+ * @brief Get the key of an indexed row.
+ */
+static inline const fsm_index_key_t *fsm_index_key(const void *pRows, size_t rowSize, unsigned short row)
+{
+    return (const fsm_index_key_t *)(const void *)((const char *)pRows + (size_t)row * rowSize);
+}
+
+/**
+ * @brief Hash a (state, signal) key with the given seed.
+ *
+ * Seed 0 selects the displacement bucket, seed d + 1 the row slot of a key
+ * whose bucket was displaced by d.
+ */
+static inline unsigned int fsm_index_hash(unsigned short state, unsigned int signal, unsigned int seed)
+{
+    unsigned int hash = ((unsigned int)state * 0x9E3779B1u) + seed;
+
+    hash ^= hash >> 16;
+    hash = (hash * 0x85EBCA6Bu) ^ signal;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+/**
+ * @brief Find the first row matching (state, signal).
+ *
+ * Rows sharing a key are contiguous, so callers walk forward from the
+ * returned row while the key still matches.
+ *
+ * @return The row index, or FSM_INDEX_NONE if no row matches.
+ */
+static inline unsigned short fsm_index_find(const fsm_index_t *pIndex,
+                                            const void *pRows,
+                                            size_t rowSize,
+                                            unsigned short state,
+                                            unsigned int signal)
+{
+    if (pIndex->dense) {
+        if ((state >= pIndex->stateCount) || (signal < pIndex->signalBase) || (signal - pIndex->signalBase >= pIndex->signalSpan)) {
+            return FSM_INDEX_NONE;
+        }
+        return pIndex->pSlots[(unsigned int)state * pIndex->signalSpan + (signal - pIndex->signalBase)];
+    }
+
+    /* Perfect hash: pSlots holds the bucket displacements followed by the row slots */
+    unsigned int displace = pIndex->pSlots[fsm_index_hash(state, signal, 0u) & pIndex->bucketMask];
+    unsigned short row = pIndex->pSlots[pIndex->bucketMask + 1u + (fsm_index_hash(state, signal, displace + 1u) & pIndex->hashMask)];
+    if (row != FSM_INDEX_NONE) {
+        const fsm_index_key_t *pKey = fsm_index_key(pRows, rowSize, row);
+        if ((pKey->state != state) || (pKey->signal != signal)) {
+            return FSM_INDEX_NONE;
+        }
+    }
+    return row;
+}
+
+#endif /* _FSM_INDEX_H_ */
@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_METRICS_H_
+#define _FSM_METRICS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "fsm_error.h"
+
+/* Set to 1 to publish every dispatch into the manager's metrics slot, 0 compiles the hooks out */
+#ifndef FSM_METRICS_ENABLE
+#define FSM_METRICS_ENABLE (0)
+#endif
+
+/* Segment header magic, "FSMM" */
+#define FSM_METRICS_MAGIC (0x4D4D5346u)
+
+/* Bumped whenever the segment layout changes */
+#define FSM_METRICS_VERSION (1u)
+
+/* Times a reader retries a slot being written before giving up on it */
+#define FSM_METRICS_READ_RETRIES (64u)
+
+/* Machine kind of a slot */
+enum fsm_metrics_kind {
+    FSM_METRICS_KIND_FREE = 0u,
+    FSM_METRICS_KIND_PSM,
+    FSM_METRICS_KIND_HSM,
+};
+
+/* Published view of one manager, guarded by a seqlock, one cache line */
+typedef struct fsm_metrics_slot {
+    _Alignas(64) atomic_uint sequence; /* Odd while the dispatcher writes */
+    atomic_uint kind;                  /* enum fsm_metrics_kind */
+    atomic_uint state;                 /* Current state instance */
+    atomic_uint queueDepth;            /* Events waiting in the manager's queue and inbox */
+    atomic_ullong tag;                 /* Caller chosen identifier, e.g. a session id */
+    atomic_ullong dispatches;          /* Events dispatched */
+    atomic_ullong transitions;         /* Dispatches that changed the current state */
+} fsm_metrics_slot_t;
+
+/* Segment header, followed by capacity slots */
+typedef struct {
+    _Alignas(64) uint32_t magic; /* FSM_METRICS_MAGIC */
+    uint32_t version;            /* FSM_METRICS_VERSION */
+    uint32_t slotSize;           /* sizeof(fsm_metrics_slot_t) */
+    uint32_t capacity;           /* Slots in the segment */
+    atomic_uint claimed;         /* Slots handed out so far */
+} fsm_metrics_header_t;
+
+/* Mapping of a segment, in the publishing or in a monitoring process */
+typedef struct {
+    fsm_metrics_header_t *pHeader; /* Start of the mapping */
+    fsm_metrics_slot_t *pSlots;    /* Slot array */
+    size_t size;                   /* Mapping length in bytes */
+} fsm_metrics_t;
+
+/* Consistent copy of a slot */
+typedef struct {
+    uint64_t tag;
+    uint64_t dispatches;
+    uint64_t transitions;
+    uint32_t kind;
+    uint32_t state;
+    uint32_t queueDepth;
+} fsm_metrics_sample_t;
+
+signed int fsm_metrics_create(fsm_metrics_t *pMetrics, const char *pName, unsigned int capacity);
+signed int fsm_metrics_open(fsm_metrics_t *pMetrics, const char *pName);
+signed int fsm_metrics_close(fsm_metrics_t *pMetrics, const char *pUnlinkName);
+fsm_metrics_slot_t *fsm_metrics_claim(fsm_metrics_t *pMetrics, unsigned int kind, uint64_t tag);
+unsigned int fsm_metrics_count(const fsm_metrics_t *pMetrics);
+bool fsm_metrics_read(const fsm_metrics_t *pMetrics, unsigned int index, fsm_metrics_sample_t *pSample);
+
+/**
+ * @brief Update a slot, from the thread currently dispatching its manager only.
+ *
+ * Readers never block the writer: it bumps the sequence to odd, stores the
+ * fields and bumps it back to even, a reader that saw the sequence move
+ * retries instead.
+ *
+ * @param pSlot        The manager's slot.
+ * @param state        The current state.
+ * @param dispatches   Events dispatched since the last update.
+ * @param transitions  State changes since the last update.
+ * @param queueDepth   Events still waiting for the manager.
+ */
+static inline void fsm_metrics_publish(fsm_metrics_slot_t *pSlot,
+                                       unsigned int state,
+                                       unsigned int dispatches,
+                                       unsigned int transitions,
+                                       unsigned int queueDepth)
+{
+    unsigned int sequence = atomic_load_explicit(&pSlot->sequence, memory_order_relaxed);
+    unsigned long long dispatched = atomic_load_explicit(&pSlot->dispatches, memory_order_relaxed);
+    unsigned long long transitioned = atomic_load_explicit(&pSlot->transitions, memory_order_relaxed);
+
+    atomic_store_explicit(&pSlot->sequence, sequence + 1u, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&pSlot->state, state, memory_order_relaxed);
+    atomic_store_explicit(&pSlot->queueDepth, queueDepth, memory_order_relaxed);
+    atomic_store_explicit(&pSlot->dispatches, dispatched + dispatches, memory_order_relaxed);
+    atomic_store_explicit(&pSlot->transitions, transitioned + transitions, memory_order_relaxed);
+    atomic_store_explicit(&pSlot->sequence, sequence + 2u, memory_order_release);
+}
+
+#endif /* _FSM_METRICS_H_ */
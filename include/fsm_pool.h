@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_POOL_H_
+#define _FSM_POOL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "fsm_error.h"
+
+/* Alignment of every payload */
+#define FSM_POOL_ALIGN (_Alignof(max_align_t))
+
+#define FSM_POOL_ROUND(size) ((((size_t)(size)) + FSM_POOL_ALIGN - 1u) & ~(FSM_POOL_ALIGN - 1u))
+
+/* Block header, placed right before the payload */
+typedef struct {
+    atomic_uint refs; /* References held, 0 while free */
+    atomic_uint next; /* Next free block index + 1, 0 ends the free list */
+} fsm_pool_block_t;
+
+#define FSM_POOL_HEADER_SIZE FSM_POOL_ROUND(sizeof(fsm_pool_block_t))
+
+/* Bytes of one block holding a payload of the given size */
+#define FSM_POOL_STRIDE(payloadSize) (FSM_POOL_HEADER_SIZE + FSM_POOL_ROUND(payloadSize))
+
+/* Bytes of storage for capacity payloads of the given size, to pass to fsm_pool_init() */
+#define FSM_POOL_STORAGE_SIZE(payloadSize, capacity) (FSM_POOL_STRIDE(payloadSize) * (size_t)(capacity))
+
+/* Fixed-block pool of reference-counted event payloads */
+typedef struct fsm_pool {
+    unsigned char *pStorage; /* capacity blocks of stride bytes */
+    size_t stride;           /* Bytes per block, header included */
+    size_t payloadSize;      /* Usable bytes per payload */
+    unsigned int capacity;   /* Number of blocks */
+    atomic_ullong freeHead;  /* ABA tag << 32 | first free block index + 1 */
+    atomic_uint available;   /* Free blocks */
+} fsm_pool_t;
+
+signed int fsm_pool_init(fsm_pool_t *pPool, void *pStorage, size_t payloadSize, unsigned int capacity);
+void *fsm_pool_alloc(fsm_pool_t *pPool);
+void *fsm_pool_retain(void *pPayload);
+bool fsm_pool_release(fsm_pool_t *pPool, void *pPayload);
+unsigned int fsm_pool_refs(const void *pPayload);
+unsigned int fsm_pool_available(const fsm_pool_t *pPool);
+
+/**
+ * @brief Check whether a pointer is a payload handed out by the pool.
+ *
+ * Lets a queue consumer tell pooled payloads from any other user context
+ * with two compares and a modulo.
+ */
+static inline bool fsm_pool_owns(const fsm_pool_t *pPool, const void *pPayload)
+{
+    const unsigned char *p = (const unsigned char *)pPayload;
+
+    if ((p < pPool->pStorage + FSM_POOL_HEADER_SIZE) || (p >= pPool->pStorage + pPool->stride * pPool->capacity)) {
+        return false;
+    }
+    return (((size_t)(p - pPool->pStorage) - FSM_POOL_HEADER_SIZE) % pPool->stride) == 0u;
+}
+
+#endif /* _FSM_POOL_H_ */
@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_PROFILE_H_
+#define _FSM_PROFILE_H_
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fsm_error.h"
+#include "fsm_trace.h"
+
+/* Set to 1 to time every state handler call, 0 compiles the hooks out */
+#ifndef FSM_PROFILE_ENABLE
+#define FSM_PROFILE_ENABLE (0)
+#endif
+
+/* Latency source, defaults to the trace timestamp counter */
+#ifndef FSM_PROFILE_TIMESTAMP
+#define FSM_PROFILE_TIMESTAMP() FSM_TRACE_TIMESTAMP()
+#endif
+
+/* Log-linear histogram: 2^FSM_PROFILE_SUB_BITS linear buckets per power of two */
+#ifndef FSM_PROFILE_SUB_BITS
+#define FSM_PROFILE_SUB_BITS (2u)
+#endif
+
+/* Buckets per histogram, the last one also counts everything above its range */
+#ifndef FSM_PROFILE_BUCKETS
+#define FSM_PROFILE_BUCKETS (96u)
+#endif
+
+/* Handler calls of one (state, signal) pair */
+typedef struct {
+    uint64_t count;                          /* Calls */
+    uint64_t totalTicks;                     /* Sum of latencies */
+    uint32_t maxTicks;                       /* Slowest call */
+    uint32_t histogram[FSM_PROFILE_BUCKETS]; /* Calls per latency bucket */
+} fsm_profile_cell_t;
+
+/* Per-manager profile over a stateCount x signalCount grid of cells */
+typedef struct fsm_profile {
+    fsm_profile_cell_t *pCells;  /* stateCount * signalCount cells, row per state */
+    unsigned short stateCount;   /* States covered */
+    unsigned int signalCount;    /* Signals covered, higher signals share the last column */
+    atomic_bool isResetPending;  /* Reset asked for by a snapshot, done by the dispatching thread */
+} fsm_profile_t;
+
+signed int fsm_profile_init(fsm_profile_t *pProfile, fsm_profile_cell_t *pCells, unsigned short stateCount, unsigned int signalCount);
+void fsm_profile_reset(fsm_profile_t *pProfile);
+signed int fsm_profile_snapshot(fsm_profile_t *pProfile, fsm_profile_cell_t *pCells, bool reset);
+const fsm_profile_cell_t *fsm_profile_cell(const fsm_profile_t *pProfile, unsigned short state, unsigned int signal);
+uint64_t fsm_profile_bucketFloor(unsigned int bucket);
+uint64_t fsm_profile_percentile(const fsm_profile_cell_t *pCell, double quantile);
+
+/**
+ * @brief Map a latency to its histogram bucket.
+ *
+ * Values below 2^FSM_PROFILE_SUB_BITS get a bucket each; above that, every
+ * power of two is split into 2^FSM_PROFILE_SUB_BITS equal buckets, so the
+ * relative error stays below 2^-FSM_PROFILE_SUB_BITS at any magnitude.
+ */
+static inline unsigned int fsm_profile_bucket(uint32_t ticks)
+{
+    const unsigned int sub = 1u << FSM_PROFILE_SUB_BITS;
+
+    if (ticks < sub) {
+        return ticks;
+    }
+
+    unsigned int exponent = 31u - (unsigned int)__builtin_clz(ticks);
+    unsigned int bucket = (exponent - FSM_PROFILE_SUB_BITS + 1u) * sub + ((ticks >> (exponent - FSM_PROFILE_SUB_BITS)) & (sub - 1u));
+    return (bucket < FSM_PROFILE_BUCKETS) ? bucket : (FSM_PROFILE_BUCKETS - 1u);
+}
+
+/**
+ * @brief Account one handler call, dispatching thread only.
+ *
+ * A reset asked for by fsm_profile_snapshot() is carried out here first, so
+ * the cells are only ever written by this thread.
+ */
+static inline void fsm_profile_record(fsm_profile_t *pProfile, unsigned short state, unsigned int signal, uint64_t start)
+{
+    uint64_t elapsed = FSM_PROFILE_TIMESTAMP() - start;
+    uint32_t ticks = (elapsed > UINT32_MAX) ? UINT32_MAX : (uint32_t)elapsed;
+
+    if (atomic_load_explicit(&pProfile->isResetPending, memory_order_acquire)) {
+        fsm_profile_reset(pProfile);
+    }
+
+    if (state < pProfile->stateCount) {
+        unsigned int column = (signal < pProfile->signalCount) ? signal : (pProfile->signalCount - 1u);
+        fsm_profile_cell_t *pCell = &pProfile->pCells[(size_t)state * pProfile->signalCount + column];
+
+        pCell->count++;
+        pCell->totalTicks += ticks;
+        pCell->maxTicks = (ticks > pCell->maxTicks) ? ticks : pCell->maxTicks;
+        pCell->histogram[fsm_profile_bucket(ticks)]++;
+    }
+}
+
+#endif /* _FSM_PROFILE_H_ */
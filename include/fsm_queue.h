@@ -0,0 +1,83 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_QUEUE_H_
+#define _FSM_QUEUE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+#include "fsm_error.h"
+
+/* Cache line size used to keep producer and consumer indexes apart */
+#ifndef FSM_CACHE_LINE_SIZE
+#define FSM_CACHE_LINE_SIZE (64u)
+#endif
+
+/* Single-producer/single-consumer ring of fixed-size elements */
+typedef struct fsm_spsc {
+    unsigned char *pBuffer;  /* Element storage, capacity * elemSize bytes */
+    unsigned int mask;       /* Capacity - 1, capacity is a power of two */
+    size_t elemSize;         /* Size of one element */
+
+    _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint tail; /* Next slot to write, advanced by the producer */
+    unsigned int headCache;                         /* Producer's last seen head */
+
+    _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint head; /* Next slot to read, advanced by the consumer */
+    unsigned int tailCache;                         /* Consumer's last seen tail */
+} fsm_spsc_t;
+
+/* Multi-producer/single-consumer bounded ring with per-slot sequence numbers */
+typedef struct fsm_mpsc {
+    unsigned char *pBuffer;   /* Element storage, capacity * elemSize bytes */
+    atomic_uint *pSequence;   /* Per-slot sequence numbers, capacity entries */
+    unsigned int mask;        /* Capacity - 1, capacity is a power of two */
+    size_t elemSize;          /* Size of one element */
+
+    _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint tail; /* Next slot to claim, shared by all producers */
+
+    _Alignas(FSM_CACHE_LINE_SIZE) atomic_bool isOwned; /* A consumer is currently draining */
+    unsigned int head;                                 /* Next slot to read, owned by the consumer */
+} fsm_mpsc_t;
+
+signed int fsm_spsc_init(fsm_spsc_t *pQueue, void *pBuffer, unsigned int capacity, size_t elemSize);
+bool fsm_spsc_push(fsm_spsc_t *pQueue, const void *pElem);
+bool fsm_spsc_pop(fsm_spsc_t *pQueue, void *pElem);
+unsigned int fsm_spsc_readable(fsm_spsc_t *pQueue);
+void fsm_spsc_consume(fsm_spsc_t *pQueue, unsigned int count);
+unsigned int fsm_spsc_count(fsm_spsc_t *pQueue);
+
+signed int fsm_mpsc_init(fsm_mpsc_t *pQueue, void *pBuffer, atomic_uint *pSequence, unsigned int capacity, size_t elemSize);
+bool fsm_mpsc_push(fsm_mpsc_t *pQueue, const void *pElem);
+bool fsm_mpsc_acquire(fsm_mpsc_t *pQueue);
+void fsm_mpsc_release(fsm_mpsc_t *pQueue);
+unsigned int fsm_mpsc_readable(fsm_mpsc_t *pQueue, unsigned int maxCount);
+void fsm_mpsc_consume(fsm_mpsc_t *pQueue, unsigned int count);
+unsigned int fsm_mpsc_count(fsm_mpsc_t *pQueue);
+
+/**
+ * @brief Get the element at offset from the head, consumer side only.
+ *
+ * Valid for offsets below the value returned by fsm_spsc_readable().
+ */
+static inline const void *fsm_spsc_at(const fsm_spsc_t *pQueue, unsigned int offset)
+{
+    unsigned int head = atomic_load_explicit(&pQueue->head, memory_order_relaxed);
+    return &pQueue->pBuffer[(size_t)((head + offset) & pQueue->mask) * pQueue->elemSize];
+}
+
+/**
+ * @brief Get the element at offset from the head, owning consumer only.
+ *
+ * Valid for offsets below the value returned by fsm_mpsc_readable().
+ */
+static inline const void *fsm_mpsc_at(const fsm_mpsc_t *pQueue, unsigned int offset)
+{
+    return &pQueue->pBuffer[(size_t)((pQueue->head + offset) & pQueue->mask) * pQueue->elemSize];
+}
+
+#endif /* _FSM_QUEUE_H_ */
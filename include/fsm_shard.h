@@ -0,0 +1,92 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_SHARD_H_
+#define _FSM_SHARD_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "fsm_queue.h"
+#include "fsm_executor.h"
+
+/* Largest event carried by a mailbox message, at least sizeof(hsm_state_input_t) */
+#ifndef FSM_SHARD_EVENT_SIZE
+#define FSM_SHARD_EVENT_SIZE (48u)
+#endif
+
+/* Messages a shard drains from one mailbox before moving to the next */
+#ifndef FSM_SHARD_BATCH
+#define FSM_SHARD_BATCH (64u)
+#endif
+
+/* No shard: the calling thread isn't a shard thread, or a shard isn't pinned */
+#define FSM_SHARD_NONE (0xFFFFFFFFu)
+
+struct fsm_shard_runtime;
+
+/* Machine owned by one shard, dispatched only on that shard's thread */
+typedef struct {
+    void *pMachine;           /* hsm_state_manager_t or psm_state_manager_t */
+    fsm_dispatch_t pDispatch; /* hsm_dispatchEvent() or psm_activities_event() */
+    size_t eventSize;         /* Size of the events the adapter expects */
+    unsigned int shard;       /* Owning shard */
+} fsm_shard_machine_t;
+
+/* Mailbox message: target machine and an inline copy of the event */
+typedef struct {
+    fsm_shard_machine_t *pTarget;
+    _Alignas(max_align_t) unsigned char event[FSM_SHARD_EVENT_SIZE];
+} fsm_shard_msg_t;
+
+/* Per-core shard: one thread, the machines bound to it and its inbound mailboxes */
+typedef struct {
+    struct fsm_shard_runtime *pRuntime;
+    unsigned int index;   /* Position in the runtime */
+    unsigned int cpu;     /* CPU the thread is pinned to, FSM_SHARD_NONE to leave it floating */
+    unsigned long events; /* Messages dispatched, owned by the shard thread */
+    signed int lastError; /* Last failed dispatch result, 0 if none */
+    pthread_t thread;
+} fsm_shard_t;
+
+/*
+ * Shared-nothing runtime. Mailbox (src, dst) is an SPSC ring written only by
+ * source src and read only by shard dst, so posting never touches an atomic
+ * another producer writes. Sources 0..shardCount-1 are the shards themselves,
+ * (src == dst being the shard's local queue); any further sources are
+ * external producer threads, one source index each.
+ */
+typedef struct fsm_shard_runtime {
+    fsm_shard_t *pShards;
+    unsigned int shardCount;
+    unsigned int sourceCount; /* shardCount + external producers */
+    fsm_spsc_t *pMailboxes;   /* sourceCount * shardCount rings, row per source */
+    atomic_bool isRunning;
+} fsm_shard_runtime_t;
+
+signed int fsm_shard_init(fsm_shard_runtime_t *pRuntime,
+                          fsm_shard_t *pShards,
+                          unsigned int shardCount,
+                          unsigned int sourceCount,
+                          fsm_spsc_t *pMailboxes,
+                          fsm_shard_msg_t *pBuffer,
+                          unsigned int mailboxCapacity);
+signed int fsm_shard_pin(fsm_shard_runtime_t *pRuntime, unsigned int shard, unsigned int cpu);
+signed int fsm_shard_bind(fsm_shard_machine_t *pTarget,
+                          fsm_shard_runtime_t *pRuntime,
+                          unsigned int shard,
+                          void *pMachine,
+                          fsm_dispatch_t pDispatch,
+                          size_t eventSize);
+signed int fsm_shard_post(fsm_shard_runtime_t *pRuntime, unsigned int source, fsm_shard_machine_t *pTarget, const void *pEvent);
+signed int fsm_shard_poll(fsm_shard_runtime_t *pRuntime, unsigned int shard);
+signed int fsm_shard_start(fsm_shard_runtime_t *pRuntime);
+signed int fsm_shard_stop(fsm_shard_runtime_t *pRuntime);
+unsigned int fsm_shard_self(void);
+
+#endif /* _FSM_SHARD_H_ */
@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_TIMER_H_
+#define _FSM_TIMER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fsm_error.h"
+
+/* Slots per wheel level, as a power of two */
+#ifndef FSM_TIMER_WHEEL_BITS
+#define FSM_TIMER_WHEEL_BITS (6u)
+#endif
+
+/* Wheel levels, the wheel spans 2^(FSM_TIMER_WHEEL_BITS * FSM_TIMER_WHEEL_LEVELS) ticks */
+#ifndef FSM_TIMER_WHEEL_LEVELS
+#define FSM_TIMER_WHEEL_LEVELS (4u)
+#endif
+
+#define FSM_TIMER_WHEEL_SLOTS (1u << FSM_TIMER_WHEEL_BITS)
+
+/* Owner of a timer that no state holds, its expiry is not delivered */
+#define FSM_TIMER_OWNER_NONE (0xFFFFu)
+
+/* Intrusive timer, owned by the caller */
+typedef struct fsm_timer {
+    struct fsm_timer *pNext;   /* Next timer in the slot, or in the expired list */
+    struct fsm_timer **ppPrev; /* Link pointing at this timer, NULL while not in the wheel */
+    uint64_t expiry;           /* Tick the timer fires at */
+    void *pMachine;            /* Manager the timeout is delivered to */
+    void *pContext;            /* Delivered as the input's pUserContext */
+    unsigned int signal;       /* Delivered as the input's signal */
+    unsigned short owner;      /* State that armed it, FSM_TIMER_OWNER_NONE when free */
+    unsigned char level;       /* Wheel level holding it */
+    unsigned char expired;     /* In an expired list not yet walked, pNext still links it */
+} fsm_timer_t;
+
+/* Hierarchical timing wheel, driven by one thread */
+typedef struct fsm_timer_wheel {
+    fsm_timer_t *pSlots[FSM_TIMER_WHEEL_LEVELS][FSM_TIMER_WHEEL_SLOTS]; /* Timer lists per level and slot */
+    unsigned int levelPending[FSM_TIMER_WHEEL_LEVELS];                  /* Timers per level, to skip empty levels */
+    uint64_t now;                                                      /* Last tick processed */
+    unsigned int pending;                                              /* Timers in the wheel */
+} fsm_timer_wheel_t;
+
+signed int fsm_timer_wheel_init(fsm_timer_wheel_t *pWheel, uint64_t now);
+void fsm_timer_init(fsm_timer_t *pTimer, void *pMachine);
+signed int fsm_timer_arm(fsm_timer_wheel_t *pWheel, fsm_timer_t *pTimer, uint64_t ticks);
+bool fsm_timer_cancel(fsm_timer_wheel_t *pWheel, fsm_timer_t *pTimer);
+fsm_timer_t *fsm_timer_advance(fsm_timer_wheel_t *pWheel, uint64_t now);
+unsigned int fsm_timer_pending(const fsm_timer_wheel_t *pWheel);
+
+/**
+ * @brief Check whether a timer is waiting in a wheel.
+ */
+static inline bool fsm_timer_isArmed(const fsm_timer_t *pTimer)
+{
+    return (pTimer->ppPrev != NULL);
+}
+
+/**
+ * @brief Check whether a timer sits in an expired list that is still being delivered.
+ *
+ * Such a timer must not be re-armed by a timeout owner, that would cut the rest of the batch off.
+ */
+static inline bool fsm_timer_isExpired(const fsm_timer_t *pTimer)
+{
+    return (pTimer->expired != 0u);
+}
+
+#endif /* _FSM_TIMER_H_ */
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _FSM_TRACE_H_
+#define _FSM_TRACE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+
+#include "fsm_error.h"
+
+/* Set to 1 to record every hsm_dispatch()/psm_activities() call, 0 compiles the hooks out */
+#ifndef FSM_TRACE_ENABLE
+#define FSM_TRACE_ENABLE (0)
+#endif
+
+/* Timestamp source, override with a port specific counter */
+#ifndef FSM_TRACE_TIMESTAMP
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define FSM_TRACE_TIMESTAMP() ((uint64_t)__rdtsc())
+#elif defined(__aarch64__)
+static inline uint64_t fsm_trace_cntvct(void)
+{
+    uint64_t ticks;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+}
+#define FSM_TRACE_TIMESTAMP() fsm_trace_cntvct()
+#else
+#define FSM_TRACE_TIMESTAMP() ((uint64_t)0u)
+#endif
+#endif
+
+/* Machine kind of a record */
+enum fsm_trace_kind {
+    FSM_TRACE_KIND_PSM = 0u,
+    FSM_TRACE_KIND_HSM,
+};
+
+/* One dispatch: the state before and after, the signal and the result */
+typedef struct {
+    uint64_t timestamp;     /* Counter value when the dispatch started */
+    const void *pMachine;   /* Manager that ran the dispatch */
+    uint32_t duration;      /* Counter ticks the dispatch took */
+    uint32_t signal;        /* Input signal */
+    uint16_t from;          /* Current state before the dispatch */
+    uint16_t to;            /* Current state after the dispatch */
+    int16_t result;         /* Dispatch return value */
+    uint8_t kind;           /* enum fsm_trace_kind */
+} fsm_trace_record_t;
+
+/* Single-writer overwriting ring, owned by the thread it is attached to */
+typedef struct {
+    fsm_trace_record_t *pRecords; /* Record storage, capacity entries */
+    unsigned int mask;            /* Capacity - 1, capacity is a power of two */
+    atomic_uint head;             /* Records written so far, wraps modulo 2^32 */
+    atomic_bool isFull;           /* Every slot has been written once */
+} fsm_trace_ring_t;
+
+signed int fsm_trace_init(fsm_trace_ring_t *pRing, fsm_trace_record_t *pRecords, unsigned int capacity);
+void fsm_trace_attach(fsm_trace_ring_t *pRing);
+fsm_trace_ring_t *fsm_trace_current(void);
+unsigned int fsm_trace_count(const fsm_trace_ring_t *pRing);
+signed int fsm_trace_save(const fsm_trace_ring_t *pRing, FILE *pFile);
+signed int fsm_trace_load(fsm_trace_ring_t *pRing, fsm_trace_record_t *pRecords, unsigned int capacity, FILE *pFile);
+signed int fsm_trace_dump_text(const fsm_trace_ring_t *pRing, FILE *pFile);
+signed int fsm_trace_dump_chrome(const fsm_trace_ring_t *pRing, FILE *pFile, double ticksPerUs);
+
+/* Ring attached to the calling thread, NULL when tracing is off for it */
+extern _Thread_local fsm_trace_ring_t *g_pFsmTraceRing;
+
+/**
+ * @brief Read the start timestamp of a dispatch, only when the thread is traced.
+ */
+static inline uint64_t fsm_trace_begin(void)
+{
+    return (g_pFsmTraceRing != NULL) ? FSM_TRACE_TIMESTAMP() : 0u;
+}
+
+/**
+ * @brief Append a record to the calling thread's ring, if one is attached.
+ *
+ * The writer owns the ring, so a record costs a few stores and one release.
+ * The record filling the last slot also marks the ring full, which keeps the
+ * oldest record findable after head wraps.
+ */
+static inline void fsm_trace_write(const void *pMachine,
+                                   uint8_t kind,
+                                   uint64_t start,
+                                   uint16_t from,
+                                   uint16_t to,
+                                   uint32_t signal,
+                                   signed int result)
+{
+    fsm_trace_ring_t *pRing = g_pFsmTraceRing;
+
+    if (pRing != NULL) {
+        unsigned int head = atomic_load_explicit(&pRing->head, memory_order_relaxed);
+        fsm_trace_record_t *pRecord = &pRing->pRecords[head & pRing->mask];
+
+        pRecord->timestamp = start;
+        pRecord->pMachine = pMachine;
+        pRecord->duration = (uint32_t)(FSM_TRACE_TIMESTAMP() - start);
+        pRecord->signal = signal;
+        pRecord->from = from;
+        pRecord->to = to;
+        pRecord->result = (int16_t)result;
+        pRecord->kind = kind;
+        if ((head & pRing->mask) == pRing->mask) {
+            atomic_store_explicit(&pRing->isFull, true, memory_order_relaxed);
+        }
+        atomic_store_explicit(&pRing->head, head + 1u, memory_order_release);
+    }
+}
+
+#endif /* _FSM_TRACE_H_ */
@@ -9,12 +9,14 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 
-/* Error codes */
-#define HSM_OK               (0)
-#define EOR_INVALID_ARGUMENT (-1)
-#define EOR_INVALID_DATA     (-2)
-#define EOR_FAULT_ERROR      (-3)
+#include "fsm_error.h"
+#include "fsm_index.h"
+
+/* Error codes, see fsm_error.h */
+#define HSM_OK FSM_OK
 
 #define HSM_ACTION_DONE (0)
 
@@ -40,15 +42,87 @@ typedef unsigned short hsm_instance_t;
 #define HSM_STATE_INSTANCE_ROOT    (0xFFFEu)
 #define HSM_STATE_INSTANCE_INVALID (0xFFFFu)
 
+/* Maximum hierarchy depth (levels) supported by compiled state paths */
+#ifndef HSM_DEPTH_MAX
+#define HSM_DEPTH_MAX (16u)
+#endif
+
+/* Per-state handled signal bitmap: bit n set when the handler reacts to signal n */
+typedef unsigned int hsm_signal_mask_t;
+#define HSM_SIGNAL_MASK(signal) ((hsm_signal_mask_t)1u << (signal))
+#define HSM_SIGNAL_MASK_ALL     ((hsm_signal_mask_t)~0u)
+#define HSM_SIGNAL_MASK_BITS    (sizeof(hsm_signal_mask_t) * 8u) /* Signals above always reach the handler */
+
+/* Bytes of small event data carried by value in every input, 0 for none */
+#ifndef HSM_INPUT_PAYLOAD_SIZE
+#define HSM_INPUT_PAYLOAD_SIZE (0u)
+#endif
+
+/* Payload alignment, spelled for both C and C++ includers */
+#ifdef __cplusplus
+#define HSM_ALIGNAS(n) alignas(n)
+#else
+#define HSM_ALIGNAS(n) _Alignas(n)
+#endif
+
 /* Input event structure */
 typedef struct {
     hsm_signal_t signal;
     void *pUserContext;
+#if HSM_INPUT_PAYLOAD_SIZE > 0
+    HSM_ALIGNAS(8) unsigned char payload[HSM_INPUT_PAYLOAD_SIZE]; /* Inline event data, copied with the input */
+#endif
 } hsm_state_input_t;
 
+#if HSM_INPUT_PAYLOAD_SIZE > 0
+/**
+ * @brief Copy event data into the input's inline payload.
+ *
+ * @return HSM_OK on success, EOR_INVALID_ARGUMENT if the data doesn't fit.
+ */
+static inline signed int hsm_input_setPayload(hsm_state_input_t *pInput, const void *pData, size_t size)
+{
+    if (size > sizeof(pInput->payload)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    memcpy(pInput->payload, pData, size);
+    return HSM_OK;
+}
+
+/**
+ * @brief Copy event data out of the input's inline payload.
+ *
+ * @return HSM_OK on success, EOR_INVALID_ARGUMENT if more than the payload is requested.
+ */
+static inline signed int hsm_input_getPayload(const hsm_state_input_t *pInput, void *pData, size_t size)
+{
+    if (size > sizeof(pInput->payload)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    memcpy(pData, pInput->payload, size);
+    return HSM_OK;
+}
+#endif
+
+struct hsm_state_manager;
+
+/* Optional attachments, each defined by its own fsm_*.h header */
+struct fsm_spsc;
+struct fsm_mpsc;
+struct fsm_profile;
+struct fsm_metrics_slot;
+struct fsm_timer_wheel;
+struct fsm_timer;
+struct fsm_pool;
+
 /* State handler function type */
 typedef signed int (*hsm_state_handler_t)(hsm_state_input_t);
 
+/* State handler receiving its manager, lets one const state table drive many managers */
+typedef signed int (*hsm_state_handler_ex_t)(struct hsm_state_manager *pManager, hsm_state_input_t input);
+
 /* State definition */
 typedef struct hsm_state {
     struct hsm_state *pParent;      /* Parent state in hierarchy (NULL for top-level) */
@@ -56,24 +130,128 @@ typedef struct hsm_state {
     unsigned int id;                /* User-defined state ID */
     const char *pName;              /* State name for debugging */
     hsm_state_handler_t pHandler;   /* State handler function */
+    hsm_state_handler_ex_t pHandlerEx; /* Manager-aware handler, called instead of pHandler when set */
 } hsm_state_t;
 
+/* Dispatch loop specialized for a mode and transducer presence, from the current row (NULL at root) */
+typedef signed int (*hsm_dispatch_run_t)(struct hsm_state_manager *pManager, hsm_state_t *pActiveState, hsm_state_input_t input);
+
+/* Hot per-state row of a compact table, only what dispatch calls */
+typedef struct {
+    hsm_state_handler_t pHandler;      /* State handler function */
+    hsm_state_handler_ex_t pHandlerEx; /* Manager-aware handler, called instead of pHandler when set */
+} hsm_state_handlers_t;
+
+/* Compact index-based state table, built once per state table by hsm_compileTable() */
+typedef struct {
+    const hsm_instance_t *pParents;          /* Parent per state (HSM_STATE_INSTANCE_INVALID: top-level) */
+    const hsm_state_handlers_t *pHandlers;   /* Handlers per state, indexed by instance */
+    unsigned short stateCount;               /* Number of states */
+} hsm_compact_table_t;
+
+/* Compiled root-to-state path, built once per state table by hsm_compile() */
+typedef struct {
+    unsigned short depth;                /* Number of ancestors (0 for top-level states) */
+    hsm_instance_t path[HSM_DEPTH_MAX];  /* Root-to-state instances, path[depth] is the state itself */
+} hsm_state_path_t;
+
+/* Cached exit/entry sequence of one (from, to) transition, filled on first use */
+typedef struct {
+    hsm_instance_t from;                      /* Source state (HSM_STATE_INSTANCE_INVALID: empty slot) */
+    hsm_instance_t to;                        /* Target state */
+    hsm_instance_t lca;                       /* Least common ancestor (HSM_STATE_INSTANCE_ROOT: none) */
+    unsigned short exitCount;                 /* Number of states in exitList */
+    unsigned short entryCount;                /* Number of states in entryList */
+    hsm_instance_t exitList[HSM_DEPTH_MAX];   /* States to exit, leaf first */
+    hsm_instance_t entryList[HSM_DEPTH_MAX];  /* States to enter, outermost first */
+} hsm_transition_path_t;
+
+/* Transition table guard and action callbacks */
+typedef bool (*hsm_guard_t)(hsm_state_input_t input);
+typedef void (*hsm_action_t)(hsm_state_input_t input);
+
+/* Transition table rule, rows sharing (state, signal) must be adjacent and are tried in order */
+typedef struct {
+    hsm_instance_t state;   /* Source state */
+    hsm_signal_t signal;    /* Triggering user signal */
+    hsm_guard_t pGuard;     /* Optional guard (NULL: always taken) */
+    hsm_action_t pAction;   /* Optional action (NULL: none) */
+    hsm_instance_t target;  /* Target state (HSM_STATE_INSTANCE_INVALID: internal, no transition) */
+} hsm_rule_t;
+
+/* Compiled transition table, built by hsm_compileRules() */
+typedef struct {
+    const hsm_rule_t *pRules;  /* Rule rows (NULL: no table) */
+    unsigned short ruleCount;  /* Number of rows */
+    fsm_index_t index;         /* Compiled (state, signal) -> first row lookup */
+} hsm_rule_table_t;
+
 /* Transducer callback for state transitions */
 typedef signed int (*hsm_transducer_t)(const hsm_state_t *pStates,
                                        hsm_instance_t fromState,
                                        hsm_instance_t toState,
                                        hsm_state_input_t input);
 
-/* State manager context */
+/* Per-instance runtime of a machine, the only state kept per session */
 typedef struct {
+    hsm_instance_t currentState;     /* Currently active state instance */
+    hsm_instance_t processingState;  /* State being processed (during transitions) */
+} hsm_runtime_t;
+
+/* Shared definition of a machine, read-only once built by hsm_defineMachine() and the compile calls */
+typedef struct hsm_machine {
+    const hsm_state_t *pStates;            /* Array of state definitions */
+    unsigned short stateCount;             /* Number of states in array */
+    hsm_instance_t initialState;           /* State entered by the first dispatch */
+    bool passThroughMode;                  /* true: pass through mode, false: current node mode */
+    hsm_transducer_t pTransducer;          /* Optional transition callback */
+    hsm_dispatch_run_t pRun;               /* Dispatch loop of hsm_dispatchMachine(), set by hsm_defineMachine() */
+    const hsm_compact_table_t *pCompact;   /* Optional compact table (NULL: dispatch from pStates rows) */
+    const hsm_state_path_t *pPaths;        /* Optional compiled paths (NULL: walk pParent pointers) */
+    const hsm_signal_mask_t *pSignalMasks; /* Optional per-state handled signals (NULL: call every handler) */
+    hsm_rule_table_t ruleTable;            /* Optional transition table (pRules NULL: handlers only) */
+} hsm_machine_t;
+
+/* Per-instance attachments of a manager, cleared and attached by hsm_setExtension() */
+typedef struct hsm_extension {
+    hsm_transition_path_t *pCache;   /* Optional transition path cache (NULL: disabled) */
+    unsigned short cacheSize;        /* Number of slots in pCache */
+    unsigned short timerCount;       /* Number of timers in pTimers */
+    struct fsm_spsc *pQueue;         /* Optional event queue (NULL: synchronous dispatch only) */
+    struct fsm_mpsc *pInbox;         /* Optional multi-producer event queue (NULL: none) */
+    struct fsm_profile *pProfile;    /* Optional handler latency profile (NULL: none) */
+    struct fsm_metrics_slot *pMetrics; /* Optional shared-memory metrics slot (NULL: none) */
+    struct fsm_timer_wheel *pWheel;  /* Optional timing wheel for state timeouts (NULL: none) */
+    struct fsm_timer *pTimers;       /* Timeout timers, at most one per armed state */
+    struct fsm_pool *pPool;          /* Optional payload pool, queued payloads are released after dispatch */
+    struct fsm_spsc *pDeferred;      /* Optional deferred event ring (NULL: hsm_defer() disabled) */
+    unsigned int *pHits;             /* Optional per-rule hit counters of the machine's rule table (NULL: not profiled) */
+    unsigned int recallCount;        /* Deferred events to recall once the dispatch completes */
+    bool isRecalling;                /* Recall in progress, nested dispatches leave it to the outer loop */
+} hsm_extension_t;
+
+/* State manager context */
+typedef struct hsm_state_manager {
     const hsm_state_t *pStates;     /* Array of state definitions */
     unsigned short stateCount;       /* Number of states in array */
     hsm_instance_t currentState;     /* Currently active state instance */
     hsm_instance_t processingState;  /* State being processed (during transitions) */
     bool passThroughMode;            /* true: pass through mode, false: current node mode */
     hsm_transducer_t pTransducer;    /* Optional transition callback */
+    const hsm_machine_t *pMachine;   /* Definition holding the compiled tables (NULL: none), see hsm_initMachine() */
+    hsm_runtime_t *pRuntime;         /* Set only on the manager hsm_dispatchMachine() hands to handlers */
+    hsm_extension_t *pExtension;     /* Optional per-instance attachments (NULL: none) */
 } hsm_state_manager_t;
 
+/* Event addressed to a manager, for batched dispatch across managers */
+typedef struct {
+    hsm_state_manager_t *pManager;
+    hsm_state_input_t input;
+} hsm_dispatch_pair_t;
+
+/* Per-instance arena storage for an extension and an event ring of capacity inputs, see hsm_arenaConstruct() and fsm_arena.h */
+#define HSM_ARENA_EXTRA_SIZE(capacity) FSM_ARENA_EXTENSION_SIZE(sizeof(hsm_extension_t), sizeof(hsm_state_input_t), (capacity))
+
 /* Public API */
 signed int hsm_init(hsm_state_manager_t *pManager,
                     const hsm_state_t *pStateList,
@@ -81,6 +259,28 @@ signed int hsm_init(hsm_state_manager_t *pManager,
                     hsm_instance_t initialState,
                     bool passThrough,
                     hsm_transducer_t pTransducer);
+signed int hsm_defineMachine(hsm_machine_t *pMachine,
+                             const hsm_state_t *pStateList,
+                             unsigned short stateCount,
+                             hsm_instance_t initialState,
+                             bool passThrough,
+                             hsm_transducer_t pTransducer);
+signed int hsm_compile(hsm_machine_t *pMachine, hsm_state_path_t *pPaths);
+signed int hsm_compileTable(hsm_machine_t *pMachine,
+                            hsm_compact_table_t *pTable,
+                            hsm_instance_t *pParents,
+                            hsm_state_handlers_t *pHandlers);
+signed int hsm_setCompactTable(hsm_machine_t *pMachine, const hsm_compact_table_t *pTable);
+signed int hsm_setSignalMasks(hsm_machine_t *pMachine, const hsm_signal_mask_t *pSignalMasks);
+signed int hsm_compileRules(hsm_machine_t *pMachine,
+                            const hsm_rule_t *pRules,
+                            unsigned short ruleCount,
+                            unsigned short *pSlots,
+                            unsigned int slotCount);
+signed int hsm_initMachine(hsm_state_manager_t *pManager, const hsm_machine_t *pMachine);
+signed int hsm_setExtension(hsm_state_manager_t *pManager, hsm_extension_t *pExtension);
+signed int hsm_setTransitionCache(hsm_state_manager_t *pManager, hsm_transition_path_t *pCache, unsigned short cacheSize);
+signed int hsm_setRuleHits(hsm_state_manager_t *pManager, unsigned int *pHits);
 signed int hsm_state_isValid(hsm_state_manager_t *pManager, hsm_instance_t instance);
 const char *hsm_state_getName(hsm_state_manager_t *pManager, hsm_instance_t instance);
 signed int hsm_state_getId(hsm_state_manager_t *pManager, hsm_instance_t instance);
@@ -89,7 +289,31 @@ const char *hsm_getCurrentStateName(hsm_state_manager_t *pManager);
 hsm_instance_t hsm_getTargetState(hsm_state_manager_t *pManager);
 const char *hsm_getTargetStateName(hsm_state_manager_t *pManager);
 signed int hsm_dispatch(hsm_state_manager_t *pManager, hsm_state_input_t input);
+signed int hsm_dispatchMany(hsm_state_manager_t *pManager, const hsm_state_input_t *pInputs, unsigned int count);
+signed int hsm_dispatchBatch(const hsm_dispatch_pair_t *pPairs, unsigned int count);
 signed int hsm_transition(hsm_state_manager_t *pManager, hsm_instance_t nextState);
+signed int hsm_setQueue(hsm_state_manager_t *pManager, struct fsm_spsc *pQueue);
+signed int hsm_post(hsm_state_manager_t *pManager, hsm_state_input_t input);
+signed int hsm_drain(hsm_state_manager_t *pManager, unsigned int maxEvents);
+signed int hsm_setInbox(hsm_state_manager_t *pManager, struct fsm_mpsc *pInbox);
+signed int hsm_postInbox(hsm_state_manager_t *pManager, hsm_state_input_t input);
+signed int hsm_drainInbox(hsm_state_manager_t *pManager, unsigned int maxEvents);
+signed int hsm_dispatchEvent(void *pManager, const void *pInput);
+signed int hsm_setProfile(hsm_state_manager_t *pManager, struct fsm_profile *pProfile);
+signed int hsm_setMetrics(hsm_state_manager_t *pManager, struct fsm_metrics_slot *pSlot);
+signed int hsm_setTimers(hsm_state_manager_t *pManager,
+                         struct fsm_timer_wheel *pWheel,
+                         struct fsm_timer *pTimers,
+                         unsigned short timerCount);
+signed int hsm_armTimeout(hsm_state_manager_t *pManager, uint64_t ticks, hsm_state_input_t input);
+signed int hsm_cancelTimeout(hsm_state_manager_t *pManager);
+signed int hsm_dispatchTimeouts(struct fsm_timer *pExpired);
+signed int hsm_setPool(hsm_state_manager_t *pManager, struct fsm_pool *pPool);
+signed int hsm_setDeferQueue(hsm_state_manager_t *pManager, struct fsm_spsc *pDeferred);
+signed int hsm_defer(hsm_state_manager_t *pManager, hsm_state_input_t input);
+signed int hsm_initRuntime(const hsm_machine_t *pMachine, hsm_runtime_t *pRuntime);
+signed int hsm_dispatchMachine(const hsm_machine_t *pMachine, hsm_runtime_t *pRuntime, hsm_state_input_t input);
+void hsm_arenaConstruct(void *pObject, void *pExtra, size_t extraSize, const void *pPrototype);
 
 /* Backward compatibility macros */
 #define pMasterState          pParent
@@ -0,0 +1,600 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _HSM_HPP_
+#define _HSM_HPP_
+
+#include <array>
+#include <cstddef>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+extern "C" {
+#include "hsm.h"
+}
+
+/*
+ * Header-only C++17 front end over hsm.h, with the semantics of hsm_dispatch().
+ *
+ * States are types deriving from hsm::state<Parent>, the hierarchy is known at
+ * compile time: parents, root-to-state paths and the LCA of every pair of
+ * states are constexpr tables, and the handler of the state being processed
+ * is called directly, so it can be inlined into the dispatch loop. A state
+ * handler has the form
+ *
+ *     template <class Machine>
+ *     static signed int handle(Machine &machine, const typename Machine::input_type &input);
+ *
+ * and requests a transition with machine.template transition<Target>(). The
+ * ENTRY, INIT and EXIT sequence, the transducer call and the pass-through and
+ * current node modes follow hsm.c step for step.
+ *
+ * The same state types also run on the C kernel through hsm::manager, which
+ * builds the hsm_state_t table and drives an hsm_state_manager_t. Use it when
+ * a machine needs queues, timers or the other attachments of hsm.h, which
+ * hsm::machine leaves out.
+ *
+ * hsm.h is included with its backward compatibility macros, so names such as
+ * current, number and middleware stay reserved in including files.
+ */
+namespace hsm
+{
+
+/* Error codes, see fsm_error.h */
+constexpr signed int OK = HSM_OK;
+constexpr signed int INVALID_ARGUMENT = EOR_INVALID_ARGUMENT;
+constexpr signed int FAULT_ERROR = EOR_FAULT_ERROR;
+
+/* State signals, see enum hsm_signal */
+using signal_t = hsm_signal_t;
+constexpr signal_t SIGNAL_UNKNOWN = HSM_SIGNAL_UNKNOWN;
+constexpr signal_t SIGNAL_ENTRY = HSM_SIGNAL_ENTRY;
+constexpr signal_t SIGNAL_INIT = HSM_SIGNAL_INIT;
+constexpr signal_t SIGNAL_EXIT = HSM_SIGNAL_EXIT;
+constexpr signal_t SIGNAL_USER_DEFINE = HSM_SIGNAL_USER_DEFINE;
+
+/* State instance identifiers, the index of a state in the machine's state list */
+using instance_t = hsm_instance_t;
+constexpr instance_t STATE_INSTANCE_ROOT = HSM_STATE_INSTANCE_ROOT;
+constexpr instance_t STATE_INSTANCE_INVALID = HSM_STATE_INSTANCE_INVALID;
+
+/* Signal dispatch modes */
+enum class mode {
+    pass_through, /* Signals propagate from root to leaf through hierarchy */
+    current_node, /* Signals only dispatch to current active state */
+};
+
+/* Parent of top-level states */
+struct top {
+};
+
+/* Base of every state type */
+template <class Parent = top>
+struct state {
+    using parent_type = Parent;
+};
+
+/* Typed input event, the data travels typed instead of through a void pointer; hsm::manager takes hsm_state_input_t */
+template <class Data = void *>
+struct input {
+    signal_t signal;
+    Data data;
+};
+
+namespace detail
+{
+
+template <class T, class... List>
+struct index_of;
+
+template <class T>
+struct index_of<T> : std::integral_constant<std::size_t, 0u> {
+};
+
+template <class T, class First, class... Rest>
+struct index_of<T, First, Rest...>
+    : std::integral_constant<std::size_t, std::is_same<T, First>::value ? 0u : 1u + index_of<T, Rest...>::value> {
+};
+
+template <class T, class... List>
+constexpr instance_t instanceOf()
+{
+    if constexpr (std::is_same<T, top>::value) {
+        return STATE_INSTANCE_INVALID;
+    } else {
+        return static_cast<instance_t>(index_of<T, List...>::value);
+    }
+}
+
+template <class Context, class Input, class = void>
+struct has_transducer : std::false_type {
+};
+
+template <class Context, class Input>
+struct has_transducer<Context,
+                      Input,
+                      std::void_t<decltype(std::declval<Context &>().onTransition(instance_t{}, instance_t{}, std::declval<const Input &>()))>>
+    : std::true_type {
+};
+
+/* Compile-time hierarchy of a state list */
+template <class... States>
+struct hierarchy {
+    static constexpr std::size_t count = sizeof...(States);
+
+    static constexpr std::array<instance_t, count> parents = {instanceOf<typename States::parent_type, States...>()...};
+
+    /* Number of ancestors, count or more when the parents form a cycle */
+    static constexpr std::size_t depthOf(std::size_t instance)
+    {
+        std::size_t depth = 0u;
+
+        while ((parents[instance] != STATE_INSTANCE_INVALID) && (depth <= count)) {
+            instance = parents[instance];
+            depth++;
+        }
+        return depth;
+    }
+
+    static constexpr std::array<std::size_t, count> buildDepths()
+    {
+        std::array<std::size_t, count> depths{};
+
+        for (std::size_t i = 0u; i < count; i++) {
+            depths[i] = depthOf(i);
+        }
+        return depths;
+    }
+
+    static constexpr std::array<std::size_t, count> depths = buildDepths();
+
+    static constexpr bool isAcyclic()
+    {
+        for (std::size_t i = 0u; i < count; i++) {
+            if (depths[i] >= count) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /* Root-to-state paths, paths[s][depths[s]] is s itself */
+    static constexpr std::array<std::array<instance_t, count>, count> buildPaths()
+    {
+        std::array<std::array<instance_t, count>, count> paths{};
+
+        for (std::size_t i = 0u; i < count; i++) {
+            std::size_t instance = i;
+
+            for (std::size_t level = depths[i] + 1u; level > 0u; level--) {
+                paths[i][level - 1u] = static_cast<instance_t>(instance);
+                instance = parents[instance];
+            }
+        }
+        return paths;
+    }
+
+    static constexpr std::array<std::array<instance_t, count>, count> paths = buildPaths();
+
+    /* Deepest common ancestor, a state being its own ancestor; STATE_INSTANCE_INVALID when there is none */
+    static constexpr std::array<std::array<instance_t, count>, count> buildLCAs()
+    {
+        std::array<std::array<instance_t, count>, count> lcas{};
+
+        for (std::size_t from = 0u; from < count; from++) {
+            for (std::size_t to = 0u; to < count; to++) {
+                std::size_t depth = (depths[from] < depths[to]) ? depths[from] : depths[to];
+                std::size_t level = 0u;
+
+                while ((level <= depth) && (paths[from][level] == paths[to][level])) {
+                    level++;
+                }
+                lcas[from][to] = (level == 0u) ? STATE_INSTANCE_INVALID : paths[from][level - 1u];
+            }
+        }
+        return lcas;
+    }
+
+    static constexpr std::array<std::array<instance_t, count>, count> lcas = buildLCAs();
+};
+
+/* State list of a machine, checked before its hierarchy is built */
+template <class Initial, class... States>
+struct state_list {
+    static_assert(sizeof...(States) > 0u, "A machine needs at least one state");
+    static_assert(sizeof...(States) < STATE_INSTANCE_ROOT, "Too many states for instance_t");
+    static_assert(index_of<Initial, States...>::value < sizeof...(States), "The initial state must be in the state list");
+    static_assert(((std::is_same<typename States::parent_type, top>::value ||
+                    (index_of<typename States::parent_type, States...>::value < sizeof...(States))) &&
+                   ...),
+                  "Every parent must be in the state list");
+
+    using hierarchy_type = hierarchy<States...>;
+};
+
+} // namespace detail
+
+/*
+ * State machine over a fixed list of state types.
+ *
+ * Context     Object handed to the handlers through machine.context(). When it
+ *             has a member onTransition(instance_t from, instance_t to, const
+ *             Input &) returning signed int, it is called as the transducer.
+ * Mode        mode::pass_through or mode::current_node.
+ * Input       Event type, with a signal_t member named signal.
+ * Initial     The initial state.
+ * States      Every state, their position is their instance.
+ */
+template <class Context, mode Mode, class Input, class Initial, class... States>
+class machine
+{
+    using hierarchy_type = typename detail::state_list<Initial, States...>::hierarchy_type;
+
+    static_assert(hierarchy_type::isAcyclic(), "The state hierarchy must not contain cycles");
+
+  public:
+    using context_type = Context;
+    using input_type = Input;
+
+    static constexpr std::size_t stateCount = sizeof...(States);
+    static constexpr bool passThroughMode = (Mode == mode::pass_through);
+
+    /* Instance of a state type */
+    template <class S>
+    static constexpr instance_t instanceOf = static_cast<instance_t>(detail::index_of<S, States...>::value);
+
+    explicit machine(Context &context) : context_(context), currentState_(STATE_INSTANCE_ROOT), processingState_(instanceOf<Initial>)
+    {
+    }
+
+    Context &context()
+    {
+        return context_;
+    }
+
+    /**
+     * @brief Request a state transition, from within a state handler.
+     */
+    template <class S>
+    void transition()
+    {
+        static_assert(detail::index_of<S, States...>::value < stateCount, "The target must be in the state list");
+        currentState_ = instanceOf<S>;
+    }
+
+    /**
+     * @brief Request a state transition by instance, from within a state handler.
+     *
+     * @return OK on success, INVALID_ARGUMENT if the instance isn't a state of this machine.
+     */
+    signed int transition(instance_t nextState)
+    {
+        if (nextState >= stateCount) {
+            return INVALID_ARGUMENT;
+        }
+
+        currentState_ = nextState;
+        return OK;
+    }
+
+    /**
+     * @brief Get the state currently being processed.
+     */
+    instance_t getProcessingState() const
+    {
+        return processingState_;
+    }
+
+    /**
+     * @brief Get the target active state, STATE_INSTANCE_ROOT before the first dispatch.
+     */
+    instance_t getTargetState() const
+    {
+        return currentState_;
+    }
+
+    /**
+     * @brief Check whether the active state is S or one of its descendants.
+     */
+    template <class S>
+    bool isIn() const
+    {
+        if (currentState_ >= stateCount) {
+            return false;
+        }
+
+        const std::size_t depth = hierarchy_type::depths[instanceOf<S>];
+        return (hierarchy_type::depths[currentState_] >= depth) && (hierarchy_type::paths[currentState_][depth] == instanceOf<S>);
+    }
+
+    /**
+     * @brief Dispatch an event to the state machine, as hsm_dispatch() does.
+     *
+     * @return OK on success, FAULT_ERROR if a handler or the transducer failed.
+     */
+    signed int dispatch(Input input)
+    {
+        instance_t currentInst = STATE_INSTANCE_INVALID;
+        instance_t workingInst = STATE_INSTANCE_INVALID;
+        instance_t entryTarget = STATE_INSTANCE_INVALID;
+        instance_t activeInst = STATE_INSTANCE_INVALID;
+        Input savedInput = input;
+        bool isInitialEntry = false;
+
+        /* Determine starting point */
+        if (isAtRoot()) {
+            workingInst = processingState_;
+            isInitialEntry = true;
+        } else {
+            currentInst = currentState_;
+            workingInst = currentInst;
+            activeInst = currentInst;
+        }
+
+        /* Main state processing loop */
+        while ((currentInst != entryTarget) || isAtRoot()) {
+            workingInst = topmostBelow(workingInst, entryTarget);
+
+            if (!isAtRoot()) {
+                if (passThroughMode || (input.signal < SIGNAL_USER_DEFINE)) {
+                    if (invoke(workingInst, input) != OK) {
+                        return FAULT_ERROR;
+                    }
+                } else if ((activeInst != STATE_INSTANCE_INVALID) && (activeInst == workingInst)) {
+                    if (invoke(workingInst, input) != OK) {
+                        return FAULT_ERROR;
+                    }
+                }
+            } else {
+                /* First iteration: commit initial state */
+                currentState_ = processingState_;
+            }
+
+            /* After reaching target state with ENTRY signal, send INIT */
+            if ((workingInst == currentInst) && (input.signal == SIGNAL_ENTRY)) {
+                input.signal = SIGNAL_INIT;
+                if (invoke(workingInst, input) != OK) {
+                    return FAULT_ERROR;
+                }
+
+                /* On initial entry, also dispatch the original user signal */
+                if (isInitialEntry && (savedInput.signal != SIGNAL_INIT)) {
+                    if (invoke(workingInst, savedInput) != OK) {
+                        return FAULT_ERROR;
+                    }
+                }
+            }
+
+            /* Check if state handler requested a transition */
+            const instance_t newInst = currentState_;
+
+            if (currentInst != newInst) {
+                const instance_t lca = (currentInst != STATE_INSTANCE_INVALID) ? hierarchy_type::lcas[currentInst][newInst]
+                                                                              : STATE_INSTANCE_INVALID;
+
+                if (input.signal != SIGNAL_INIT) {
+                    savedInput = input;
+                }
+                if (notifyTransition(currentInst, savedInput) != OK) {
+                    return FAULT_ERROR;
+                }
+
+                /* Exit states from current up to LCA */
+                input.signal = SIGNAL_EXIT;
+                for (instance_t exitInst = currentInst; (exitInst != lca) && (exitInst != newInst);
+                     exitInst = hierarchy_type::parents[exitInst]) {
+                    if (invoke(exitInst, input) != OK) {
+                        return FAULT_ERROR;
+                    }
+                }
+
+                /* Prepare to enter new state hierarchy */
+                input.signal = SIGNAL_ENTRY;
+                currentInst = newInst;
+                entryTarget = lca;
+            } else {
+                /* No transition: we're done with this state */
+                entryTarget = workingInst;
+            }
+
+            workingInst = currentInst;
+        }
+
+        return OK;
+    }
+
+  private:
+    bool isAtRoot() const
+    {
+        return (currentState_ == STATE_INSTANCE_ROOT);
+    }
+
+    /* The ancestor of a state right below target, the topmost state when target is STATE_INSTANCE_INVALID */
+    static instance_t topmostBelow(instance_t stateInst, instance_t target)
+    {
+        const std::size_t level = (target != STATE_INSTANCE_INVALID) ? (hierarchy_type::depths[target] + 1u) : 0u;
+        return hierarchy_type::paths[stateInst][level];
+    }
+
+    template <std::size_t... I>
+    signed int call(instance_t stateInst, const Input &input, std::index_sequence<I...>)
+    {
+        signed int ret = OK;
+
+        (void)((((stateInst == I) ? (ret = std::tuple_element_t<I, std::tuple<States...>>::handle(*this, input), true) : false) || ...));
+        return ret;
+    }
+
+    /* Call a state handler directly, the state list unrolled into a chain of compares */
+    signed int invoke(instance_t stateInst, const Input &input)
+    {
+        processingState_ = stateInst;
+        return call(stateInst, input, std::index_sequence_for<States...>{});
+    }
+
+    signed int notifyTransition(instance_t fromInst, const Input &input)
+    {
+        if constexpr (detail::has_transducer<Context, Input>::value) {
+            return context_.onTransition((fromInst != STATE_INSTANCE_INVALID) ? fromInst : STATE_INSTANCE_ROOT, currentState_, input);
+        } else {
+            (void)fromInst;
+            (void)input;
+            return OK;
+        }
+    }
+
+    Context &context_;
+    instance_t currentState_;    /* Currently active state instance */
+    instance_t processingState_; /* State being processed (during transitions) */
+};
+
+/*
+ * The same state list run by the C kernel, on an hsm_state_manager_t.
+ *
+ * Each state becomes a row of an hsm_state_t table whose manager-aware
+ * handler calls the state's handle() with this object, so handlers written
+ * for hsm::machine work unchanged, with hsm_state_input_t as input type. The
+ * underlying manager is reachable through get() to give it an extension with
+ * hsm_setExtension(), then attach queues, timers and the like with the hsm.h
+ * calls; machine definitions are not supported, their handlers would not
+ * receive this object. The table and manager point into this object, so it
+ * is neither copied nor moved.
+ */
+template <class Context, mode Mode, class Initial, class... States>
+class manager
+{
+    using hierarchy_type = typename detail::state_list<Initial, States...>::hierarchy_type;
+
+    static_assert(hierarchy_type::isAcyclic(), "The state hierarchy must not contain cycles");
+
+  public:
+    using context_type = Context;
+    using input_type = hsm_state_input_t;
+
+    static constexpr std::size_t stateCount = sizeof...(States);
+    static constexpr bool passThroughMode = (Mode == mode::pass_through);
+
+    /* Instance of a state type */
+    template <class S>
+    static constexpr instance_t instanceOf = static_cast<instance_t>(detail::index_of<S, States...>::value);
+
+    explicit manager(Context &context) : manager_(), states_(), pContext_(&context)
+    {
+        const hsm_state_handler_ex_t handlers[] = {&manager::template handlerOf<States>...};
+
+        for (std::size_t i = 0u; i < stateCount; i++) {
+            const instance_t parent = hierarchy_type::parents[i];
+
+            states_[i].pParent = (parent != STATE_INSTANCE_INVALID) ? &states_[parent] : nullptr;
+            states_[i].instance = static_cast<instance_t>(i);
+            states_[i].id = static_cast<unsigned int>(i);
+            states_[i].pName = nullptr;
+            states_[i].pHandler = nullptr;
+            states_[i].pHandlerEx = handlers[i];
+        }
+        hsm_init(&manager_, states_.data(), static_cast<unsigned short>(stateCount), instanceOf<Initial>, passThroughMode,
+                 detail::has_transducer<Context, input_type>::value ? &manager::transducer : nullptr);
+    }
+
+    manager(const manager &) = delete;
+    manager &operator=(const manager &) = delete;
+
+    Context &context()
+    {
+        return *pContext_;
+    }
+
+    /**
+     * @brief Get the underlying C manager, to attach the hsm.h features to it.
+     */
+    hsm_state_manager_t *get()
+    {
+        return &manager_;
+    }
+
+    /**
+     * @brief Request a state transition, from within a state handler.
+     */
+    template <class S>
+    void transition()
+    {
+        static_assert(detail::index_of<S, States...>::value < stateCount, "The target must be in the state list");
+        (void)hsm_transition(&manager_, instanceOf<S>);
+    }
+
+    /**
+     * @brief Request a state transition by instance, see hsm_transition().
+     */
+    signed int transition(instance_t nextState)
+    {
+        return hsm_transition(&manager_, nextState);
+    }
+
+    instance_t getProcessingState()
+    {
+        return hsm_getProcessingState(&manager_);
+    }
+
+    instance_t getTargetState()
+    {
+        return hsm_getTargetState(&manager_);
+    }
+
+    /**
+     * @brief Check whether the active state is S or one of its descendants.
+     */
+    template <class S>
+    bool isIn()
+    {
+        const instance_t active = hsm_getTargetState(&manager_);
+
+        if (active >= stateCount) {
+            return false;
+        }
+
+        const std::size_t depth = hierarchy_type::depths[instanceOf<S>];
+        return (hierarchy_type::depths[active] >= depth) && (hierarchy_type::paths[active][depth] == instanceOf<S>);
+    }
+
+    /**
+     * @brief Dispatch an event through hsm_dispatch().
+     */
+    signed int dispatch(hsm_state_input_t input)
+    {
+        return hsm_dispatch(&manager_, input);
+    }
+
+  private:
+    template <class S>
+    static signed int handlerOf(hsm_state_manager_t *pManager, hsm_state_input_t input)
+    {
+        return S::handle(*reinterpret_cast<manager *>(pManager), input);
+    }
+
+    static signed int transducer(const hsm_state_t *pStates, instance_t fromState, instance_t toState, hsm_state_input_t input)
+    {
+        if constexpr (detail::has_transducer<Context, input_type>::value) {
+            const manager *pSelf = reinterpret_cast<const manager *>(reinterpret_cast<const char *>(pStates) - offsetof(manager, states_));
+
+            return pSelf->pContext_->onTransition(fromState, toState, input);
+        } else {
+            (void)pStates;
+            (void)fromState;
+            (void)toState;
+            (void)input;
+            return OK;
+        }
+    }
+
+    hsm_state_manager_t manager_;                       /* First member, handlers get back to this object from it */
+    std::array<hsm_state_t, sizeof...(States)> states_; /* State table built from the state list */
+    Context *pContext_;                                 /* Handed to the handlers and the transducer */
+};
+
+} // namespace hsm
+
+#endif /* _HSM_HPP_ */
@@ -12,9 +12,8 @@
 #include <string.h>
 #include <stdbool.h>
 
-#define EOR_INVALID_ARGUMENT (-1)
-#define EOR_INVALID_DATA     (-2)
-#define EOR_FAULT_ERROR      (-3)
+#include "fsm_error.h"
+#include "fsm_index.h"
 
 enum psm_signal {
     PSM_SIGNAL_UNKNOWN = 0u,
@@ -29,13 +28,79 @@ typedef unsigned short psm_instance_t;
 #define PSM_FAULT_ERROR            (0xFFFFFFFFu)
 #define PSM_ACTION_DONE            (NULL)
 
+#ifndef PSM_INPUT_PAYLOAD_SIZE
+#define PSM_INPUT_PAYLOAD_SIZE (0u)
+#endif
+
+#ifdef __cplusplus
+#define PSM_ALIGNAS(n) alignas(n)
+#else
+#define PSM_ALIGNAS(n) _Alignas(n)
+#endif
+
 typedef struct {
     psm_signal_t signal;
     void *pUserContext;
+#if PSM_INPUT_PAYLOAD_SIZE > 0
+    PSM_ALIGNAS(8) unsigned char payload[PSM_INPUT_PAYLOAD_SIZE];
+#endif
 } psm_state_input_t;
 
+#if PSM_INPUT_PAYLOAD_SIZE > 0
+/**
+ * @brief Copy the user data into the input inline payload.
+ *
+ * @param pInput The input.
+ * @param pData The data.
+ * @param size The data size.
+ *
+ * @return The value of 0 on success, EOR_INVALID_ARGUMENT if the data doesn't fit.
+ */
+static inline signed int psm_input_payload_set(psm_state_input_t *pInput, const void *pData, size_t size)
+{
+    if (size > sizeof(pInput->payload)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    memcpy(pInput->payload, pData, size);
+    return 0;
+}
+
+/**
+ * @brief Copy the user data out of the input inline payload.
+ *
+ * @param pInput The input.
+ * @param pData The data.
+ * @param size The data size.
+ *
+ * @return The value of 0 on success, EOR_INVALID_ARGUMENT if more than the payload is requested.
+ */
+static inline signed int psm_input_payload_get(const psm_state_input_t *pInput, void *pData, size_t size)
+{
+    if (size > sizeof(pInput->payload)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    memcpy(pData, pInput->payload, size);
+    return 0;
+}
+#endif
+
+struct psm_state_manager;
+
+/* Optional attachments, each defined by its own fsm_*.h header */
+struct fsm_spsc;
+struct fsm_mpsc;
+struct fsm_profile;
+struct fsm_metrics_slot;
+struct fsm_timer_wheel;
+struct fsm_timer;
+struct fsm_pool;
+
 typedef void *(*pPsmEntryFunc_t)(psm_state_input_t);
 
+typedef void *(*pPsmEntryExFunc_t)(struct psm_state_manager *, psm_state_input_t);
+
 typedef struct psm_state {
     psm_instance_t instance;
 
@@ -44,11 +109,89 @@ typedef struct psm_state {
     const char *pName;
 
     pPsmEntryFunc_t pEntryFunc;
+
+    pPsmEntryExFunc_t pEntryExFunc;
 } psm_state_t;
 
+typedef struct {
+    pPsmEntryFunc_t pEntryFunc;
+
+    pPsmEntryExFunc_t pEntryExFunc;
+} psm_entry_t;
+
+typedef bool (*pPsmGuardFunc_t)(psm_state_input_t);
+
+typedef void (*pPsmActionFunc_t)(psm_state_input_t);
+
+typedef struct psm_rule {
+    psm_instance_t current;
+
+    psm_signal_t signal;
+
+    pPsmGuardFunc_t pGuardFunc;
+
+    pPsmActionFunc_t pActionFunc;
+
+    psm_instance_t next;
+} psm_rule_t;
+
+typedef struct {
+    const psm_rule_t *pRules;
+
+    unsigned short number;
+
+    fsm_index_t index;
+} psm_rule_table_t;
+
 typedef signed int (*pPsmTransducerFunc_t)(const psm_state_t *, psm_instance_t, psm_instance_t, psm_state_input_t);
 
 typedef struct {
+    psm_instance_t previous;
+
+    psm_instance_t current;
+} psm_runtime_t;
+
+typedef struct psm_machine {
+    const psm_state_t *pInitState;
+
+    unsigned short number;
+
+    psm_instance_t initInstance;
+
+    pPsmTransducerFunc_t pTransucerFunc;
+
+    const psm_entry_t *pEntries;
+
+    psm_rule_table_t ruleTable;
+} psm_machine_t;
+
+typedef struct psm_extension {
+    struct fsm_spsc *pQueue;
+
+    struct fsm_mpsc *pInbox;
+
+    struct fsm_profile *pProfile;
+
+    struct fsm_metrics_slot *pMetrics;
+
+    struct fsm_timer_wheel *pWheel;
+
+    struct fsm_timer *pTimers;
+
+    unsigned short timerNumber;
+
+    struct fsm_pool *pPool;
+
+    struct fsm_spsc *pDeferred;
+
+    unsigned int *pHits;
+
+    unsigned int recallNumber;
+
+    bool isRecalling;
+} psm_extension_t;
+
+typedef struct psm_state_manager {
     const psm_state_t *pInitState;
 
     unsigned short number;
@@ -60,15 +203,60 @@ typedef struct {
     psm_signal_t exit_signal;
 
     pPsmTransducerFunc_t pTransucerFunc;
+
+    const psm_machine_t *pMachine;
+
+    psm_runtime_t *pRuntime;
+
+    psm_extension_t *pExtension;
 } psm_state_manager_t;
 
+typedef struct {
+    psm_state_manager_t *pStateManager;
+
+    psm_state_input_t input;
+} psm_activities_pair_t;
+
+#define PSM_ARENA_EXTRA_SIZE(number) FSM_ARENA_EXTENSION_SIZE(sizeof(psm_extension_t), sizeof(psm_state_input_t), (number))
+
 signed int psm_init(psm_state_manager_t *pInitManager, const psm_state_t *pInitStateList, unsigned short number,
                     psm_instance_t initInstance, pPsmTransducerFunc_t pTransucerFunc);
+signed int psm_machine_define(psm_machine_t *pMachine, const psm_state_t *pInitStateList, unsigned short number,
+                              psm_instance_t initInstance, pPsmTransducerFunc_t pTransucerFunc);
+signed int psm_rules_compile(psm_machine_t *pMachine, const psm_rule_t *pRules, unsigned short number, unsigned short *pSlots,
+                             unsigned int slotNumber);
+signed int psm_table_compile(psm_machine_t *pMachine, psm_entry_t *pEntries);
+signed int psm_table_attach(psm_machine_t *pMachine, const psm_entry_t *pEntries);
+signed int psm_machine_init(psm_state_manager_t *pStateManager, const psm_machine_t *pMachine);
+signed int psm_extension_attach(psm_state_manager_t *pStateManager, psm_extension_t *pExtension);
+signed int psm_rules_hits_attach(psm_state_manager_t *pStateManager, unsigned int *pHits);
 signed int psm_state_inst_isInvalid(psm_state_manager_t *pStateManager, psm_instance_t instance);
 const char *psm_state_nameGet(psm_state_manager_t *pStateManager, psm_instance_t instance);
 signed int psm_state_idGet(psm_state_manager_t *pStateManager, psm_instance_t instance);
 psm_instance_t psm_inst_current_get(psm_state_manager_t *pStateManager);
 signed int psm_activities(psm_state_manager_t *pStateManager, psm_state_input_t input);
+signed int psm_activities_many(psm_state_manager_t *pStateManager, const psm_state_input_t *pInputs, unsigned int number);
+signed int psm_activities_batch(const psm_activities_pair_t *pPairs, unsigned int number);
 void *psm_transition(psm_state_manager_t *pStateManager, psm_instance_t next);
+signed int psm_queue_attach(psm_state_manager_t *pStateManager, struct fsm_spsc *pQueue);
+signed int psm_queue_post(psm_state_manager_t *pStateManager, psm_state_input_t input);
+signed int psm_queue_drain(psm_state_manager_t *pStateManager, unsigned int maxNumber);
+signed int psm_inbox_attach(psm_state_manager_t *pStateManager, struct fsm_mpsc *pInbox);
+signed int psm_inbox_post(psm_state_manager_t *pStateManager, psm_state_input_t input);
+signed int psm_inbox_drain(psm_state_manager_t *pStateManager, unsigned int maxNumber);
+signed int psm_activities_event(void *pStateManager, const void *pInput);
+signed int psm_profile_attach(psm_state_manager_t *pStateManager, struct fsm_profile *pProfile);
+signed int psm_metrics_attach(psm_state_manager_t *pStateManager, struct fsm_metrics_slot *pSlot);
+signed int psm_timers_attach(psm_state_manager_t *pStateManager, struct fsm_timer_wheel *pWheel, struct fsm_timer *pTimers,
+                             unsigned short number);
+signed int psm_timeout_arm(psm_state_manager_t *pStateManager, uint64_t ticks, psm_state_input_t input);
+signed int psm_timeout_cancel(psm_state_manager_t *pStateManager);
+signed int psm_timeout_run(struct fsm_timer *pExpired);
+signed int psm_pool_attach(psm_state_manager_t *pStateManager, struct fsm_pool *pPool);
+signed int psm_defer_attach(psm_state_manager_t *pStateManager, struct fsm_spsc *pDeferred);
+signed int psm_defer(psm_state_manager_t *pStateManager, psm_state_input_t input);
+signed int psm_runtime_init(const psm_machine_t *pMachine, psm_runtime_t *pRuntime);
+signed int psm_activities_machine(const psm_machine_t *pMachine, psm_runtime_t *pRuntime, psm_state_input_t input);
+void psm_arena_construct(void *pObject, void *pExtra, size_t extraSize, const void *pPrototype);
 
 #endif /* _PSM_H_ */
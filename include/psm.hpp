@@ -0,0 +1,382 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _PSM_HPP_
+#define _PSM_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+extern "C" {
+#include "psm.h"
+}
+
+/*
+ * Header-only C++17 front end over psm.h, with the semantics of psm_activities().
+ *
+ * States are types, their position in the machine's state list is their
+ * instance. A state's entry function has the form
+ *
+ *     template <class Machine>
+ *     static psm::action handle(Machine &machine, const typename Machine::input_type &input);
+ *
+ * and returns action::done, like PSM_ACTION_DONE, or the result of
+ * machine.template transition<Target>(), like psm_transition(). psm::machine
+ * calls the current state's entry function directly, so it can be inlined;
+ * the EXIT, transducer and ENTRY sequence and the loop on returned entry
+ * functions follow psm.c step for step. psm::manager runs the same states on
+ * a psm_state_manager_t, for queues, timers and the other attachments of
+ * psm.h.
+ */
+namespace psm
+{
+
+/* Error codes, see fsm_error.h */
+constexpr signed int OK = 0;
+constexpr signed int INVALID_ARGUMENT = EOR_INVALID_ARGUMENT;
+constexpr signed int FAULT_ERROR = EOR_FAULT_ERROR;
+
+/* State signals, see enum psm_signal */
+using signal_t = psm_signal_t;
+constexpr signal_t SIGNAL_UNKNOWN = PSM_SIGNAL_UNKNOWN;
+constexpr signal_t SIGNAL_ENTRY = PSM_SIGNAL_ENTRY;
+constexpr signal_t SIGNAL_EXIT = PSM_SIGNAL_EXIT;
+constexpr signal_t SIGNAL_USER_DEFINE = PSM_SIGNAL_USER_DEFINE;
+
+/* State instance identifiers, the index of a state in the machine's state list */
+using instance_t = psm_instance_t;
+constexpr instance_t STATE_INSTANCE_INVALID = PSM_STATE_INSTANCE_INVALID;
+
+/* Result of an entry function */
+enum class action {
+    done,  /* PSM_ACTION_DONE, the input is handled */
+    next,  /* An entry function was returned, run the current state again */
+    fault, /* PSM_FAULT_ERROR */
+};
+
+/* Typed input, the data travels typed instead of through a void pointer; psm::manager takes psm_state_input_t */
+template <class Data = void *>
+struct input {
+    signal_t signal;
+    Data data;
+};
+
+namespace detail
+{
+
+template <class T, class... List>
+struct index_of;
+
+template <class T>
+struct index_of<T> : std::integral_constant<std::size_t, 0u> {
+};
+
+template <class T, class First, class... Rest>
+struct index_of<T, First, Rest...>
+    : std::integral_constant<std::size_t, std::is_same<T, First>::value ? 0u : 1u + index_of<T, Rest...>::value> {
+};
+
+template <class Context, class Input, class = void>
+struct has_transducer : std::false_type {
+};
+
+template <class Context, class Input>
+struct has_transducer<Context,
+                      Input,
+                      std::void_t<decltype(std::declval<Context &>().onTransition(instance_t{}, instance_t{}, std::declval<const Input &>()))>>
+    : std::true_type {
+};
+
+/* State list of a machine */
+template <class Initial, class... States>
+struct state_list {
+    static_assert(sizeof...(States) > 0u, "A machine needs at least one state");
+    static_assert(sizeof...(States) < STATE_INSTANCE_INVALID, "Too many states for instance_t");
+    static_assert(index_of<Initial, States...>::value < sizeof...(States), "The initial state must be in the state list");
+
+    static constexpr std::size_t count = sizeof...(States);
+};
+
+} // namespace detail
+
+/*
+ * State machine over a fixed list of state types.
+ *
+ * Context     Object handed to the entry functions through machine.context().
+ *             When it has a member onTransition(instance_t from, instance_t
+ *             to, const Input &) returning signed int, it is called as the
+ *             transducer, -1 (PSM_FAULT_ERROR) stopping the transition.
+ * Input       Input type, with a signal_t member named signal.
+ * Initial     The initial state.
+ * States      Every state, their position is their instance.
+ */
+template <class Context, class Input, class Initial, class... States>
+class machine
+{
+  public:
+    using context_type = Context;
+    using input_type = Input;
+
+    static constexpr std::size_t stateCount = detail::state_list<Initial, States...>::count;
+
+    /* Instance of a state type */
+    template <class S>
+    static constexpr instance_t instanceOf = static_cast<instance_t>(detail::index_of<S, States...>::value);
+
+    explicit machine(Context &context) : context_(context), previous_(STATE_INSTANCE_INVALID), current_(instanceOf<Initial>)
+    {
+    }
+
+    Context &context()
+    {
+        return context_;
+    }
+
+    /**
+     * @brief Switch to another state, from within an entry function.
+     *
+     * @return action::next, to be returned by the entry function.
+     */
+    template <class S>
+    action transition()
+    {
+        static_assert(detail::index_of<S, States...>::value < stateCount, "The target must be in the state list");
+        current_ = instanceOf<S>;
+        return action::next;
+    }
+
+    /**
+     * @brief Switch to another state by instance, from within an entry function.
+     *
+     * @return action::next, or action::fault if the instance isn't a state of this machine.
+     */
+    action transition(instance_t next)
+    {
+        if (next >= stateCount) {
+            return action::fault;
+        }
+
+        current_ = next;
+        return action::next;
+    }
+
+    /**
+     * @brief Get the current state.
+     */
+    instance_t getCurrentState() const
+    {
+        return current_;
+    }
+
+    /**
+     * @brief Run an input through the state machine, as psm_activities() does.
+     *
+     * @return OK on success, FAULT_ERROR if an entry function failed.
+     */
+    signed int activities(Input input)
+    {
+        action next = action::done;
+
+        do {
+            if (previous_ != current_) {
+                const signal_t exitSignal = input.signal;
+
+                input.signal = SIGNAL_EXIT;
+                if (previous_ != STATE_INSTANCE_INVALID) {
+                    if (invoke(previous_, input) == action::fault) {
+                        break;
+                    }
+                }
+
+                if (notifyTransition(input) == PSM_FAULT_ERROR) {
+                    break;
+                }
+
+                /* The first state gets its ENTRY and then the input, later ones only ENTRY */
+                input.signal = SIGNAL_ENTRY;
+                if (previous_ == STATE_INSTANCE_INVALID) {
+                    if (invoke(current_, input) == action::fault) {
+                        break;
+                    }
+                    input.signal = exitSignal;
+                }
+
+                previous_ = current_;
+            }
+
+            next = invoke(current_, input);
+        } while (next == action::next);
+
+        return (next != action::fault) ? OK : FAULT_ERROR;
+    }
+
+  private:
+    template <std::size_t... I>
+    action call(instance_t stateInst, const Input &input, std::index_sequence<I...>)
+    {
+        action ret = action::done;
+
+        (void)((((stateInst == I) ? (ret = std::tuple_element_t<I, std::tuple<States...>>::handle(*this, input), true) : false) || ...));
+        return ret;
+    }
+
+    /* Call an entry function directly, the state list unrolled into a chain of compares */
+    action invoke(instance_t stateInst, const Input &input)
+    {
+        return call(stateInst, input, std::index_sequence_for<States...>{});
+    }
+
+    unsigned int notifyTransition(const Input &input)
+    {
+        if constexpr (detail::has_transducer<Context, Input>::value) {
+            return static_cast<unsigned int>(context_.onTransition(previous_, current_, input));
+        } else {
+            (void)input;
+            return 0u;
+        }
+    }
+
+    Context &context_;
+    instance_t previous_; /* State entered last, STATE_INSTANCE_INVALID before the first input */
+    instance_t current_;  /* Current state, differs from previous_ while a transition is pending */
+};
+
+/*
+ * The same state list run by the C kernel, on a psm_state_manager_t.
+ *
+ * Each state becomes a row of a psm_state_t table whose extended entry
+ * function calls the state's handle() with this object, so entry functions
+ * written for psm::machine work unchanged, with psm_state_input_t as input
+ * type. The underlying manager is reachable through get() to give it an
+ * extension with psm_extension_attach(), then attach queues, timers and the
+ * like with the psm.h calls; machine definitions are not supported, their
+ * entry functions would not receive this object. The table and manager point
+ * into this object, so it is neither copied nor moved.
+ */
+template <class Context, class Initial, class... States>
+class manager
+{
+  public:
+    using context_type = Context;
+    using input_type = psm_state_input_t;
+
+    static constexpr std::size_t stateCount = detail::state_list<Initial, States...>::count;
+
+    /* Instance of a state type */
+    template <class S>
+    static constexpr instance_t instanceOf = static_cast<instance_t>(detail::index_of<S, States...>::value);
+
+    explicit manager(Context &context) : manager_(), states_(), pContext_(&context)
+    {
+        const pPsmEntryExFunc_t entries[] = {&manager::template entryOf<States>...};
+
+        for (std::size_t i = 0u; i < stateCount; i++) {
+            states_[i].instance = static_cast<instance_t>(i);
+            states_[i].id = static_cast<unsigned int>(i);
+            states_[i].pName = nullptr;
+            states_[i].pEntryExFunc = entries[i];
+        }
+        psm_init(&manager_, states_.data(), static_cast<unsigned short>(stateCount), instanceOf<Initial>,
+                 detail::has_transducer<Context, input_type>::value ? &manager::transducer : nullptr);
+    }
+
+    manager(const manager &) = delete;
+    manager &operator=(const manager &) = delete;
+
+    Context &context()
+    {
+        return *pContext_;
+    }
+
+    /**
+     * @brief Get the underlying C manager, to attach the psm.h features to it.
+     */
+    psm_state_manager_t *get()
+    {
+        return &manager_;
+    }
+
+    /**
+     * @brief Switch to another state through psm_transition(), from within an entry function.
+     */
+    template <class S>
+    action transition()
+    {
+        static_assert(detail::index_of<S, States...>::value < stateCount, "The target must be in the state list");
+        return toAction(psm_transition(&manager_, instanceOf<S>));
+    }
+
+    /**
+     * @brief Switch to another state by instance through psm_transition().
+     */
+    action transition(instance_t next)
+    {
+        return toAction(psm_transition(&manager_, next));
+    }
+
+    instance_t getCurrentState()
+    {
+        return psm_inst_current_get(&manager_);
+    }
+
+    /**
+     * @brief Run an input through psm_activities().
+     */
+    signed int activities(psm_state_input_t input)
+    {
+        return psm_activities(&manager_, input);
+    }
+
+  private:
+    static action toAction(void *pEntry)
+    {
+        if (pEntry == PSM_ACTION_DONE) {
+            return action::done;
+        }
+        return (pEntry == reinterpret_cast<void *>(static_cast<std::uintptr_t>(PSM_FAULT_ERROR))) ? action::fault : action::next;
+    }
+
+    template <class S>
+    static void *entryOf(psm_state_manager_t *pManager, psm_state_input_t input)
+    {
+        switch (S::handle(*reinterpret_cast<manager *>(pManager), input)) {
+        case action::done:
+            return PSM_ACTION_DONE;
+        case action::fault:
+            return reinterpret_cast<void *>(static_cast<std::uintptr_t>(PSM_FAULT_ERROR));
+        default:
+            /* psm.c only tests the returned entry function, then runs the current state again */
+            return pManager;
+        }
+    }
+
+    static signed int transducer(const psm_state_t *pStates, instance_t fromState, instance_t toState, psm_state_input_t input)
+    {
+        if constexpr (detail::has_transducer<Context, input_type>::value) {
+            const manager *pSelf = reinterpret_cast<const manager *>(reinterpret_cast<const char *>(pStates) - offsetof(manager, states_));
+
+            return pSelf->pContext_->onTransition(fromState, toState, input);
+        } else {
+            (void)pStates;
+            (void)fromState;
+            (void)toState;
+            (void)input;
+            return 0;
+        }
+    }
+
+    psm_state_manager_t manager_;                      /* First member, entry functions get back to this object from it */
+    std::array<psm_state_t, sizeof...(States)> states_; /* State table built from the state list */
+    Context *pContext_;                                /* Handed to the entry functions and the transducer */
+};
+
+} // namespace psm
+
+#endif /* _PSM_HPP_ */
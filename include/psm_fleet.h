@@ -0,0 +1,38 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#ifndef _PSM_FLEET_H_
+#define _PSM_FLEET_H_
+
+#include "psm.h"
+
+/* Table entries past number * signalSpan, lets vector gathers read whole words at the last entry */
+#define PSM_FLEET_TABLE_PAD (1u)
+
+/* Many identical flat PSMs stepped together through a (state, signal) -> next state table */
+typedef struct {
+    const psm_state_t *pInitState;
+
+    unsigned short number;
+
+    psm_signal_t signalBase;
+
+    unsigned int signalSpan;
+
+    const psm_instance_t *pNext;
+
+    pPsmTransducerFunc_t pTransucerFunc;
+} psm_fleet_t;
+
+signed int psm_fleet_compile(psm_fleet_t *pFleet, const psm_state_t *pInitStateList, unsigned short number, const psm_rule_t *pRules,
+                             unsigned short ruleNumber, psm_instance_t *pTable, unsigned int tableNumber,
+                             pPsmTransducerFunc_t pTransucerFunc);
+signed int psm_fleet_step(const psm_fleet_t *pFleet, psm_instance_t *pStates, const psm_signal_t *pSignals, void *const *ppContexts,
+                          unsigned int number);
+signed int psm_fleet_broadcast(const psm_fleet_t *pFleet, psm_instance_t *pStates, psm_signal_t signal, void *const *ppContexts,
+                               unsigned int number);
+
+#endif /* _PSM_FLEET_H_ */
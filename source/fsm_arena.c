@@ -0,0 +1,236 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include <string.h>
+#include "fsm_arena.h"
+
+/*============================================================================
+ * Private Helper Functions
+ *============================================================================*/
+
+/**
+ * @brief Get the object of a slot by index.
+ */
+static unsigned char *fsm_arena_slot(const fsm_arena_t *pArena, unsigned int index)
+{
+    return pArena->pSlots + pArena->stride * index;
+}
+
+/**
+ * @brief Get the slot index of an object, or capacity if the arena didn't hand it out.
+ */
+static unsigned int fsm_arena_index(const fsm_arena_t *pArena, const void *pObject)
+{
+    const unsigned char *p = (const unsigned char *)pObject;
+
+    if ((p < pArena->pSlots) || (p >= pArena->pSlots + pArena->stride * pArena->capacity) ||
+        (((size_t)(p - pArena->pSlots) % pArena->stride) != 0u)) {
+        return pArena->capacity;
+    }
+    return (unsigned int)((size_t)(p - pArena->pSlots) / pArena->stride);
+}
+
+/**
+ * @brief Put the object of a slot in its initial state.
+ */
+static void fsm_arena_construct(fsm_arena_t *pArena, unsigned int index)
+{
+    unsigned char *pObject = fsm_arena_slot(pArena, index);
+
+    if (pArena->pConstruct != NULL) {
+        pArena->pConstruct(pObject, (pArena->extraSize != 0u) ? (pObject + pArena->objectSize) : NULL, pArena->extraSize,
+                           pArena->pPrototype);
+    } else {
+        memcpy(pObject, pArena->pPrototype, pArena->objectSize);
+    }
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Initialize an arena of machine instances over caller-owned storage.
+ *
+ * Objects live in contiguous slots, each followed by its own extraSize bytes
+ * of per-instance storage, e.g. an event ring carved by the constructor with
+ * fsm_arena_carveQueue(). Allocating and freeing are O(1) and never touch the
+ * system allocator. The arena is not thread safe: use it from the thread
+ * owning its instances.
+ *
+ * @param pArena      The arena to initialize.
+ * @param pStorage    FSM_ARENA_STORAGE_SIZE(objectSize, extraSize, capacity) bytes, aligned to FSM_ARENA_ALIGN.
+ * @param objectSize  Bytes of one object, e.g. sizeof(hsm_state_manager_t).
+ * @param extraSize   Bytes of per-instance storage, 0 for none.
+ * @param capacity    Number of slots.
+ * @param pPrototype  An object in its initial state, kept by the arena.
+ * @param pConstruct  Constructor run on allocation and reset, e.g. hsm_arenaConstruct, or NULL to copy the prototype.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_arena_init(fsm_arena_t *pArena,
+                          void *pStorage,
+                          size_t objectSize,
+                          size_t extraSize,
+                          unsigned int capacity,
+                          const void *pPrototype,
+                          fsm_arena_construct_t pConstruct)
+{
+    if ((pArena == NULL) || (pStorage == NULL) || (pPrototype == NULL) || (objectSize == 0u) || (capacity == 0u) ||
+        (capacity == FSM_ARENA_LIVE) || (((uintptr_t)pStorage % FSM_ARENA_ALIGN) != 0u)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pArena->pLinks = (unsigned int *)pStorage;
+    pArena->pSlots = (unsigned char *)pStorage + FSM_ARENA_ROUND(sizeof(unsigned int) * (size_t)capacity);
+    pArena->stride = FSM_ARENA_STRIDE(objectSize, extraSize);
+    pArena->objectSize = FSM_ARENA_ROUND(objectSize);
+    pArena->extraSize = FSM_ARENA_ROUND(extraSize);
+    pArena->capacity = capacity;
+    pArena->pPrototype = pPrototype;
+    pArena->pConstruct = pConstruct;
+    fsm_arena_clear(pArena);
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Take a slot and put its object in the initial state, in O(1).
+ *
+ * @param pArena  The arena.
+ *
+ * @return The object, or NULL if every slot is in use.
+ */
+void *fsm_arena_alloc(fsm_arena_t *pArena)
+{
+    if ((pArena == NULL) || (pArena->freeHead == 0u)) {
+        return NULL;
+    }
+
+    unsigned int index = pArena->freeHead - 1u;
+
+    pArena->freeHead = pArena->pLinks[index];
+    pArena->pLinks[index] = FSM_ARENA_LIVE;
+    pArena->used++;
+    fsm_arena_construct(pArena, index);
+
+    return fsm_arena_slot(pArena, index);
+}
+
+/**
+ * @brief Give a slot back to the arena, in O(1).
+ *
+ * Freed slots are reused first, so a churning population stays in the same
+ * few warm slots.
+ *
+ * @param pArena   The arena.
+ * @param pObject  An object from fsm_arena_alloc().
+ *
+ * @return true on success, false if the object isn't in use in this arena.
+ */
+bool fsm_arena_free(fsm_arena_t *pArena, void *pObject)
+{
+    if ((pArena == NULL) || (pObject == NULL)) {
+        return false;
+    }
+
+    unsigned int index = fsm_arena_index(pArena, pObject);
+    if ((index >= pArena->capacity) || (pArena->pLinks[index] != FSM_ARENA_LIVE)) {
+        return false;
+    }
+
+    pArena->pLinks[index] = pArena->freeHead;
+    pArena->freeHead = index + 1u;
+    pArena->used--;
+    return true;
+}
+
+/**
+ * @brief Put every object in use back in its initial state, keeping it allocated.
+ */
+void fsm_arena_reset(fsm_arena_t *pArena)
+{
+    if (pArena == NULL) {
+        return;
+    }
+
+    for (unsigned int i = 0u; i < pArena->capacity; i++) {
+        if (pArena->pLinks[i] == FSM_ARENA_LIVE) {
+            fsm_arena_construct(pArena, i);
+        }
+    }
+}
+
+/**
+ * @brief Free every slot at once.
+ */
+void fsm_arena_clear(fsm_arena_t *pArena)
+{
+    if (pArena == NULL) {
+        return;
+    }
+
+    for (unsigned int i = 0u; i < pArena->capacity; i++) {
+        pArena->pLinks[i] = (i + 1u < pArena->capacity) ? (i + 2u) : 0u;
+    }
+    pArena->freeHead = 1u;
+    pArena->used = 0u;
+}
+
+/**
+ * @brief Get the per-instance storage following an object.
+ *
+ * @return The storage, or NULL if the arena has none or didn't hand the object out.
+ */
+void *fsm_arena_extra(const fsm_arena_t *pArena, const void *pObject)
+{
+    if ((pArena == NULL) || (pArena->extraSize == 0u) || (fsm_arena_index(pArena, pObject) >= pArena->capacity)) {
+        return NULL;
+    }
+    return (unsigned char *)(uintptr_t)pObject + pArena->objectSize;
+}
+
+/**
+ * @brief Get the number of slots in use.
+ */
+unsigned int fsm_arena_used(const fsm_arena_t *pArena)
+{
+    return (pArena != NULL) ? pArena->used : 0u;
+}
+
+/**
+ * @brief Lay out an empty event ring in per-instance storage.
+ *
+ * The ring gets the largest power-of-two capacity fitting after its header,
+ * FSM_ARENA_QUEUE_SIZE() tells how much storage a given capacity needs.
+ *
+ * @param pExtra     Per-instance storage, aligned to FSM_ARENA_ALIGN.
+ * @param extraSize  Bytes of pExtra.
+ * @param elemSize   Size of one event.
+ *
+ * @return The ring, or NULL if the storage can't hold one event.
+ */
+fsm_spsc_t *fsm_arena_carveQueue(void *pExtra, size_t extraSize, size_t elemSize)
+{
+    size_t header = FSM_ARENA_ROUND(sizeof(fsm_spsc_t));
+
+    if ((pExtra == NULL) || (elemSize == 0u) || (extraSize < header + elemSize)) {
+        return NULL;
+    }
+
+    size_t fit = (extraSize - header) / elemSize;
+    unsigned int capacity = 1u;
+
+    while (((size_t)capacity * 2u <= fit) && (capacity < (1u << 30u))) {
+        capacity *= 2u;
+    }
+
+    fsm_spsc_t *pQueue = (fsm_spsc_t *)pExtra;
+    if (fsm_spsc_init(pQueue, (unsigned char *)pExtra + header, capacity, elemSize) != FSM_OK) {
+        return NULL;
+    }
+    return pQueue;
+}
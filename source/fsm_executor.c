@@ -0,0 +1,445 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include <time.h>
+#include "fsm_executor.h"
+
+/* Failed steal rounds before a worker parks */
+#define FSM_EXECUTOR_SPIN_ROUNDS (64u)
+
+/* Parked worker timeout, bounds the cost of a missed wakeup */
+#define FSM_EXECUTOR_PARK_NS (1000000L)
+
+/* Worker running on the calling thread, NULL outside the executor */
+static _Thread_local fsm_worker_t *s_pCurrentWorker = NULL;
+
+/*============================================================================
+ * Private Helper Functions
+ *============================================================================*/
+
+/**
+ * @brief Push an object at the owner end of a worker's deque, owner only.
+ *
+ * @return true on success, false if the deque is full.
+ */
+static bool fsm_worker_push(fsm_worker_t *pWorker, fsm_active_t *pActive)
+{
+    long bottom = atomic_load_explicit(&pWorker->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&pWorker->top, memory_order_acquire);
+
+    if (bottom - top > pWorker->mask) {
+        return false;
+    }
+
+    atomic_store_explicit(&pWorker->pSlots[bottom & pWorker->mask], pActive, memory_order_release);
+    atomic_store_explicit(&pWorker->bottom, bottom + 1, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Take the newest object from the owner end, owner only.
+ */
+static fsm_active_t *fsm_worker_take(fsm_worker_t *pWorker)
+{
+    long bottom = atomic_load_explicit(&pWorker->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&pWorker->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long top = atomic_load_explicit(&pWorker->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        atomic_store_explicit(&pWorker->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    fsm_active_t *pActive = atomic_load_explicit(&pWorker->pSlots[bottom & pWorker->mask], memory_order_relaxed);
+    if (top == bottom) {
+        /* Last element: race the thieves for it */
+        if (!atomic_compare_exchange_strong_explicit(&pWorker->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+            pActive = NULL;
+        }
+        atomic_store_explicit(&pWorker->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return pActive;
+}
+
+/**
+ * @brief Steal the oldest object from the other end, from any worker.
+ */
+static fsm_active_t *fsm_worker_steal(fsm_worker_t *pVictim)
+{
+    long top = atomic_load_explicit(&pVictim->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long bottom = atomic_load_explicit(&pVictim->bottom, memory_order_acquire);
+
+    if (top >= bottom) {
+        return NULL;
+    }
+
+    fsm_active_t *pActive = atomic_load_explicit(&pVictim->pSlots[top & pVictim->mask], memory_order_acquire);
+    if (!atomic_compare_exchange_strong_explicit(&pVictim->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return pActive;
+}
+
+/**
+ * @brief Wake one parked worker, if any.
+ */
+static void fsm_executor_wake(fsm_executor_t *pExecutor)
+{
+    if (atomic_load_explicit(&pExecutor->sleepers, memory_order_seq_cst) != 0u) {
+        pthread_mutex_lock(&pExecutor->lock);
+        pthread_cond_signal(&pExecutor->wakeup);
+        pthread_mutex_unlock(&pExecutor->lock);
+    }
+}
+
+/**
+ * @brief Hand a ready object to the executor through the injection list.
+ */
+static void fsm_executor_inject(fsm_executor_t *pExecutor, fsm_active_t *pActive)
+{
+    fsm_active_t *pHead = atomic_load_explicit(&pExecutor->pInjected, memory_order_relaxed);
+
+    do {
+        pActive->pNext = pHead;
+    } while (!atomic_compare_exchange_weak_explicit(&pExecutor->pInjected, &pHead, pActive, memory_order_release, memory_order_relaxed));
+
+    fsm_executor_wake(pExecutor);
+}
+
+/**
+ * @brief Queue a ready object, on the caller's own deque when it is a worker.
+ */
+static void fsm_executor_schedule(fsm_executor_t *pExecutor, fsm_active_t *pActive)
+{
+    fsm_worker_t *pWorker = s_pCurrentWorker;
+
+    if ((pWorker != NULL) && (pWorker->pExecutor == pExecutor) && fsm_worker_push(pWorker, pActive)) {
+        fsm_executor_wake(pExecutor);
+        return;
+    }
+    fsm_executor_inject(pExecutor, pActive);
+}
+
+/**
+ * @brief Move the whole injection list onto a worker's deque.
+ *
+ * The list is taken with a single exchange, so there is no ABA hazard, and
+ * replayed oldest first. Objects that don't fit go back to the list.
+ */
+static fsm_active_t *fsm_worker_collect(fsm_worker_t *pWorker)
+{
+    fsm_executor_t *pExecutor = pWorker->pExecutor;
+    fsm_active_t *pList = atomic_exchange_explicit(&pExecutor->pInjected, NULL, memory_order_acquire);
+    fsm_active_t *pReversed = NULL;
+
+    while (pList != NULL) {
+        fsm_active_t *pNext = pList->pNext;
+        pList->pNext = pReversed;
+        pReversed = pList;
+        pList = pNext;
+    }
+
+    fsm_active_t *pFirst = pReversed;
+    if (pFirst == NULL) {
+        return NULL;
+    }
+
+    for (fsm_active_t *pActive = pFirst->pNext; pActive != NULL;) {
+        fsm_active_t *pNext = pActive->pNext;
+        if (!fsm_worker_push(pWorker, pActive)) {
+            fsm_executor_inject(pExecutor, pActive);
+        }
+        pActive = pNext;
+    }
+    return pFirst;
+}
+
+/**
+ * @brief Find the next ready object: own deque, injection list, then steal.
+ */
+static fsm_active_t *fsm_worker_next(fsm_worker_t *pWorker)
+{
+    fsm_executor_t *pExecutor = pWorker->pExecutor;
+    fsm_active_t *pActive = fsm_worker_take(pWorker);
+
+    if (pActive == NULL) {
+        pActive = fsm_worker_collect(pWorker);
+    }
+
+    for (unsigned int i = 0u; (pActive == NULL) && (i < pExecutor->workerCount); i++) {
+        pWorker->victim = (pWorker->victim + 1u) % pExecutor->workerCount;
+        if (pWorker->victim != pWorker->index) {
+            pActive = fsm_worker_steal(&pExecutor->pWorkers[pWorker->victim]);
+        }
+    }
+    return pActive;
+}
+
+/**
+ * @brief Run a batch of an object's events to completion.
+ *
+ * The object is owned exclusively while isScheduled is set. After clearing it
+ * the inbox tail is re-checked: a producer either sees the cleared flag and
+ * schedules the object itself, or its event is seen here and the object is
+ * rescheduled, so no event is left behind.
+ */
+static void fsm_worker_run(fsm_worker_t *pWorker, fsm_active_t *pActive)
+{
+    fsm_mpsc_t *pInbox = pActive->pInbox;
+    unsigned int count = fsm_mpsc_readable(pInbox, FSM_EXECUTOR_BATCH);
+
+    for (unsigned int i = 0u; i < count; i++) {
+        signed int ret = pActive->pDispatch(pActive->pMachine, fsm_mpsc_at(pInbox, i));
+        if (ret != FSM_OK) {
+            atomic_store_explicit(&pActive->lastError, ret, memory_order_relaxed);
+        }
+    }
+    fsm_mpsc_consume(pInbox, count);
+
+    unsigned int head = pInbox->head;
+    if (count == FSM_EXECUTOR_BATCH) {
+        /* Still busy: requeue behind everything else that is ready */
+        fsm_executor_inject(pWorker->pExecutor, pActive);
+        return;
+    }
+
+    atomic_store_explicit(&pActive->isScheduled, false, memory_order_seq_cst);
+    atomic_thread_fence(memory_order_seq_cst);
+    if ((atomic_load_explicit(&pInbox->tail, memory_order_seq_cst) != head) &&
+        !atomic_exchange_explicit(&pActive->isScheduled, true, memory_order_seq_cst)) {
+        fsm_executor_schedule(pWorker->pExecutor, pActive);
+    }
+}
+
+/**
+ * @brief Park an idle worker until work is injected or the timeout expires.
+ */
+static void fsm_worker_park(fsm_worker_t *pWorker)
+{
+    fsm_executor_t *pExecutor = pWorker->pExecutor;
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += FSM_EXECUTOR_PARK_NS;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&pExecutor->lock);
+    atomic_fetch_add_explicit(&pExecutor->sleepers, 1u, memory_order_seq_cst);
+    if ((atomic_load_explicit(&pExecutor->pInjected, memory_order_seq_cst) == NULL) &&
+        atomic_load_explicit(&pExecutor->isRunning, memory_order_relaxed)) {
+        pthread_cond_timedwait(&pExecutor->wakeup, &pExecutor->lock, &deadline);
+    }
+    atomic_fetch_sub_explicit(&pExecutor->sleepers, 1u, memory_order_relaxed);
+    pthread_mutex_unlock(&pExecutor->lock);
+}
+
+/**
+ * @brief Worker thread entry.
+ */
+static void *fsm_worker_main(void *pArg)
+{
+    fsm_worker_t *pWorker = (fsm_worker_t *)pArg;
+    unsigned int idleRounds = 0u;
+
+    s_pCurrentWorker = pWorker;
+    while (atomic_load_explicit(&pWorker->pExecutor->isRunning, memory_order_relaxed)) {
+        fsm_active_t *pActive = fsm_worker_next(pWorker);
+
+        if (pActive != NULL) {
+            fsm_worker_run(pWorker, pActive);
+            idleRounds = 0u;
+        } else if (++idleRounds >= FSM_EXECUTOR_SPIN_ROUNDS) {
+            fsm_worker_park(pWorker);
+            idleRounds = 0u;
+        }
+    }
+    s_pCurrentWorker = NULL;
+
+    return NULL;
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Initialize a work-stealing executor.
+ *
+ * Every object made ready sits in exactly one deque at a time, so
+ * slotsPerWorker only needs to cover the objects one worker may hold;
+ * overflow falls back to the shared injection list.
+ *
+ * @param pExecutor       The executor to initialize.
+ * @param pWorkers        Worker storage, workerCount entries.
+ * @param workerCount     Number of worker threads.
+ * @param pSlots          Deque storage, workerCount * slotsPerWorker entries.
+ * @param slotsPerWorker  Deque capacity per worker, must be a power of two.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_executor_init(fsm_executor_t *pExecutor,
+                             fsm_worker_t *pWorkers,
+                             unsigned int workerCount,
+                             fsm_active_slot_t *pSlots,
+                             unsigned int slotsPerWorker)
+{
+    if ((pExecutor == NULL) || (pWorkers == NULL) || (workerCount == 0u) || (pSlots == NULL) || (slotsPerWorker == 0u) ||
+        ((slotsPerWorker & (slotsPerWorker - 1u)) != 0u)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if ((pthread_mutex_init(&pExecutor->lock, NULL) != 0) || (pthread_cond_init(&pExecutor->wakeup, NULL) != 0)) {
+        return EOR_FAULT_ERROR;
+    }
+
+    pExecutor->pWorkers = pWorkers;
+    pExecutor->workerCount = workerCount;
+    atomic_init(&pExecutor->pInjected, NULL);
+    atomic_init(&pExecutor->isRunning, false);
+    atomic_init(&pExecutor->sleepers, 0u);
+
+    for (unsigned int i = 0u; i < workerCount; i++) {
+        fsm_worker_t *pWorker = &pWorkers[i];
+
+        atomic_init(&pWorker->top, 0);
+        atomic_init(&pWorker->bottom, 0);
+        pWorker->pSlots = &pSlots[(size_t)i * slotsPerWorker];
+        pWorker->mask = (long)slotsPerWorker - 1;
+        pWorker->pExecutor = pExecutor;
+        pWorker->index = i;
+        pWorker->victim = i;
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Start the worker threads.
+ *
+ * @param pExecutor  The executor context.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_executor_start(fsm_executor_t *pExecutor)
+{
+    if (pExecutor == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    atomic_store(&pExecutor->isRunning, true);
+    for (unsigned int i = 0u; i < pExecutor->workerCount; i++) {
+        if (pthread_create(&pExecutor->pWorkers[i].thread, NULL, fsm_worker_main, &pExecutor->pWorkers[i]) != 0) {
+            atomic_store(&pExecutor->isRunning, false);
+            while (i-- > 0u) {
+                pthread_join(pExecutor->pWorkers[i].thread, NULL);
+            }
+            return EOR_FAULT_ERROR;
+        }
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Stop and join the worker threads.
+ *
+ * Events still queued stay in the inboxes and run after the next start.
+ *
+ * @param pExecutor  The executor context.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_executor_stop(fsm_executor_t *pExecutor)
+{
+    if (pExecutor == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    atomic_store(&pExecutor->isRunning, false);
+    pthread_mutex_lock(&pExecutor->lock);
+    pthread_cond_broadcast(&pExecutor->wakeup);
+    pthread_mutex_unlock(&pExecutor->lock);
+
+    for (unsigned int i = 0u; i < pExecutor->workerCount; i++) {
+        pthread_join(pExecutor->pWorkers[i].thread, NULL);
+    }
+
+    /* Objects left on the deques are handed back through the injection list */
+    for (unsigned int i = 0u; i < pExecutor->workerCount; i++) {
+        fsm_active_t *pActive = NULL;
+        while ((pActive = fsm_worker_steal(&pExecutor->pWorkers[i])) != NULL) {
+            fsm_executor_inject(pExecutor, pActive);
+        }
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Bind a state machine to an executor as an active object.
+ *
+ * @param pActive    The active object to initialize.
+ * @param pExecutor  The executor that will run it.
+ * @param pMachine   The machine, an initialized hsm or psm manager.
+ * @param pDispatch  hsm_dispatchEvent for HSM managers, psm_activities_event for PSM managers.
+ * @param pInbox     Event ring whose element type matches pDispatch, not
+ *                   drained by anyone else.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_active_init(fsm_active_t *pActive,
+                           fsm_executor_t *pExecutor,
+                           void *pMachine,
+                           fsm_dispatch_t pDispatch,
+                           fsm_mpsc_t *pInbox)
+{
+    if ((pActive == NULL) || (pExecutor == NULL) || (pMachine == NULL) || (pDispatch == NULL) || (pInbox == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pActive->pMachine = pMachine;
+    pActive->pDispatch = pDispatch;
+    pActive->pInbox = pInbox;
+    pActive->pExecutor = pExecutor;
+    pActive->pNext = NULL;
+    atomic_init(&pActive->isScheduled, false);
+    atomic_init(&pActive->lastError, FSM_OK);
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Post an event to an active object, from any thread.
+ *
+ * The object is made ready if it wasn't already; a worker then runs its
+ * events to completion. It never runs on two workers at once.
+ *
+ * @param pActive  The active object.
+ * @param pEvent   The event, copied into the object's inbox.
+ *
+ * @return FSM_OK on success, EOR_FAULT_ERROR if the inbox is full, error code otherwise.
+ */
+signed int fsm_active_post(fsm_active_t *pActive, const void *pEvent)
+{
+    if ((pActive == NULL) || (pEvent == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if (!fsm_mpsc_push(pActive->pInbox, pEvent)) {
+        return EOR_FAULT_ERROR;
+    }
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_exchange_explicit(&pActive->isScheduled, true, memory_order_seq_cst)) {
+        fsm_executor_schedule(pActive->pExecutor, pActive);
+    }
+    return FSM_OK;
+}
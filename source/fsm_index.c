@@ -0,0 +1,249 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include "fsm_index.h"
+
+/* Displacements tried per bucket before growing the hash table */
+#define FSM_INDEX_DISPLACE_TRIES (4096u)
+
+/* Average keys per displacement bucket */
+#define FSM_INDEX_BUCKET_KEYS (4u)
+
+/*============================================================================
+ * Private Helper Functions
+ *============================================================================*/
+
+/**
+ * @brief Check if two rows carry the same (state, signal) key.
+ */
+static inline bool fsm_index_sameKey(const fsm_index_key_t *pA, const fsm_index_key_t *pB)
+{
+    return (pA->state == pB->state) && (pA->signal == pB->signal);
+}
+
+/**
+ * @brief Check if a row is the first of its key group.
+ */
+static inline bool fsm_index_isFirst(const void *pRows, size_t rowSize, unsigned short row)
+{
+    return (row == 0u) || !fsm_index_sameKey(fsm_index_key(pRows, rowSize, row), fsm_index_key(pRows, rowSize, (unsigned short)(row - 1u)));
+}
+
+/**
+ * @brief Get the displacement bucket of a key.
+ */
+static inline unsigned int fsm_index_bucket(const fsm_index_t *pIndex, const fsm_index_key_t *pKey)
+{
+    return fsm_index_hash(pKey->state, pKey->signal, 0u) & pIndex->bucketMask;
+}
+
+/**
+ * @brief Get the row slot of a key within a bucket displaced by displace.
+ */
+static inline unsigned short *fsm_index_slot(const fsm_index_t *pIndex, const fsm_index_key_t *pKey, unsigned int displace)
+{
+    return &pIndex->pSlots[pIndex->bucketMask + 1u + (fsm_index_hash(pKey->state, pKey->signal, displace + 1u) & pIndex->hashMask)];
+}
+
+/**
+ * @brief Count the key groups hashed into a bucket.
+ */
+static unsigned int fsm_index_bucketSize(const fsm_index_t *pIndex, const void *pRows, unsigned short rowCount, size_t rowSize, unsigned int bucket)
+{
+    unsigned int size = 0u;
+
+    for (unsigned short row = 0u; row < rowCount; row++) {
+        if (fsm_index_isFirst(pRows, rowSize, row) && (fsm_index_bucket(pIndex, fsm_index_key(pRows, rowSize, row)) == bucket)) {
+            size++;
+        }
+    }
+    return size;
+}
+
+/**
+ * @brief Try to place every key group of a bucket with one displacement.
+ *
+ * @return true if each key landed in a free slot, false after undoing a partial placement.
+ */
+static bool fsm_index_tryDisplace(fsm_index_t *pIndex, const void *pRows, unsigned short rowCount, size_t rowSize, unsigned int bucket, unsigned int displace)
+{
+    for (unsigned short row = 0u; row < rowCount; row++) {
+        const fsm_index_key_t *pKey = fsm_index_key(pRows, rowSize, row);
+        if (!fsm_index_isFirst(pRows, rowSize, row) || (fsm_index_bucket(pIndex, pKey) != bucket)) {
+            continue;
+        }
+
+        unsigned short *pSlot = fsm_index_slot(pIndex, pKey, displace);
+        if (*pSlot == FSM_INDEX_NONE) {
+            *pSlot = row;
+            continue;
+        }
+
+        /* Collision: release the slots this bucket took so far */
+        for (unsigned short placed = 0u; placed < row; placed++) {
+            const fsm_index_key_t *pPlaced = fsm_index_key(pRows, rowSize, placed);
+            if (fsm_index_isFirst(pRows, rowSize, placed) && (fsm_index_bucket(pIndex, pPlaced) == bucket)) {
+                *fsm_index_slot(pIndex, pPlaced, displace) = FSM_INDEX_NONE;
+            }
+        }
+        return false;
+    }
+
+    pIndex->pSlots[bucket] = (unsigned short)displace;
+    return true;
+}
+
+/**
+ * @brief Build a hash-and-displace perfect hash with the current table sizes.
+ *
+ * Buckets are placed largest first, each one searching for a displacement that
+ * sends all of its keys to free slots.
+ *
+ * @return true if every bucket found a displacement.
+ */
+static bool fsm_index_tryHash(fsm_index_t *pIndex, const void *pRows, unsigned short rowCount, size_t rowSize)
+{
+    unsigned int sizeMax = 0u;
+
+    for (unsigned int slot = 0u; slot <= pIndex->bucketMask + 1u + pIndex->hashMask; slot++) {
+        pIndex->pSlots[slot] = (slot <= pIndex->bucketMask) ? 0u : FSM_INDEX_NONE;
+    }
+    for (unsigned int bucket = 0u; bucket <= pIndex->bucketMask; bucket++) {
+        unsigned int size = fsm_index_bucketSize(pIndex, pRows, rowCount, rowSize, bucket);
+        sizeMax = (size > sizeMax) ? size : sizeMax;
+    }
+
+    for (unsigned int size = sizeMax; size > 0u; size--) {
+        for (unsigned int bucket = 0u; bucket <= pIndex->bucketMask; bucket++) {
+            if (fsm_index_bucketSize(pIndex, pRows, rowCount, rowSize, bucket) != size) {
+                continue;
+            }
+
+            unsigned int displace = 0u;
+            while (!fsm_index_tryDisplace(pIndex, pRows, rowCount, rowSize, bucket, displace)) {
+                if (++displace >= FSM_INDEX_DISPLACE_TRIES) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Compile a (state, signal) lookup over a table of rows.
+ *
+ * Rows with the same key must be contiguous; they are tried in table order.
+ * Narrow signal ranges compile to a dense state x signal array when it fits in
+ * pSlots, anything else to a hash-and-displace perfect hash, so a lookup is
+ * always one bucket read plus one slot read.
+ *
+ * @param pIndex      The index to build.
+ * @param pSlots      Slot storage.
+ * @param slotCount   Capacity of pSlots. The hash needs keys / 4 buckets plus
+ *                    the next power of two above the key count; dense needs
+ *                    stateCount x span.
+ * @param pRows       Row table, each row starting with an fsm_index_key_t.
+ * @param rowCount    Number of rows.
+ * @param rowSize     Size of one row.
+ * @param stateCount  Number of states, rows must reference states below it.
+ *
+ * @return FSM_OK on success, EOR_INVALID_DATA if the rows are malformed or no
+ *         perfect hash fits in pSlots, error code otherwise.
+ */
+signed int fsm_index_build(fsm_index_t *pIndex,
+                           unsigned short *pSlots,
+                           unsigned int slotCount,
+                           const void *pRows,
+                           unsigned short rowCount,
+                           size_t rowSize,
+                           unsigned short stateCount)
+{
+    if ((pIndex == NULL) || (pSlots == NULL) || (slotCount == 0u) || ((pRows == NULL) && (rowCount != 0u)) ||
+        (rowSize < sizeof(fsm_index_key_t)) || (rowCount == FSM_INDEX_NONE)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    unsigned int keyCount = 0u;
+    unsigned int signalMin = ~0u;
+    unsigned int signalMax = 0u;
+
+    for (unsigned short row = 0u; row < rowCount; row++) {
+        const fsm_index_key_t *pKey = fsm_index_key(pRows, rowSize, row);
+
+        if (pKey->state >= stateCount) {
+            return EOR_INVALID_DATA;
+        }
+        if (!fsm_index_isFirst(pRows, rowSize, row)) {
+            continue;
+        }
+
+        /* A key reappearing after another key would be unreachable */
+        for (unsigned short prior = 0u; prior < row; prior++) {
+            if (fsm_index_sameKey(pKey, fsm_index_key(pRows, rowSize, prior))) {
+                return EOR_INVALID_DATA;
+            }
+        }
+
+        keyCount++;
+        signalMin = (pKey->signal < signalMin) ? pKey->signal : signalMin;
+        signalMax = (pKey->signal > signalMax) ? pKey->signal : signalMax;
+    }
+
+    pIndex->pSlots = pSlots;
+    pIndex->slotCount = slotCount;
+    pIndex->stateCount = stateCount;
+
+    if (keyCount == 0u) {
+        pIndex->dense = true;
+        pIndex->signalBase = 0u;
+        pIndex->signalSpan = 0u;
+        return FSM_OK;
+    }
+
+    unsigned int span = signalMax - signalMin + 1u;
+    if ((span <= FSM_INDEX_DENSE_SPAN_MAX) && ((unsigned long)stateCount * span <= slotCount)) {
+        pIndex->dense = true;
+        pIndex->signalBase = signalMin;
+        pIndex->signalSpan = span;
+
+        for (unsigned int slot = 0u; slot < (unsigned int)stateCount * span; slot++) {
+            pSlots[slot] = FSM_INDEX_NONE;
+        }
+        for (unsigned short row = 0u; row < rowCount; row++) {
+            const fsm_index_key_t *pKey = fsm_index_key(pRows, rowSize, row);
+            if (fsm_index_isFirst(pRows, rowSize, row)) {
+                pSlots[(unsigned int)pKey->state * span + (pKey->signal - signalMin)] = row;
+            }
+        }
+        return FSM_OK;
+    }
+
+    unsigned int buckets = 1u;
+    while (buckets * FSM_INDEX_BUCKET_KEYS < keyCount) {
+        buckets <<= 1;
+    }
+
+    pIndex->dense = false;
+    pIndex->bucketMask = buckets - 1u;
+    for (unsigned int size = 1u; (size != 0u) && (buckets + size <= slotCount); size <<= 1) {
+        if (size < keyCount) {
+            continue;
+        }
+
+        pIndex->hashMask = size - 1u;
+        if (fsm_index_tryHash(pIndex, pRows, rowCount, rowSize)) {
+            return FSM_OK;
+        }
+    }
+
+    return EOR_INVALID_DATA;
+}
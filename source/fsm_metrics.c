@@ -0,0 +1,246 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fsm_metrics.h"
+
+/*============================================================================
+ * Private Helper Functions
+ *============================================================================*/
+
+/**
+ * @brief Get the mapping length of a segment with capacity slots.
+ */
+static size_t fsm_metrics_size(unsigned int capacity)
+{
+    return sizeof(fsm_metrics_header_t) + (size_t)capacity * sizeof(fsm_metrics_slot_t);
+}
+
+/**
+ * @brief Point a mapping at the header and slots of a mapped segment.
+ */
+static void fsm_metrics_bind(fsm_metrics_t *pMetrics, void *pBase, size_t size)
+{
+    pMetrics->pHeader = (fsm_metrics_header_t *)pBase;
+    pMetrics->pSlots = (fsm_metrics_slot_t *)(void *)((char *)pBase + sizeof(fsm_metrics_header_t));
+    pMetrics->size = size;
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Create a metrics segment in the publishing process.
+ *
+ * The segment is a POSIX shared memory object, so a monitor can map it with
+ * fsm_metrics_open() and poll every slot without ever stalling a dispatcher.
+ *
+ * @param pMetrics  The mapping to fill.
+ * @param pName     The shared memory object name, e.g. "/fsm-metrics", NULL for an anonymous mapping shared with forked children.
+ * @param capacity  Number of slots, one per published manager.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_metrics_create(fsm_metrics_t *pMetrics, const char *pName, unsigned int capacity)
+{
+    fsm_metrics_slot_t probe;
+
+    if ((pMetrics == NULL) || (capacity == 0u)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    /* Slots are shared across processes, which only works for lock-free atomics */
+    if (!atomic_is_lock_free(&probe.dispatches)) {
+        return EOR_FAULT_ERROR;
+    }
+
+    size_t size = fsm_metrics_size(capacity);
+    void *pBase;
+
+    if (pName == NULL) {
+        pBase = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    } else {
+        int fd = shm_open(pName, O_CREAT | O_RDWR, 0644);
+        if (fd < 0) {
+            return EOR_FAULT_ERROR;
+        }
+        if (ftruncate(fd, (off_t)size) != 0) {
+            close(fd);
+            shm_unlink(pName);
+            return EOR_FAULT_ERROR;
+        }
+        pBase = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    if (pBase == MAP_FAILED) {
+        return EOR_FAULT_ERROR;
+    }
+
+    memset(pBase, 0, size);
+    fsm_metrics_bind(pMetrics, pBase, size);
+    pMetrics->pHeader->version = FSM_METRICS_VERSION;
+    pMetrics->pHeader->slotSize = (uint32_t)sizeof(fsm_metrics_slot_t);
+    pMetrics->pHeader->capacity = capacity;
+    atomic_init(&pMetrics->pHeader->claimed, 0u);
+    atomic_thread_fence(memory_order_release);
+    pMetrics->pHeader->magic = FSM_METRICS_MAGIC;
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Map an existing metrics segment read-only, in a monitoring process.
+ *
+ * @param pMetrics  The mapping to fill.
+ * @param pName     The name the publisher passed to fsm_metrics_create().
+ *
+ * @return FSM_OK on success, EOR_INVALID_DATA if the segment isn't laid out by this build, error code otherwise.
+ */
+signed int fsm_metrics_open(fsm_metrics_t *pMetrics, const char *pName)
+{
+    fsm_metrics_header_t header;
+    struct stat info;
+
+    if ((pMetrics == NULL) || (pName == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    int fd = shm_open(pName, O_RDONLY, 0);
+    if (fd < 0) {
+        return EOR_FAULT_ERROR;
+    }
+    if ((fstat(fd, &info) != 0) || ((size_t)info.st_size < sizeof(header)) ||
+        (pread(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))) {
+        close(fd);
+        return EOR_FAULT_ERROR;
+    }
+    if ((header.magic != FSM_METRICS_MAGIC) || (header.version != FSM_METRICS_VERSION) ||
+        (header.slotSize != sizeof(fsm_metrics_slot_t)) || ((size_t)info.st_size < fsm_metrics_size(header.capacity))) {
+        close(fd);
+        return EOR_INVALID_DATA;
+    }
+
+    void *pBase = mmap(NULL, fsm_metrics_size(header.capacity), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (pBase == MAP_FAILED) {
+        return EOR_FAULT_ERROR;
+    }
+
+    fsm_metrics_bind(pMetrics, pBase, fsm_metrics_size(header.capacity));
+    return FSM_OK;
+}
+
+/**
+ * @brief Unmap a segment, detach every manager publishing into it first.
+ *
+ * @param pMetrics     The mapping.
+ * @param pUnlinkName  The shared memory object name to remove, or NULL to keep it.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_metrics_close(fsm_metrics_t *pMetrics, const char *pUnlinkName)
+{
+    if ((pMetrics == NULL) || (pMetrics->pHeader == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    signed int ret = (munmap(pMetrics->pHeader, pMetrics->size) == 0) ? FSM_OK : EOR_FAULT_ERROR;
+    if ((pUnlinkName != NULL) && (shm_unlink(pUnlinkName) != 0)) {
+        ret = EOR_FAULT_ERROR;
+    }
+
+    pMetrics->pHeader = NULL;
+    pMetrics->pSlots = NULL;
+    pMetrics->size = 0u;
+    return ret;
+}
+
+/**
+ * @brief Hand out the next free slot, from any thread of the publishing process.
+ *
+ * @param pMetrics  The mapping from fsm_metrics_create().
+ * @param kind      FSM_METRICS_KIND_HSM or FSM_METRICS_KIND_PSM.
+ * @param tag       Identifier shown to the monitor, e.g. a session id.
+ *
+ * @return The slot, to attach with hsm_setMetrics() or psm_metrics_attach(), or NULL when the segment is full.
+ */
+fsm_metrics_slot_t *fsm_metrics_claim(fsm_metrics_t *pMetrics, unsigned int kind, uint64_t tag)
+{
+    if ((pMetrics == NULL) || (pMetrics->pHeader == NULL) || (kind == FSM_METRICS_KIND_FREE)) {
+        return NULL;
+    }
+
+    unsigned int index = atomic_fetch_add_explicit(&pMetrics->pHeader->claimed, 1u, memory_order_relaxed);
+    if (index >= pMetrics->pHeader->capacity) {
+        atomic_fetch_sub_explicit(&pMetrics->pHeader->claimed, 1u, memory_order_relaxed);
+        return NULL;
+    }
+
+    fsm_metrics_slot_t *pSlot = &pMetrics->pSlots[index];
+    atomic_store_explicit(&pSlot->sequence, 1u, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&pSlot->tag, tag, memory_order_relaxed);
+    atomic_store_explicit(&pSlot->kind, kind, memory_order_relaxed);
+    atomic_store_explicit(&pSlot->sequence, 2u, memory_order_release);
+
+    return pSlot;
+}
+
+/**
+ * @brief Get the number of slots handed out, the monitor polls [0, count).
+ */
+unsigned int fsm_metrics_count(const fsm_metrics_t *pMetrics)
+{
+    if ((pMetrics == NULL) || (pMetrics->pHeader == NULL)) {
+        return 0u;
+    }
+
+    unsigned int claimed = atomic_load_explicit(&pMetrics->pHeader->claimed, memory_order_acquire);
+    return (claimed < pMetrics->pHeader->capacity) ? claimed : pMetrics->pHeader->capacity;
+}
+
+/**
+ * @brief Take a consistent copy of a slot, without blocking its writer.
+ *
+ * @param pMetrics  The mapping, from either side.
+ * @param index     The slot index, below fsm_metrics_count().
+ * @param pSample   Output.
+ *
+ * @return true on success, false if the slot is unused or kept changing for FSM_METRICS_READ_RETRIES tries.
+ */
+bool fsm_metrics_read(const fsm_metrics_t *pMetrics, unsigned int index, fsm_metrics_sample_t *pSample)
+{
+    if ((pMetrics == NULL) || (pMetrics->pHeader == NULL) || (pSample == NULL) || (index >= fsm_metrics_count(pMetrics))) {
+        return false;
+    }
+
+    fsm_metrics_slot_t *pSlot = &pMetrics->pSlots[index];
+    for (unsigned int i = 0u; i < FSM_METRICS_READ_RETRIES; i++) {
+        unsigned int sequence = atomic_load_explicit(&pSlot->sequence, memory_order_acquire);
+        if ((sequence & 1u) != 0u) {
+            continue;
+        }
+
+        pSample->tag = atomic_load_explicit(&pSlot->tag, memory_order_relaxed);
+        pSample->dispatches = atomic_load_explicit(&pSlot->dispatches, memory_order_relaxed);
+        pSample->transitions = atomic_load_explicit(&pSlot->transitions, memory_order_relaxed);
+        pSample->kind = atomic_load_explicit(&pSlot->kind, memory_order_relaxed);
+        pSample->state = atomic_load_explicit(&pSlot->state, memory_order_relaxed);
+        pSample->queueDepth = atomic_load_explicit(&pSlot->queueDepth, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+
+        if (atomic_load_explicit(&pSlot->sequence, memory_order_relaxed) == sequence) {
+            return (pSample->kind != FSM_METRICS_KIND_FREE);
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,171 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include "fsm_pool.h"
+
+/*============================================================================
+ * Private Helper Functions
+ *============================================================================*/
+
+/**
+ * @brief Get the header of a block by index.
+ */
+static fsm_pool_block_t *fsm_pool_block(const fsm_pool_t *pPool, unsigned int index)
+{
+    return (fsm_pool_block_t *)(void *)(pPool->pStorage + pPool->stride * index);
+}
+
+/**
+ * @brief Get the header in front of a payload.
+ */
+static fsm_pool_block_t *fsm_pool_header(const void *pPayload)
+{
+    return (fsm_pool_block_t *)(void *)((unsigned char *)(uintptr_t)pPayload - FSM_POOL_HEADER_SIZE);
+}
+
+/**
+ * @brief Push a block back onto the free list.
+ *
+ * The head carries a tag bumped on every update, so a pop racing with a
+ * pop and push of the same block fails its compare instead of corrupting
+ * the list.
+ */
+static void fsm_pool_push(fsm_pool_t *pPool, unsigned int index)
+{
+    fsm_pool_block_t *pBlock = fsm_pool_block(pPool, index);
+    unsigned long long head = atomic_load_explicit(&pPool->freeHead, memory_order_relaxed);
+    unsigned long long next;
+
+    do {
+        atomic_store_explicit(&pBlock->next, (unsigned int)(head & 0xFFFFFFFFu), memory_order_relaxed);
+        next = (((head >> 32u) + 1u) << 32u) | (unsigned long long)(index + 1u);
+    } while (!atomic_compare_exchange_weak_explicit(&pPool->freeHead, &head, next, memory_order_release, memory_order_relaxed));
+
+    atomic_fetch_add_explicit(&pPool->available, 1u, memory_order_relaxed);
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Initialize a pool over caller-owned storage.
+ *
+ * @param pPool        The pool to initialize.
+ * @param pStorage     FSM_POOL_STORAGE_SIZE(payloadSize, capacity) bytes, aligned to FSM_POOL_ALIGN.
+ * @param payloadSize  Usable bytes per payload.
+ * @param capacity     Number of payloads.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_pool_init(fsm_pool_t *pPool, void *pStorage, size_t payloadSize, unsigned int capacity)
+{
+    if ((pPool == NULL) || (pStorage == NULL) || (payloadSize == 0u) || (capacity == 0u) || (capacity == UINT32_MAX) ||
+        (((uintptr_t)pStorage % FSM_POOL_ALIGN) != 0u)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pPool->pStorage = (unsigned char *)pStorage;
+    pPool->stride = FSM_POOL_STRIDE(payloadSize);
+    pPool->payloadSize = FSM_POOL_ROUND(payloadSize);
+    pPool->capacity = capacity;
+    atomic_init(&pPool->available, capacity);
+    atomic_init(&pPool->freeHead, 1u);
+
+    for (unsigned int i = 0u; i < capacity; i++) {
+        fsm_pool_block_t *pBlock = fsm_pool_block(pPool, i);
+
+        atomic_init(&pBlock->refs, 0u);
+        atomic_init(&pBlock->next, (i + 1u < capacity) ? (i + 2u) : 0u);
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Take a payload from the pool, from any thread.
+ *
+ * The caller holds the only reference. Post it in an input's pUserContext to
+ * hand the reference over, or fsm_pool_retain() it once per extra receiver.
+ *
+ * @param pPool  The pool.
+ *
+ * @return The payload, or NULL if the pool is exhausted.
+ */
+void *fsm_pool_alloc(fsm_pool_t *pPool)
+{
+    if (pPool == NULL) {
+        return NULL;
+    }
+
+    unsigned long long head = atomic_load_explicit(&pPool->freeHead, memory_order_acquire);
+    unsigned long long next;
+    unsigned int index;
+
+    do {
+        if ((head & 0xFFFFFFFFu) == 0u) {
+            return NULL;
+        }
+        index = (unsigned int)(head & 0xFFFFFFFFu) - 1u;
+        next = (((head >> 32u) + 1u) << 32u) |
+               (unsigned long long)atomic_load_explicit(&fsm_pool_block(pPool, index)->next, memory_order_relaxed);
+    } while (!atomic_compare_exchange_weak_explicit(&pPool->freeHead, &head, next, memory_order_acquire, memory_order_acquire));
+
+    atomic_fetch_sub_explicit(&pPool->available, 1u, memory_order_relaxed);
+    atomic_store_explicit(&fsm_pool_block(pPool, index)->refs, 1u, memory_order_relaxed);
+    return pPool->pStorage + pPool->stride * index + FSM_POOL_HEADER_SIZE;
+}
+
+/**
+ * @brief Add a reference to a payload, for one more queue or subscriber.
+ *
+ * @return The payload, so it can be written inline in an input initializer.
+ */
+void *fsm_pool_retain(void *pPayload)
+{
+    if (pPayload != NULL) {
+        atomic_fetch_add_explicit(&fsm_pool_header(pPayload)->refs, 1u, memory_order_relaxed);
+    }
+    return pPayload;
+}
+
+/**
+ * @brief Drop a reference, the last one returns the block to the pool.
+ *
+ * @param pPool     The pool the payload came from.
+ * @param pPayload  The payload.
+ *
+ * @return true if the block went back to the pool, false otherwise.
+ */
+bool fsm_pool_release(fsm_pool_t *pPool, void *pPayload)
+{
+    if ((pPool == NULL) || (pPayload == NULL) || !fsm_pool_owns(pPool, pPayload)) {
+        return false;
+    }
+
+    if (atomic_fetch_sub_explicit(&fsm_pool_header(pPayload)->refs, 1u, memory_order_acq_rel) != 1u) {
+        return false;
+    }
+
+    fsm_pool_push(pPool, (unsigned int)((size_t)((unsigned char *)pPayload - pPool->pStorage) / pPool->stride));
+    return true;
+}
+
+/**
+ * @brief Get the number of references held on a payload.
+ */
+unsigned int fsm_pool_refs(const void *pPayload)
+{
+    return (pPayload != NULL) ? atomic_load_explicit(&fsm_pool_header(pPayload)->refs, memory_order_relaxed) : 0u;
+}
+
+/**
+ * @brief Get the number of free blocks.
+ */
+unsigned int fsm_pool_available(const fsm_pool_t *pPool)
+{
+    return (pPool != NULL) ? atomic_load_explicit(&pPool->available, memory_order_relaxed) : 0u;
+}
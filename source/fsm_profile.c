@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include <string.h>
+#include "fsm_profile.h"
+
+/*============================================================================
+ * Private Helper Functions
+ *============================================================================*/
+
+/**
+ * @brief Get the number of cells of a profile.
+ */
+static size_t fsm_profile_cells(const fsm_profile_t *pProfile)
+{
+    return (size_t)pProfile->stateCount * pProfile->signalCount;
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Initialize a profile and clear its cells.
+ *
+ * @param pProfile     The profile to initialize.
+ * @param pCells       Cell storage, stateCount * signalCount entries.
+ * @param stateCount   Number of states covered, usually the manager's state count.
+ * @param signalCount  Number of signals covered, signals from signalCount - 1 up share the last column.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_profile_init(fsm_profile_t *pProfile, fsm_profile_cell_t *pCells, unsigned short stateCount, unsigned int signalCount)
+{
+    if ((pProfile == NULL) || (pCells == NULL) || (stateCount == 0u) || (signalCount == 0u)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pProfile->pCells = pCells;
+    pProfile->stateCount = stateCount;
+    pProfile->signalCount = signalCount;
+    atomic_init(&pProfile->isResetPending, false);
+    fsm_profile_reset(pProfile);
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Clear every cell, from the dispatching thread or while it is idle.
+ *
+ * Other threads reset through fsm_profile_snapshot() instead, the cells are
+ * written without synchronization.
+ */
+void fsm_profile_reset(fsm_profile_t *pProfile)
+{
+    if (pProfile != NULL) {
+        memset(pProfile->pCells, 0, fsm_profile_cells(pProfile) * sizeof(fsm_profile_cell_t));
+        atomic_store_explicit(&pProfile->isResetPending, false, memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Copy every cell out of the profile.
+ *
+ * The dispatching thread updates cells without synchronization, so a
+ * snapshot taken from another thread while events run may see a cell a few
+ * calls apart between its count and its histogram. Take it from the
+ * dispatching thread when exact totals matter.
+ *
+ * A reset never clears the cells from here: it is handed to the dispatching
+ * thread, which clears them before recording its next call. A monitor can
+ * snapshot and reset while events run; a call recorded while the snapshot
+ * runs may be missing from both intervals.
+ *
+ * @param pProfile  The profile to read.
+ * @param pCells    Output, stateCount * signalCount entries.
+ * @param reset     Clear the profile after the copy, to start a new interval.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_profile_snapshot(fsm_profile_t *pProfile, fsm_profile_cell_t *pCells, bool reset)
+{
+    if ((pProfile == NULL) || (pCells == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    memcpy(pCells, pProfile->pCells, fsm_profile_cells(pProfile) * sizeof(fsm_profile_cell_t));
+    if (reset) {
+        atomic_store_explicit(&pProfile->isResetPending, true, memory_order_release);
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Get the cell of a (state, signal) pair.
+ *
+ * @return The cell, or NULL if the state is out of range.
+ */
+const fsm_profile_cell_t *fsm_profile_cell(const fsm_profile_t *pProfile, unsigned short state, unsigned int signal)
+{
+    if ((pProfile == NULL) || (state >= pProfile->stateCount)) {
+        return NULL;
+    }
+
+    unsigned int column = (signal < pProfile->signalCount) ? signal : (pProfile->signalCount - 1u);
+    return &pProfile->pCells[(size_t)state * pProfile->signalCount + column];
+}
+
+/**
+ * @brief Get the smallest latency that falls into a histogram bucket.
+ */
+uint64_t fsm_profile_bucketFloor(unsigned int bucket)
+{
+    const unsigned int sub = 1u << FSM_PROFILE_SUB_BITS;
+
+    if (bucket < sub) {
+        return bucket;
+    }
+
+    unsigned int exponent = bucket / sub - 1u + FSM_PROFILE_SUB_BITS;
+    return ((uint64_t)(sub + (bucket % sub))) << (exponent - FSM_PROFILE_SUB_BITS);
+}
+
+/**
+ * @brief Estimate a latency percentile of a cell.
+ *
+ * @param pCell     The cell, from fsm_profile_cell() or a snapshot.
+ * @param quantile  The quantile in [0, 1], 0.99 for p99.
+ *
+ * @return The lower bound of the bucket holding the quantile, capped by the maximum seen, 0 if the cell is empty.
+ */
+uint64_t fsm_profile_percentile(const fsm_profile_cell_t *pCell, double quantile)
+{
+    if ((pCell == NULL) || (pCell->count == 0u)) {
+        return 0u;
+    }
+
+    uint64_t rank = (uint64_t)(quantile * (double)pCell->count);
+    uint64_t seen = 0u;
+
+    rank = (rank >= pCell->count) ? (pCell->count - 1u) : rank;
+    for (unsigned int bucket = 0u; bucket < FSM_PROFILE_BUCKETS; bucket++) {
+        seen += pCell->histogram[bucket];
+        if (seen > rank) {
+            uint64_t floor = fsm_profile_bucketFloor(bucket);
+            return (floor < pCell->maxTicks) ? floor : pCell->maxTicks;
+        }
+    }
+
+    return pCell->maxTicks;
+}
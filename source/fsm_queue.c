@@ -0,0 +1,241 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include <string.h>
+#include "fsm_queue.h"
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Initialize a single-producer/single-consumer ring.
+ *
+ * @param pQueue    The ring to initialize.
+ * @param pBuffer   Element storage of capacity * elemSize bytes.
+ * @param capacity  Number of elements, must be a power of two.
+ * @param elemSize  Size of one element.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_spsc_init(fsm_spsc_t *pQueue, void *pBuffer, unsigned int capacity, size_t elemSize)
+{
+    if ((pQueue == NULL) || (pBuffer == NULL) || (elemSize == 0u) || (capacity == 0u) || ((capacity & (capacity - 1u)) != 0u)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pQueue->pBuffer = (unsigned char *)pBuffer;
+    pQueue->mask = capacity - 1u;
+    pQueue->elemSize = elemSize;
+    pQueue->headCache = 0u;
+    pQueue->tailCache = 0u;
+    atomic_init(&pQueue->head, 0u);
+    atomic_init(&pQueue->tail, 0u);
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Append one element, producer side only.
+ *
+ * The consumer's head is re-read only when the cached copy says the ring is
+ * full, so a steady stream of pushes doesn't touch the consumer's cache line.
+ *
+ * @return true on success, false if the ring is full.
+ */
+bool fsm_spsc_push(fsm_spsc_t *pQueue, const void *pElem)
+{
+    unsigned int tail = atomic_load_explicit(&pQueue->tail, memory_order_relaxed);
+
+    if (tail - pQueue->headCache > pQueue->mask) {
+        pQueue->headCache = atomic_load_explicit(&pQueue->head, memory_order_acquire);
+        if (tail - pQueue->headCache > pQueue->mask) {
+            return false;
+        }
+    }
+
+    memcpy(&pQueue->pBuffer[(size_t)(tail & pQueue->mask) * pQueue->elemSize], pElem, pQueue->elemSize);
+    atomic_store_explicit(&pQueue->tail, tail + 1u, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Remove the oldest element, consumer side only.
+ *
+ * @return true on success, false if the ring is empty.
+ */
+bool fsm_spsc_pop(fsm_spsc_t *pQueue, void *pElem)
+{
+    if (fsm_spsc_readable(pQueue) == 0u) {
+        return false;
+    }
+
+    memcpy(pElem, fsm_spsc_at(pQueue, 0u), pQueue->elemSize);
+    fsm_spsc_consume(pQueue, 1u);
+    return true;
+}
+
+/**
+ * @brief Get the number of elements the consumer can read in place.
+ *
+ * Elements stay valid through fsm_spsc_at() until fsm_spsc_consume() returns
+ * their slots to the producer, so a batch is read with one acquire and one
+ * release instead of one pair per element.
+ */
+unsigned int fsm_spsc_readable(fsm_spsc_t *pQueue)
+{
+    unsigned int head = atomic_load_explicit(&pQueue->head, memory_order_relaxed);
+
+    if (pQueue->tailCache == head) {
+        pQueue->tailCache = atomic_load_explicit(&pQueue->tail, memory_order_acquire);
+    }
+    return pQueue->tailCache - head;
+}
+
+/**
+ * @brief Release count elements read in place back to the producer.
+ */
+void fsm_spsc_consume(fsm_spsc_t *pQueue, unsigned int count)
+{
+    unsigned int head = atomic_load_explicit(&pQueue->head, memory_order_relaxed);
+    atomic_store_explicit(&pQueue->head, head + count, memory_order_release);
+}
+
+/**
+ * @brief Get the approximate number of queued elements, from any thread.
+ */
+unsigned int fsm_spsc_count(fsm_spsc_t *pQueue)
+{
+    unsigned int head = atomic_load_explicit(&pQueue->head, memory_order_acquire);
+    unsigned int tail = atomic_load_explicit(&pQueue->tail, memory_order_acquire);
+    return tail - head;
+}
+
+/**
+ * @brief Initialize a multi-producer/single-consumer ring.
+ *
+ * @param pQueue     The ring to initialize.
+ * @param pBuffer    Element storage of capacity * elemSize bytes.
+ * @param pSequence  Sequence number storage of capacity entries.
+ * @param capacity   Number of elements, must be a power of two.
+ * @param elemSize   Size of one element.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_mpsc_init(fsm_mpsc_t *pQueue, void *pBuffer, atomic_uint *pSequence, unsigned int capacity, size_t elemSize)
+{
+    if ((pQueue == NULL) || (pBuffer == NULL) || (pSequence == NULL) || (elemSize == 0u) || (capacity == 0u) ||
+        ((capacity & (capacity - 1u)) != 0u)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pQueue->pBuffer = (unsigned char *)pBuffer;
+    pQueue->pSequence = pSequence;
+    pQueue->mask = capacity - 1u;
+    pQueue->elemSize = elemSize;
+    pQueue->head = 0u;
+    atomic_init(&pQueue->tail, 0u);
+    atomic_init(&pQueue->isOwned, false);
+    for (unsigned int slot = 0u; slot < capacity; slot++) {
+        atomic_init(&pSequence[slot], slot);
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Append one element, from any thread.
+ *
+ * A producer claims a slot by advancing the shared tail with a CAS, fills it
+ * and then publishes it through the slot's sequence number, so producers only
+ * contend on the tail and never wait for each other to finish copying.
+ *
+ * @return true on success, false if the ring is full.
+ */
+bool fsm_mpsc_push(fsm_mpsc_t *pQueue, const void *pElem)
+{
+    unsigned int pos = atomic_load_explicit(&pQueue->tail, memory_order_relaxed);
+    atomic_uint *pSequence = NULL;
+
+    for (;;) {
+        pSequence = &pQueue->pSequence[pos & pQueue->mask];
+        int diff = (int)(atomic_load_explicit(pSequence, memory_order_acquire) - pos);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&pQueue->tail, &pos, pos + 1u, memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&pQueue->tail, memory_order_relaxed);
+        }
+    }
+
+    memcpy(&pQueue->pBuffer[(size_t)(pos & pQueue->mask) * pQueue->elemSize], pElem, pQueue->elemSize);
+    atomic_store_explicit(pSequence, pos + 1u, memory_order_release);
+    return true;
+}
+
+/**
+ * @brief Become the ring's consumer.
+ *
+ * Any thread may try, at most one succeeds until fsm_mpsc_release(), so the
+ * machine fed by the ring keeps run-to-completion semantics.
+ *
+ * @return true if the caller now owns the consumer side.
+ */
+bool fsm_mpsc_acquire(fsm_mpsc_t *pQueue)
+{
+    return !atomic_exchange_explicit(&pQueue->isOwned, true, memory_order_acquire);
+}
+
+/**
+ * @brief Give up the consumer side taken with fsm_mpsc_acquire().
+ */
+void fsm_mpsc_release(fsm_mpsc_t *pQueue)
+{
+    atomic_store_explicit(&pQueue->isOwned, false, memory_order_release);
+}
+
+/**
+ * @brief Get the number of consecutive published elements, owning consumer only.
+ *
+ * Stops at the first slot a producer claimed but hasn't published yet.
+ */
+unsigned int fsm_mpsc_readable(fsm_mpsc_t *pQueue, unsigned int maxCount)
+{
+    unsigned int count = 0u;
+
+    while (count < maxCount) {
+        unsigned int pos = pQueue->head + count;
+        if (atomic_load_explicit(&pQueue->pSequence[pos & pQueue->mask], memory_order_acquire) != pos + 1u) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+/**
+ * @brief Hand count elements read in place back to the producers.
+ */
+void fsm_mpsc_consume(fsm_mpsc_t *pQueue, unsigned int count)
+{
+    for (unsigned int i = 0u; i < count; i++) {
+        unsigned int pos = pQueue->head + i;
+        atomic_store_explicit(&pQueue->pSequence[pos & pQueue->mask], pos + pQueue->mask + 1u, memory_order_release);
+    }
+    pQueue->head += count;
+}
+
+/**
+ * @brief Get the approximate number of claimed elements, owning consumer only.
+ */
+unsigned int fsm_mpsc_count(fsm_mpsc_t *pQueue)
+{
+    return atomic_load_explicit(&pQueue->tail, memory_order_acquire) - pQueue->head;
+}
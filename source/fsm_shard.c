@@ -0,0 +1,314 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+#include <string.h>
+#include <sched.h>
+#include "fsm_shard.h"
+
+/* Empty polls before a shard thread yields its core */
+#define FSM_SHARD_SPIN_ROUNDS (1024u)
+
+/* Shard running on the calling thread, FSM_SHARD_NONE outside the runtime */
+static _Thread_local unsigned int s_currentShard = FSM_SHARD_NONE;
+
+/*============================================================================
+ * Private Helper Functions
+ *============================================================================*/
+
+/**
+ * @brief Get the mailbox written by source and read by shard.
+ */
+static inline fsm_spsc_t *fsm_shard_mailbox(fsm_shard_runtime_t *pRuntime, unsigned int source, unsigned int shard)
+{
+    return &pRuntime->pMailboxes[(size_t)source * pRuntime->shardCount + shard];
+}
+
+/**
+ * @brief Pin the calling thread to a CPU, where the platform supports it.
+ */
+static void fsm_shard_applyAffinity(const fsm_shard_t *pShard)
+{
+#if defined(__linux__)
+    if (pShard->cpu != FSM_SHARD_NONE) {
+        cpu_set_t set;
+
+        CPU_ZERO(&set);
+        CPU_SET(pShard->cpu, &set);
+        (void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#else
+    (void)pShard;
+#endif
+}
+
+/**
+ * @brief Shard thread entry: poll the mailboxes until the runtime stops.
+ */
+static void *fsm_shard_main(void *pArg)
+{
+    fsm_shard_t *pShard = (fsm_shard_t *)pArg;
+    fsm_shard_runtime_t *pRuntime = pShard->pRuntime;
+    unsigned int idleRounds = 0u;
+
+    fsm_shard_applyAffinity(pShard);
+    s_currentShard = pShard->index;
+
+    while (atomic_load_explicit(&pRuntime->isRunning, memory_order_relaxed)) {
+        if (fsm_shard_poll(pRuntime, pShard->index) > 0) {
+            idleRounds = 0u;
+        } else if (++idleRounds >= FSM_SHARD_SPIN_ROUNDS) {
+            sched_yield();
+            idleRounds = 0u;
+        }
+    }
+    s_currentShard = FSM_SHARD_NONE;
+
+    return NULL;
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Initialize a shard-per-core runtime.
+ *
+ * @param pRuntime         The runtime to initialize.
+ * @param pShards          Shard storage, shardCount entries.
+ * @param shardCount       Number of shards, normally one per core.
+ * @param sourceCount      Number of posting sources, shardCount plus one per
+ *                         external producer thread.
+ * @param pMailboxes       Ring storage, sourceCount * shardCount entries.
+ * @param pBuffer          Message storage, sourceCount * shardCount * mailboxCapacity entries.
+ * @param mailboxCapacity  Messages per mailbox, must be a power of two.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_shard_init(fsm_shard_runtime_t *pRuntime,
+                          fsm_shard_t *pShards,
+                          unsigned int shardCount,
+                          unsigned int sourceCount,
+                          fsm_spsc_t *pMailboxes,
+                          fsm_shard_msg_t *pBuffer,
+                          unsigned int mailboxCapacity)
+{
+    if ((pRuntime == NULL) || (pShards == NULL) || (shardCount == 0u) || (sourceCount < shardCount) || (pMailboxes == NULL) ||
+        (pBuffer == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pRuntime->pShards = pShards;
+    pRuntime->shardCount = shardCount;
+    pRuntime->sourceCount = sourceCount;
+    pRuntime->pMailboxes = pMailboxes;
+    atomic_init(&pRuntime->isRunning, false);
+
+    for (size_t i = 0u; i < (size_t)sourceCount * shardCount; i++) {
+        signed int ret = fsm_spsc_init(&pMailboxes[i], &pBuffer[i * mailboxCapacity], mailboxCapacity, sizeof(fsm_shard_msg_t));
+        if (ret != FSM_OK) {
+            return ret;
+        }
+    }
+
+    for (unsigned int i = 0u; i < shardCount; i++) {
+        pShards[i].pRuntime = pRuntime;
+        pShards[i].index = i;
+        pShards[i].cpu = FSM_SHARD_NONE;
+        pShards[i].events = 0u;
+        pShards[i].lastError = FSM_OK;
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Pin a shard's thread to a CPU, applied when the runtime starts.
+ *
+ * @param pRuntime  The runtime context.
+ * @param shard     The shard to pin.
+ * @param cpu       The CPU index, or FSM_SHARD_NONE to leave the thread floating.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_shard_pin(fsm_shard_runtime_t *pRuntime, unsigned int shard, unsigned int cpu)
+{
+    if ((pRuntime == NULL) || (shard >= pRuntime->shardCount)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pRuntime->pShards[shard].cpu = cpu;
+    return FSM_OK;
+}
+
+/**
+ * @brief Hand a state machine to a shard.
+ *
+ * The machine is dispatched only on that shard's thread from then on, so its
+ * handlers never need locking.
+ *
+ * @param pTarget    The binding to initialize, used as the post address.
+ * @param pRuntime   The runtime context.
+ * @param shard      The owning shard.
+ * @param pMachine   The machine, an initialized hsm or psm manager.
+ * @param pDispatch  hsm_dispatchEvent for HSM managers, psm_activities_event for PSM managers.
+ * @param eventSize  Size of the events pDispatch expects.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_shard_bind(fsm_shard_machine_t *pTarget,
+                          fsm_shard_runtime_t *pRuntime,
+                          unsigned int shard,
+                          void *pMachine,
+                          fsm_dispatch_t pDispatch,
+                          size_t eventSize)
+{
+    if ((pTarget == NULL) || (pRuntime == NULL) || (shard >= pRuntime->shardCount) || (pMachine == NULL) || (pDispatch == NULL) ||
+        (eventSize == 0u) || (eventSize > FSM_SHARD_EVENT_SIZE)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pTarget->pMachine = pMachine;
+    pTarget->pDispatch = pDispatch;
+    pTarget->eventSize = eventSize;
+    pTarget->shard = shard;
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Post an event to a machine, from the thread owning source.
+ *
+ * A shard posts with its own index; posting to one of its own machines goes
+ * through its local queue. Each external thread posts with its own index at
+ * or above shardCount.
+ *
+ * @param pRuntime  The runtime context.
+ * @param source    The posting source.
+ * @param pTarget   The machine binding.
+ * @param pEvent    The event, copied into the mailbox.
+ *
+ * @return FSM_OK on success, EOR_FAULT_ERROR if the mailbox is full, error code otherwise.
+ */
+signed int fsm_shard_post(fsm_shard_runtime_t *pRuntime, unsigned int source, fsm_shard_machine_t *pTarget, const void *pEvent)
+{
+    if ((pRuntime == NULL) || (source >= pRuntime->sourceCount) || (pTarget == NULL) || (pEvent == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    fsm_shard_msg_t msg;
+    msg.pTarget = pTarget;
+    memcpy(msg.event, pEvent, pTarget->eventSize);
+
+    return fsm_spsc_push(fsm_shard_mailbox(pRuntime, source, pTarget->shard), &msg) ? FSM_OK : EOR_FAULT_ERROR;
+}
+
+/**
+ * @brief Dispatch one batch from each of a shard's mailboxes.
+ *
+ * Called by the shard thread, or directly by an application that drives the
+ * shard from its own loop instead of fsm_shard_start().
+ *
+ * @param pRuntime  The runtime context.
+ * @param shard     The shard to poll, owned by the calling thread.
+ *
+ * @return Number of messages dispatched, or error code.
+ */
+signed int fsm_shard_poll(fsm_shard_runtime_t *pRuntime, unsigned int shard)
+{
+    if ((pRuntime == NULL) || (shard >= pRuntime->shardCount)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    fsm_shard_t *pShard = &pRuntime->pShards[shard];
+    unsigned int total = 0u;
+
+    for (unsigned int source = 0u; source < pRuntime->sourceCount; source++) {
+        fsm_spsc_t *pMailbox = fsm_shard_mailbox(pRuntime, source, shard);
+        unsigned int count = fsm_spsc_readable(pMailbox);
+
+        if (count > FSM_SHARD_BATCH) {
+            count = FSM_SHARD_BATCH;
+        }
+        for (unsigned int i = 0u; i < count; i++) {
+            const fsm_shard_msg_t *pMsg = (const fsm_shard_msg_t *)fsm_spsc_at(pMailbox, i);
+            signed int ret = pMsg->pTarget->pDispatch(pMsg->pTarget->pMachine, pMsg->event);
+
+            if (ret != FSM_OK) {
+                pShard->lastError = ret;
+            }
+        }
+        fsm_spsc_consume(pMailbox, count);
+        total += count;
+    }
+
+    pShard->events += total;
+    return (signed int)total;
+}
+
+/**
+ * @brief Start one thread per shard, pinned where requested.
+ *
+ * @param pRuntime  The runtime context.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_shard_start(fsm_shard_runtime_t *pRuntime)
+{
+    if (pRuntime == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    atomic_store(&pRuntime->isRunning, true);
+    for (unsigned int i = 0u; i < pRuntime->shardCount; i++) {
+        if (pthread_create(&pRuntime->pShards[i].thread, NULL, fsm_shard_main, &pRuntime->pShards[i]) != 0) {
+            atomic_store(&pRuntime->isRunning, false);
+            while (i-- > 0u) {
+                pthread_join(pRuntime->pShards[i].thread, NULL);
+            }
+            return EOR_FAULT_ERROR;
+        }
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Stop and join the shard threads.
+ *
+ * Undelivered messages stay in the mailboxes.
+ *
+ * @param pRuntime  The runtime context.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_shard_stop(fsm_shard_runtime_t *pRuntime)
+{
+    if (pRuntime == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    atomic_store(&pRuntime->isRunning, false);
+    for (unsigned int i = 0u; i < pRuntime->shardCount; i++) {
+        pthread_join(pRuntime->pShards[i].thread, NULL);
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Get the shard running on the calling thread.
+ *
+ * Handlers use it as the source when posting to other machines.
+ *
+ * @return The shard index, or FSM_SHARD_NONE outside a shard thread.
+ */
+unsigned int fsm_shard_self(void)
+{
+    return s_currentShard;
+}
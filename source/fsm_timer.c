@@ -0,0 +1,262 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include <string.h>
+#include "fsm_timer.h"
+
+#define FSM_TIMER_SLOT_MASK ((uint64_t)FSM_TIMER_WHEEL_SLOTS - 1u)
+
+/* Longest delay the top level holds, later expiries are parked there and cascaded again */
+#define FSM_TIMER_SPAN_MAX ((((uint64_t)1u) << (FSM_TIMER_WHEEL_BITS * FSM_TIMER_WHEEL_LEVELS)) - 1u)
+
+_Static_assert(FSM_TIMER_WHEEL_BITS * FSM_TIMER_WHEEL_LEVELS < 64u, "The wheel span must fit in a 64-bit tick");
+
+/*============================================================================
+ * Private Helper Functions
+ *============================================================================*/
+
+/**
+ * @brief Link a timer into the slot its expiry falls in, relative to the wheel time.
+ *
+ * A timer goes to the lowest level whose span covers its delay; it is cascaded
+ * one level down each time the wheel reaches its slot, so arming stays O(1).
+ */
+static void fsm_timer_place(fsm_timer_wheel_t *pWheel, fsm_timer_t *pTimer)
+{
+    uint64_t delay = pTimer->expiry - pWheel->now;
+    uint64_t at = (delay > FSM_TIMER_SPAN_MAX) ? (pWheel->now + FSM_TIMER_SPAN_MAX) : pTimer->expiry;
+    unsigned int level = 0u;
+
+    delay = at - pWheel->now;
+    while ((level + 1u < FSM_TIMER_WHEEL_LEVELS) && ((delay >> (FSM_TIMER_WHEEL_BITS * (level + 1u))) != 0u)) {
+        level++;
+    }
+
+    fsm_timer_t **ppHead = &pWheel->pSlots[level][(at >> (FSM_TIMER_WHEEL_BITS * level)) & FSM_TIMER_SLOT_MASK];
+    pTimer->pNext = *ppHead;
+    pTimer->ppPrev = ppHead;
+    pTimer->level = (unsigned char)level;
+    pWheel->levelPending[level]++;
+    if (*ppHead != NULL) {
+        (*ppHead)->ppPrev = &pTimer->pNext;
+    }
+    *ppHead = pTimer;
+}
+
+/**
+ * @brief Take a whole slot out of the wheel.
+ */
+static fsm_timer_t *fsm_timer_take(fsm_timer_wheel_t *pWheel, unsigned int level, uint64_t tick)
+{
+    fsm_timer_t **ppHead = &pWheel->pSlots[level][(tick >> (FSM_TIMER_WHEEL_BITS * level)) & FSM_TIMER_SLOT_MASK];
+    fsm_timer_t *pList = *ppHead;
+
+    *ppHead = NULL;
+    for (fsm_timer_t *pTimer = pList; pTimer != NULL; pTimer = pTimer->pNext) {
+        pWheel->levelPending[level]--;
+    }
+    return pList;
+}
+
+/**
+ * @brief Process one tick: cascade the higher levels reaching a new slot, then expire level 0.
+ *
+ * @param pWheel  The wheel, pWheel->now being the tick to process.
+ * @param ppTail  Tail link of the expired list.
+ *
+ * @return The new tail link.
+ */
+static fsm_timer_t **fsm_timer_tick(fsm_timer_wheel_t *pWheel, fsm_timer_t **ppTail)
+{
+    unsigned int top = 0u;
+
+    while ((top + 1u < FSM_TIMER_WHEEL_LEVELS) && ((pWheel->now & ((((uint64_t)1u) << (FSM_TIMER_WHEEL_BITS * (top + 1u))) - 1u)) == 0u)) {
+        top++;
+    }
+
+    for (unsigned int level = top; level > 0u; level--) {
+        fsm_timer_t *pTimer = fsm_timer_take(pWheel, level, pWheel->now);
+
+        while (pTimer != NULL) {
+            fsm_timer_t *pNext = pTimer->pNext;
+            fsm_timer_place(pWheel, pTimer);
+            pTimer = pNext;
+        }
+    }
+
+    for (fsm_timer_t *pTimer = fsm_timer_take(pWheel, 0u, pWheel->now); pTimer != NULL;) {
+        fsm_timer_t *pNext = pTimer->pNext;
+
+        pTimer->pNext = NULL;
+        pTimer->ppPrev = NULL;
+        pTimer->expired = 1u;
+        *ppTail = pTimer;
+        ppTail = &pTimer->pNext;
+        pWheel->pending--;
+        pTimer = pNext;
+    }
+
+    return ppTail;
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Initialize an empty timing wheel.
+ *
+ * The wheel is not thread safe: arm, cancel and advance it from the thread
+ * running the machines it times.
+ *
+ * @param pWheel  The wheel to initialize.
+ * @param now     The current tick, in whatever unit the caller advances it.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_timer_wheel_init(fsm_timer_wheel_t *pWheel, uint64_t now)
+{
+    if (pWheel == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    memset(pWheel->pSlots, 0, sizeof(pWheel->pSlots));
+    memset(pWheel->levelPending, 0, sizeof(pWheel->levelPending));
+    pWheel->now = now;
+    pWheel->pending = 0u;
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Initialize an idle timer for a manager.
+ */
+void fsm_timer_init(fsm_timer_t *pTimer, void *pMachine)
+{
+    if (pTimer != NULL) {
+        pTimer->pNext = NULL;
+        pTimer->ppPrev = NULL;
+        pTimer->expiry = 0u;
+        pTimer->pMachine = pMachine;
+        pTimer->pContext = NULL;
+        pTimer->signal = 0u;
+        pTimer->owner = FSM_TIMER_OWNER_NONE;
+        pTimer->level = 0u;
+        pTimer->expired = 0u;
+    }
+}
+
+/**
+ * @brief Arm a timer to expire ticks after the wheel's current tick, in O(1).
+ *
+ * An armed timer is re-armed with the new delay.
+ *
+ * @param pWheel  The wheel.
+ * @param pTimer  The timer.
+ * @param ticks   The delay, at least 1.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_timer_arm(fsm_timer_wheel_t *pWheel, fsm_timer_t *pTimer, uint64_t ticks)
+{
+    if ((pWheel == NULL) || (pTimer == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    fsm_timer_cancel(pWheel, pTimer);
+    pTimer->expired = 0u;
+    pTimer->expiry = pWheel->now + ((ticks != 0u) ? ticks : 1u);
+    fsm_timer_place(pWheel, pTimer);
+    pWheel->pending++;
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Take a timer out of the wheel, in O(1).
+ *
+ * @param pWheel  The wheel.
+ * @param pTimer  The timer.
+ *
+ * @return true if the timer was armed, false otherwise.
+ */
+bool fsm_timer_cancel(fsm_timer_wheel_t *pWheel, fsm_timer_t *pTimer)
+{
+    if ((pWheel == NULL) || (pTimer == NULL) || (pTimer->ppPrev == NULL)) {
+        return false;
+    }
+
+    *pTimer->ppPrev = pTimer->pNext;
+    if (pTimer->pNext != NULL) {
+        pTimer->pNext->ppPrev = pTimer->ppPrev;
+    }
+    pTimer->pNext = NULL;
+    pTimer->ppPrev = NULL;
+    pWheel->levelPending[pTimer->level]--;
+    pWheel->pending--;
+
+    return true;
+}
+
+/**
+ * @brief Advance the wheel up to a tick and collect every timer that expired.
+ *
+ * The expired timers are returned as one list linked through pNext, in expiry
+ * order, so the caller can deliver them as a batch. They are no longer in the
+ * wheel and stay marked expired until the caller walks past them, clearing
+ * the mark; read pNext before re-arming one of them.
+ *
+ * @param pWheel  The wheel.
+ * @param now     The current tick, earlier ticks are ignored.
+ *
+ * @return The expired timers, or NULL if none.
+ */
+fsm_timer_t *fsm_timer_advance(fsm_timer_wheel_t *pWheel, uint64_t now)
+{
+    fsm_timer_t *pExpired = NULL;
+    fsm_timer_t **ppTail = &pExpired;
+
+    if (pWheel == NULL) {
+        return NULL;
+    }
+
+    while (pWheel->now < now) {
+        unsigned int level = 0u;
+
+        while ((level < FSM_TIMER_WHEEL_LEVELS) && (pWheel->levelPending[level] == 0u)) {
+            level++;
+        }
+        if (level == FSM_TIMER_WHEEL_LEVELS) {
+            pWheel->now = now;
+            break;
+        }
+
+        /* Nothing can expire before the lowest busy level reaches its next slot */
+        if (level > 0u) {
+            unsigned int shift = FSM_TIMER_WHEEL_BITS * level;
+            uint64_t next = ((pWheel->now >> shift) + 1u) << shift;
+
+            if (next > now) {
+                pWheel->now = now;
+                break;
+            }
+            pWheel->now = next - 1u;
+        }
+
+        pWheel->now++;
+        ppTail = fsm_timer_tick(pWheel, ppTail);
+    }
+
+    return pExpired;
+}
+
+/**
+ * @brief Get the number of timers waiting in the wheel.
+ */
+unsigned int fsm_timer_pending(const fsm_timer_wheel_t *pWheel)
+{
+    return (pWheel != NULL) ? pWheel->pending : 0u;
+}
@@ -0,0 +1,269 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include <string.h>
+#include "fsm_trace.h"
+
+/* Binary dump header magic, "FSMT" */
+#define FSM_TRACE_MAGIC (0x544D5346u)
+
+_Thread_local fsm_trace_ring_t *g_pFsmTraceRing = NULL;
+
+/* Binary dump header, followed by count records oldest first */
+typedef struct {
+    uint32_t magic;
+    uint32_t recordSize;
+    uint32_t count;
+    uint32_t reserved;
+} fsm_trace_file_t;
+
+/*============================================================================
+ * Private Helper Functions
+ *============================================================================*/
+
+/**
+ * @brief Get the index of the oldest record still held by the ring.
+ *
+ * Sequence numbers wrap with head, so a full ring starts capacity records back in modular arithmetic.
+ */
+static unsigned int fsm_trace_first(const fsm_trace_ring_t *pRing, unsigned int head)
+{
+    return atomic_load_explicit(&pRing->isFull, memory_order_relaxed) ? (head - (pRing->mask + 1u)) : 0u;
+}
+
+/**
+ * @brief Get a record by its sequence number.
+ */
+static const fsm_trace_record_t *fsm_trace_at(const fsm_trace_ring_t *pRing, unsigned int sequence)
+{
+    return &pRing->pRecords[sequence & pRing->mask];
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Initialize a trace ring.
+ *
+ * @param pRing     The ring to initialize.
+ * @param pRecords  Record storage, capacity entries.
+ * @param capacity  Number of records kept, must be a power of two.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_trace_init(fsm_trace_ring_t *pRing, fsm_trace_record_t *pRecords, unsigned int capacity)
+{
+    if ((pRing == NULL) || (pRecords == NULL) || (capacity == 0u) || ((capacity & (capacity - 1u)) != 0u)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pRing->pRecords = pRecords;
+    pRing->mask = capacity - 1u;
+    atomic_init(&pRing->head, 0u);
+    atomic_init(&pRing->isFull, false);
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Trace the dispatches run by the calling thread into a ring.
+ *
+ * Only the attached thread writes the ring, so no two writers ever race.
+ * Once full, the oldest records are overwritten.
+ *
+ * @param pRing  The ring, or NULL to stop tracing this thread.
+ */
+void fsm_trace_attach(fsm_trace_ring_t *pRing)
+{
+    g_pFsmTraceRing = pRing;
+}
+
+/**
+ * @brief Get the ring attached to the calling thread.
+ */
+fsm_trace_ring_t *fsm_trace_current(void)
+{
+    return g_pFsmTraceRing;
+}
+
+/**
+ * @brief Get the number of records the ring holds.
+ */
+unsigned int fsm_trace_count(const fsm_trace_ring_t *pRing)
+{
+    if (pRing == NULL) {
+        return 0u;
+    }
+
+    unsigned int head = atomic_load_explicit(&pRing->head, memory_order_acquire);
+    return head - fsm_trace_first(pRing, head);
+}
+
+/**
+ * @brief Write the held records to a binary file, oldest first.
+ *
+ * Call it from the writer thread or once the writer is idle, records being
+ * overwritten while they are saved are not detected.
+ *
+ * @param pRing  The ring to save.
+ * @param pFile  The output stream, opened in binary mode.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_trace_save(const fsm_trace_ring_t *pRing, FILE *pFile)
+{
+    if ((pRing == NULL) || (pFile == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    unsigned int head = atomic_load_explicit(&pRing->head, memory_order_acquire);
+    unsigned int first = fsm_trace_first(pRing, head);
+    fsm_trace_file_t header = {
+        .magic = FSM_TRACE_MAGIC,
+        .recordSize = (uint32_t)sizeof(fsm_trace_record_t),
+        .count = head - first,
+        .reserved = 0u,
+    };
+
+    if (fwrite(&header, sizeof(header), 1u, pFile) != 1u) {
+        return EOR_FAULT_ERROR;
+    }
+    for (unsigned int sequence = first; sequence != head; sequence++) {
+        if (fwrite(fsm_trace_at(pRing, sequence), sizeof(fsm_trace_record_t), 1u, pFile) != 1u) {
+            return EOR_FAULT_ERROR;
+        }
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Read a binary file written by fsm_trace_save() into a ring.
+ *
+ * Machine pointers are kept as identifiers only, they can't be dereferenced
+ * in another process. When the file holds more records than capacity, the
+ * newest ones are kept.
+ *
+ * @param pRing     The ring to fill.
+ * @param pRecords  Record storage, capacity entries.
+ * @param capacity  Number of records, must be a power of two.
+ * @param pFile     The input stream, opened in binary mode.
+ *
+ * @return FSM_OK on success, EOR_INVALID_DATA if the file isn't a trace of this build, error code otherwise.
+ */
+signed int fsm_trace_load(fsm_trace_ring_t *pRing, fsm_trace_record_t *pRecords, unsigned int capacity, FILE *pFile)
+{
+    fsm_trace_file_t header;
+
+    if (pFile == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    signed int ret = fsm_trace_init(pRing, pRecords, capacity);
+    if (ret != FSM_OK) {
+        return ret;
+    }
+
+    if (fread(&header, sizeof(header), 1u, pFile) != 1u) {
+        return EOR_INVALID_DATA;
+    }
+    if ((header.magic != FSM_TRACE_MAGIC) || (header.recordSize != sizeof(fsm_trace_record_t))) {
+        return EOR_INVALID_DATA;
+    }
+
+    for (uint32_t i = 0u; i < header.count; i++) {
+        unsigned int head = atomic_load_explicit(&pRing->head, memory_order_relaxed);
+
+        if (fread(&pRecords[head & pRing->mask], sizeof(fsm_trace_record_t), 1u, pFile) != 1u) {
+            return EOR_INVALID_DATA;
+        }
+        if ((head & pRing->mask) == pRing->mask) {
+            atomic_store_explicit(&pRing->isFull, true, memory_order_relaxed);
+        }
+        atomic_store_explicit(&pRing->head, head + 1u, memory_order_relaxed);
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Print the held records as text, one line per dispatch.
+ *
+ * @param pRing  The ring to print.
+ * @param pFile  The output stream.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_trace_dump_text(const fsm_trace_ring_t *pRing, FILE *pFile)
+{
+    if ((pRing == NULL) || (pFile == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    unsigned int head = atomic_load_explicit(&pRing->head, memory_order_acquire);
+    for (unsigned int sequence = fsm_trace_first(pRing, head); sequence != head; sequence++) {
+        const fsm_trace_record_t *pRecord = fsm_trace_at(pRing, sequence);
+
+        fprintf(pFile,
+                "%llu %s %p signal %u: %u -> %u, %u ticks, result %d\n",
+                (unsigned long long)pRecord->timestamp,
+                (pRecord->kind == FSM_TRACE_KIND_HSM) ? "hsm" : "psm",
+                pRecord->pMachine,
+                (unsigned int)pRecord->signal,
+                (unsigned int)pRecord->from,
+                (unsigned int)pRecord->to,
+                (unsigned int)pRecord->duration,
+                (int)pRecord->result);
+    }
+
+    return FSM_OK;
+}
+
+/**
+ * @brief Print the held records as Chrome trace event JSON.
+ *
+ * Each dispatch becomes a complete event on a track per machine, viewable in
+ * chrome://tracing or Perfetto.
+ *
+ * @param pRing       The ring to print.
+ * @param pFile       The output stream.
+ * @param ticksPerUs  Timestamp ticks per microsecond, 0 to print raw ticks.
+ *
+ * @return FSM_OK on success, error code otherwise.
+ */
+signed int fsm_trace_dump_chrome(const fsm_trace_ring_t *pRing, FILE *pFile, double ticksPerUs)
+{
+    if ((pRing == NULL) || (pFile == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    double scale = (ticksPerUs > 0.0) ? (1.0 / ticksPerUs) : 1.0;
+    unsigned int head = atomic_load_explicit(&pRing->head, memory_order_acquire);
+    unsigned int first = fsm_trace_first(pRing, head);
+    uint64_t origin = (first != head) ? fsm_trace_at(pRing, first)->timestamp : 0u;
+
+    fprintf(pFile, "{\"traceEvents\":[");
+    for (unsigned int sequence = first; sequence != head; sequence++) {
+        const fsm_trace_record_t *pRecord = fsm_trace_at(pRing, sequence);
+
+        fprintf(pFile,
+                "%s\n{\"name\":\"signal %u\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":\"%p\","
+                "\"args\":{\"from\":%u,\"to\":%u,\"result\":%d}}",
+                (sequence != first) ? "," : "",
+                (unsigned int)pRecord->signal,
+                (pRecord->kind == FSM_TRACE_KIND_HSM) ? "hsm" : "psm",
+                (double)(pRecord->timestamp - origin) * scale,
+                (double)pRecord->duration * scale,
+                pRecord->pMachine,
+                (unsigned int)pRecord->from,
+                (unsigned int)pRecord->to,
+                (int)pRecord->result);
+    }
+    fprintf(pFile, "\n]}\n");
+
+    return FSM_OK;
+}
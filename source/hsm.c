@@ -5,36 +5,193 @@
  * LICENSE file in the root directory of this source tree.
  **/
 #include "hsm.h"
+#include "fsm_queue.h"
+#include "fsm_trace.h"
+#include "fsm_profile.h"
+#include "fsm_metrics.h"
+#include "fsm_timer.h"
+#include "fsm_pool.h"
+#include "fsm_arena.h"
+
+_Static_assert(offsetof(hsm_rule_t, signal) == offsetof(fsm_index_key_t, signal), "hsm_rule_t must start with an fsm_index_key_t");
 
 /*============================================================================
  * Private Helper Functions
  *============================================================================*/
 
+/* Maximum slots probed per transition cache lookup */
+#define HSM_CACHE_PROBE_MAX (4u)
+
+/* Read prefetch hint for batched dispatch */
+#if defined(__GNUC__) || defined(__clang__)
+#define HSM_PREFETCH(p) __builtin_prefetch((p), 0, 3)
+#else
+#define HSM_PREFETCH(p) ((void)(p))
+#endif
+
+/* Force the dispatch core into each specialized variant */
+#if defined(__GNUC__) || defined(__clang__)
+#define HSM_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define HSM_ALWAYS_INLINE inline
+#endif
+
+/*
+ * Definition and runtime fields of a manager. The session handle passed to
+ * handlers by hsm_dispatchMachine() only points at the shared definition and
+ * the runtime, other managers hold them inline. isSession is a compile-time
+ * constant in the dispatch loops, so only one side is compiled into each.
+ */
+#define HSM_STATES(pManager, isSession)       ((isSession) ? (pManager)->pMachine->pStates : (pManager)->pStates)
+#define HSM_STATE_COUNT(pManager, isSession)  ((isSession) ? (pManager)->pMachine->stateCount : (pManager)->stateCount)
+#define HSM_TRANSDUCER(pManager, isSession)   ((isSession) ? (pManager)->pMachine->pTransducer : (pManager)->pTransducer)
+#define HSM_CURRENT(pManager, isSession)      (*((isSession) ? &(pManager)->pRuntime->currentState : &(pManager)->currentState))
+#define HSM_PROCESSING(pManager, isSession)   (*((isSession) ? &(pManager)->pRuntime->processingState : &(pManager)->processingState))
+
+/* Compiled tables live in the definition, a session always has one */
+#define HSM_MACHINE(pManager, isSession)      (((isSession) || ((pManager)->pMachine != NULL)) ? (pManager)->pMachine : NULL)
+#define HSM_TABLE(pManager, isSession, field) ((HSM_MACHINE(pManager, isSession) != NULL) ? (pManager)->pMachine->field : NULL)
+
+/* Per-instance attachments, a session never has any */
+#define HSM_EXTENSION(pManager, isSession)    ((isSession) ? (hsm_extension_t *)NULL : (pManager)->pExtension)
+
+/**
+ * @brief Check if the manager is the session handle of hsm_dispatchMachine().
+ */
+static inline bool hsm_isSession(const hsm_state_manager_t *pManager)
+{
+    return (pManager->pRuntime != NULL);
+}
+
 /**
  * @brief Get state pointer by instance index.
  */
-static inline hsm_state_t *hsm_getState(const hsm_state_manager_t *pManager, hsm_instance_t instance)
+static inline hsm_state_t *hsm_getState(const hsm_state_manager_t *pManager, hsm_instance_t instance, const bool isSession)
+{
+    return (hsm_state_t *)&HSM_STATES(pManager, isSession)[instance];
+}
+
+/**
+ * @brief Get the instance of a state.
+ *
+ * With a compact table attached the instance is the row index, which costs no
+ * load from the state row.
+ */
+static inline hsm_instance_t hsm_getInstance(const hsm_state_manager_t *pManager, const hsm_state_t *pState, const bool isSession)
+{
+    if (HSM_TABLE(pManager, isSession, pCompact) != NULL) {
+        return (hsm_instance_t)(pState - HSM_STATES(pManager, isSession));
+    }
+    return pState->instance;
+}
+
+/**
+ * @brief Get the parent of a state, NULL for a top-level state.
+ */
+static inline hsm_state_t *hsm_getParent(const hsm_state_manager_t *pManager, const hsm_state_t *pState, const bool isSession)
 {
-    return (hsm_state_t *)&pManager->pStates[instance];
+    const hsm_compact_table_t *pCompact = HSM_TABLE(pManager, isSession, pCompact);
+
+    if (pCompact != NULL) {
+        hsm_instance_t parent = pCompact->pParents[pState - HSM_STATES(pManager, isSession)];
+        return (parent != HSM_STATE_INSTANCE_INVALID) ? hsm_getState(pManager, parent, isSession) : NULL;
+    }
+    return pState->pParent;
 }
 
 /**
  * @brief Check if HSM is at root (not yet entered any state).
  */
-static inline bool hsm_isAtRoot(const hsm_state_manager_t *pManager)
+static inline bool hsm_isAtRoot(const hsm_state_manager_t *pManager, const bool isSession)
+{
+    return (HSM_CURRENT(pManager, isSession) == HSM_STATE_INSTANCE_ROOT);
+}
+
+/**
+ * @brief Get the current state's row, NULL while the HSM is at root.
+ */
+static inline hsm_state_t *hsm_getActiveState(const hsm_state_manager_t *pManager, const bool isSession)
 {
-    return (pManager->currentState == HSM_STATE_INSTANCE_ROOT);
+    return hsm_isAtRoot(pManager, isSession) ? NULL : hsm_getState(pManager, HSM_CURRENT(pManager, isSession), isSession);
+}
+
+/**
+ * @brief Call a state's handler, the manager-aware one when it's set.
+ */
+static inline signed int hsm_callHandler(hsm_state_manager_t *pManager,
+                                         hsm_state_t *pState,
+                                         hsm_state_input_t input,
+                                         const bool isSession)
+{
+    const hsm_compact_table_t *pCompact = HSM_TABLE(pManager, isSession, pCompact);
+
+    if (pCompact != NULL) {
+        const hsm_state_handlers_t *pRow = &pCompact->pHandlers[pState - HSM_STATES(pManager, isSession)];
+
+        return (pRow->pHandlerEx != NULL) ? pRow->pHandlerEx(pManager, input) : pRow->pHandler(input);
+    }
+    if (pState->pHandlerEx != NULL) {
+        return pState->pHandlerEx(pManager, input);
+    }
+    return pState->pHandler(input);
 }
 
 /**
  * @brief Invoke state handler with given signal.
+ *
+ * Handlers whose signal mask doesn't subscribe to the signal are skipped
+ * without the indirect call. With profiling compiled in, the call is timed
+ * into the manager's profile when one is attached.
  */
 static inline signed int hsm_invokeHandler(hsm_state_manager_t *pManager,
                                            hsm_state_t *pState,
-                                           hsm_state_input_t input)
+                                           hsm_state_input_t input,
+                                           const bool isSession)
 {
-    pManager->processingState = pState->instance;
-    return pState->pHandler(input);
+    hsm_instance_t instance = hsm_getInstance(pManager, pState, isSession);
+    const hsm_signal_mask_t *pSignalMasks = HSM_TABLE(pManager, isSession, pSignalMasks);
+
+    HSM_PROCESSING(pManager, isSession) = instance;
+
+    if ((pSignalMasks != NULL) && (input.signal < HSM_SIGNAL_MASK_BITS) &&
+        ((pSignalMasks[instance] & HSM_SIGNAL_MASK(input.signal)) == 0u)) {
+        return HSM_OK;
+    }
+#if FSM_PROFILE_ENABLE
+    hsm_extension_t *pExtension = HSM_EXTENSION(pManager, isSession);
+
+    if ((pExtension != NULL) && (pExtension->pProfile != NULL)) {
+        uint64_t start = FSM_PROFILE_TIMESTAMP();
+        signed int ret = hsm_callHandler(pManager, pState, input, isSession);
+        fsm_profile_record(pExtension->pProfile, instance, input.signal, start);
+        return ret;
+    }
+#endif
+    return hsm_callHandler(pManager, pState, input, isSession);
+}
+
+/**
+ * @brief Find the LCA from the compiled root-to-state paths.
+ *
+ * Both paths share the same prefix down to the LCA, so a single forward scan
+ * over two contiguous rows replaces the nested pParent walks.
+ */
+static hsm_state_t *hsm_findCompiledLCA(const hsm_state_manager_t *pManager,
+                                        const hsm_state_t *pFromState,
+                                        const hsm_state_t *pToState,
+                                        const bool isSession)
+{
+    const hsm_state_path_t *pPaths = pManager->pMachine->pPaths;
+    const hsm_state_path_t *pFromPath = &pPaths[hsm_getInstance(pManager, pFromState, isSession)];
+    const hsm_state_path_t *pToPath = &pPaths[hsm_getInstance(pManager, pToState, isSession)];
+    unsigned short depth = (pFromPath->depth < pToPath->depth) ? pFromPath->depth : pToPath->depth;
+    unsigned short level = 0u;
+
+    while ((level <= depth) && (pFromPath->path[level] == pToPath->path[level])) {
+        level++;
+    }
+
+    return (level == 0u) ? NULL : hsm_getState(pManager, pFromPath->path[level - 1u], isSession);
 }
 
 /**
@@ -47,15 +204,22 @@ static inline signed int hsm_invokeHandler(hsm_state_manager_t *pManager,
  * - If fromState is ancestor of toState (parent->child transition): returns fromState
  * - If toState is ancestor of fromState (child->parent transition): returns toState
  */
-static hsm_state_t *hsm_findLCA(hsm_state_t *pFromState, hsm_state_t *pToState)
+static hsm_state_t *hsm_findLCA(const hsm_state_manager_t *pManager,
+                                hsm_state_t *pFromState,
+                                hsm_state_t *pToState,
+                                const bool isSession)
 {
+    if ((HSM_TABLE(pManager, isSession, pPaths) != NULL) && (pFromState != NULL) && (pToState != NULL)) {
+        return hsm_findCompiledLCA(pManager, pFromState, pToState, isSession);
+    }
+
     /* Check if fromState is an ancestor of toState (e.g., INIT -> PREPARE where PREPARE's parent is INIT) */
     hsm_state_t *pIter = pToState;
     while (pIter != NULL) {
         if (pIter == pFromState) {
             return pFromState;  /* fromState is the LCA */
         }
-        pIter = pIter->pParent;
+        pIter = hsm_getParent(pManager, pIter, isSession);
     }
 
     /* Check if toState is an ancestor of fromState (e.g., PREPARE -> INIT where PREPARE's parent is INIT) */
@@ -64,7 +228,7 @@ static hsm_state_t *hsm_findLCA(hsm_state_t *pFromState, hsm_state_t *pToState)
         if (pIter == pToState) {
             return pToState;  /* toState is the LCA */
         }
-        pIter = pIter->pParent;
+        pIter = hsm_getParent(pManager, pIter, isSession);
     }
 
     /* Neither is ancestor of the other - find common ancestor by comparing hierarchies */
@@ -76,9 +240,9 @@ static hsm_state_t *hsm_findLCA(hsm_state_t *pFromState, hsm_state_t *pToState)
             if (pFromIter == pToIter) {
                 return pFromIter;  /* Found common ancestor */
             }
-            pToIter = pToIter->pParent;
+            pToIter = hsm_getParent(pManager, pToIter, isSession);
         }
-        pFromIter = pFromIter->pParent;
+        pFromIter = hsm_getParent(pManager, pFromIter, isSession);
     }
 
     return NULL;  /* No common ancestor (both are top-level states) */
@@ -87,16 +251,42 @@ static hsm_state_t *hsm_findLCA(hsm_state_t *pFromState, hsm_state_t *pToState)
 /**
  * @brief Walk up the hierarchy to find topmost ancestor below target.
  *
- * This ensures we enter states from top-to-bottom in the hierarchy.
+ * This ensures we enter states from top-to-bottom in the hierarchy. With
+ * compiled paths the answer is the next slot of pState's root-to-state path,
+ * so walking a whole hierarchy costs O(depth) instead of O(depth^2).
  */
-static hsm_state_t *hsm_findTopmostBelow(hsm_state_t *pState, hsm_state_t *pTarget)
+static hsm_state_t *hsm_findTopmostBelow(const hsm_state_manager_t *pManager,
+                                         hsm_state_t *pState,
+                                         hsm_state_t *pTarget,
+                                         const bool isSession)
 {
-    while (pState->pParent != pTarget) {
-        pState = pState->pParent;
+    const hsm_state_path_t *pPaths = HSM_TABLE(pManager, isSession, pPaths);
+
+    if (pPaths != NULL) {
+        unsigned short level = (pTarget != NULL) ? (unsigned short)(pPaths[hsm_getInstance(pManager, pTarget, isSession)].depth + 1u) : 0u;
+        return hsm_getState(pManager, pPaths[hsm_getInstance(pManager, pState, isSession)].path[level], isSession);
+    }
+
+    for (hsm_state_t *pParent = hsm_getParent(pManager, pState, isSession); pParent != pTarget;
+         pParent = hsm_getParent(pManager, pState, isSession)) {
+        pState = pParent;
     }
     return pState;
 }
 
+/**
+ * @brief Cancel the timeouts armed by a state, it is being exited.
+ */
+static inline void hsm_cancelStateTimers(hsm_extension_t *pExtension, hsm_instance_t instance)
+{
+    for (unsigned short i = 0u; i < pExtension->timerCount; i++) {
+        if (pExtension->pTimers[i].owner == instance) {
+            fsm_timer_cancel(pExtension->pWheel, &pExtension->pTimers[i]);
+            pExtension->pTimers[i].owner = FSM_TIMER_OWNER_NONE;
+        }
+    }
+}
+
 /**
  * @brief Exit states from current up to (but not including) the LCA.
  */
@@ -104,291 +294,317 @@ static signed int hsm_exitToLCA(hsm_state_manager_t *pManager,
                                 hsm_state_t *pFromState,
                                 hsm_state_t *pLCA,
                                 hsm_state_t *pToState,
-                                hsm_state_input_t input)
+                                hsm_state_input_t input,
+                                const bool isSession)
 {
+    hsm_extension_t *pExtension = HSM_EXTENSION(pManager, isSession);
+
     input.signal = HSM_SIGNAL_EXIT;
 
     while ((pFromState != pLCA) && (pFromState != pToState)) {
-        if (hsm_invokeHandler(pManager, pFromState, input)) {
+        if (hsm_invokeHandler(pManager, pFromState, input, isSession)) {
             return EOR_FAULT_ERROR;
         }
-        pFromState = pFromState->pParent;
+        if ((pExtension != NULL) && (pExtension->pWheel != NULL)) {
+            hsm_cancelStateTimers(pExtension, hsm_getInstance(pManager, pFromState, isSession));
+        }
+        pFromState = hsm_getParent(pManager, pFromState, isSession);
     }
 
     return HSM_OK;
 }
 
 /**
- * @brief Notify transducer of state transition.
- */
-static signed int hsm_notifyTransition(hsm_state_manager_t *pManager,
-                                       hsm_state_t *pFromState,
-                                       hsm_state_input_t input)
-{
-    if (pManager->pTransducer == NULL) {
-        return HSM_OK;
-    }
-
-    hsm_instance_t fromInst = (pFromState != NULL) ? pFromState->instance : HSM_STATE_INSTANCE_ROOT;
-
-    return pManager->pTransducer(pManager->pStates, fromInst, pManager->currentState, input);
-}
-
-/*============================================================================
- * Public API Implementation
- *============================================================================*/
-
-/**
- * @brief Initialize a new HSM manager.
+ * @brief Fill a transition cache slot with the exit and entry sequence.
  *
- * @param pManager        The HSM manager context to initialize.
- * @param pStateList      Array of state definitions.
- * @param stateCount      Number of states in the array.
- * @param initialState    The initial state instance to start in.
- * @param passThrough     True: pass through mode, false: current node mode.
- * @param pTransducer     Optional callback for state transitions (can be NULL).
+ * Only managers with an extension have a cache, never a session handle.
  *
- * @return HSM_OK on success, error code otherwise.
+ * @return true if the sequence fits in the slot, false otherwise.
  */
-signed int hsm_init(hsm_state_manager_t *pManager,
-                    const hsm_state_t *pStateList,
-                    unsigned short stateCount,
-                    hsm_instance_t initialState,
-                    bool passThrough,
-                    hsm_transducer_t pTransducer)
+static bool hsm_fillTransitionPath(const hsm_state_manager_t *pManager,
+                                   hsm_transition_path_t *pPath,
+                                   hsm_state_t *pFromState,
+                                   hsm_state_t *pToState)
 {
-    if (pManager == NULL || pStateList == NULL) {
-        return EOR_INVALID_ARGUMENT;
+    hsm_state_t *pLCA = hsm_findLCA(pManager, pFromState, pToState, false);
+    hsm_instance_t chain[HSM_DEPTH_MAX];
+    unsigned short exitCount = 0u;
+    unsigned short entryCount = 0u;
+
+    /* Same walk as hsm_exitToLCA() */
+    for (hsm_state_t *pIter = pFromState; (pIter != pLCA) && (pIter != pToState); pIter = hsm_getParent(pManager, pIter, false)) {
+        if (exitCount >= HSM_DEPTH_MAX) {
+            return false;
+        }
+        pPath->exitList[exitCount++] = hsm_getInstance(pManager, pIter, false);
     }
 
-    pManager->pStates = pStateList;
-    pManager->stateCount = stateCount;
-    pManager->currentState = HSM_STATE_INSTANCE_ROOT;
-    pManager->processingState = initialState;
-    pManager->passThroughMode = passThrough;
-    pManager->pTransducer = pTransducer;
+    /* Entry order is the reverse of the walk up from the target */
+    for (hsm_state_t *pIter = pToState; pIter != pLCA; pIter = hsm_getParent(pManager, pIter, false)) {
+        if (entryCount >= HSM_DEPTH_MAX) {
+            return false;
+        }
+        chain[entryCount++] = hsm_getInstance(pManager, pIter, false);
+    }
+    for (unsigned short i = 0u; i < entryCount; i++) {
+        pPath->entryList[i] = chain[entryCount - 1u - i];
+    }
 
-    return HSM_OK;
+    pPath->from = hsm_getInstance(pManager, pFromState, false);
+    pPath->to = hsm_getInstance(pManager, pToState, false);
+    pPath->lca = (pLCA != NULL) ? hsm_getInstance(pManager, pLCA, false) : HSM_STATE_INSTANCE_ROOT;
+    pPath->exitCount = exitCount;
+    pPath->entryCount = entryCount;
+    return true;
 }
 
 /**
- * @brief Check if a state instance is valid.
+ * @brief Look up (or lazily fill) the cached path of a transition.
  *
- * @param pManager  The HSM manager context.
- * @param instance  The state instance to validate.
+ * Slots are open-addressed by (from, to) with a short linear probe. When the
+ * probe window is full the transition simply runs uncached.
  *
- * @return HSM_OK if valid, error code otherwise.
+ * @return The cached path, or NULL if caching is disabled or no slot is free.
  */
-signed int hsm_state_isValid(hsm_state_manager_t *pManager, hsm_instance_t instance)
+static inline const hsm_transition_path_t *hsm_findTransitionPath(hsm_state_manager_t *pManager,
+                                                                  hsm_state_t *pFromState,
+                                                                  hsm_state_t *pToState,
+                                                                  const bool isSession)
 {
-    if (pManager == NULL) {
-        return EOR_INVALID_ARGUMENT;
-    }
-    return (instance < pManager->stateCount) ? HSM_OK : EOR_INVALID_DATA;
-}
+    hsm_extension_t *pExtension = HSM_EXTENSION(pManager, isSession);
 
-/**
- * @brief Get the name of a state.
- *
- * @param pManager  The HSM manager context.
- * @param instance  The state instance.
- *
- * @return State name string, or NULL if invalid.
- */
-const char *hsm_state_getName(hsm_state_manager_t *pManager, hsm_instance_t instance)
-{
-    if (pManager == NULL || hsm_state_isValid(pManager, instance) != HSM_OK) {
+    if ((pExtension == NULL) || (pExtension->pCache == NULL) || (pFromState == NULL)) {
         return NULL;
     }
-    return pManager->pStates[instance].pName;
-}
 
-/**
- * @brief Get the user-defined ID of a state.
- *
- * @param pManager  The HSM manager context.
- * @param instance  The state instance.
- *
- * @return State ID, or error code if invalid.
- */
-signed int hsm_state_getId(hsm_state_manager_t *pManager, hsm_instance_t instance)
-{
-    if (pManager == NULL || hsm_state_isValid(pManager, instance) != HSM_OK) {
-        return EOR_INVALID_ARGUMENT;
-    }
-    return (signed int)pManager->pStates[instance].id;
-}
+    hsm_instance_t from = hsm_getInstance(pManager, pFromState, false);
+    hsm_instance_t to = hsm_getInstance(pManager, pToState, false);
+    unsigned int hash = ((unsigned int)from * 0x9E37u) ^ (unsigned int)to;
 
-/**
- * @brief Get the state currently being processed.
- *
- * @param pManager  The HSM manager context.
- *
- * @return Processing state instance, or HSM_STATE_INSTANCE_INVALID if error.
- */
-hsm_instance_t hsm_getProcessingState(hsm_state_manager_t *pManager)
-{
-    if (pManager == NULL) {
-        return HSM_STATE_INSTANCE_INVALID;
-    }
-    return pManager->processingState;
-}
+    for (unsigned short probe = 0u; (probe < HSM_CACHE_PROBE_MAX) && (probe < pExtension->cacheSize); probe++) {
+        hsm_transition_path_t *pPath = &pExtension->pCache[(hash + probe) % pExtension->cacheSize];
 
-/**
- * @brief Get the name of the current state.
- *
- * @param pManager  The HSM manager context.
- *
- * @return Current state name, or NULL if error.
- */
-const char *hsm_getCurrentStateName(hsm_state_manager_t *pManager)
-{
-    if (pManager == NULL) {
-        return NULL;
+        if ((pPath->from == from) && (pPath->to == to)) {
+            return pPath;
+        }
+        if (pPath->from == HSM_STATE_INSTANCE_INVALID) {
+            return hsm_fillTransitionPath(pManager, pPath, pFromState, pToState) ? pPath : NULL;
+        }
     }
-    return pManager->pStates[pManager->processingState].pName;
+
+    return NULL;
 }
 
 /**
- * @brief Get the name of the target state.
- *
- * @param pManager  The HSM manager context.
- *
- * @return Target state name, or NULL if error.
+ * @brief Exit the states listed in a cached transition path.
  */
-const char *hsm_getTargetStateName(hsm_state_manager_t *pManager)
+static signed int hsm_exitCachedPath(hsm_state_manager_t *pManager, const hsm_transition_path_t *pPath, hsm_state_input_t input)
 {
-    if (pManager == NULL) {
-        return NULL;
+    hsm_extension_t *pExtension = pManager->pExtension;
+
+    input.signal = HSM_SIGNAL_EXIT;
+
+    for (unsigned short i = 0u; i < pPath->exitCount; i++) {
+        if (hsm_invokeHandler(pManager, hsm_getState(pManager, pPath->exitList[i], false), input, false)) {
+            return EOR_FAULT_ERROR;
+        }
+        if (pExtension->pWheel != NULL) {
+            hsm_cancelStateTimers(pExtension, pPath->exitList[i]);
+        }
     }
-    return pManager->pStates[pManager->currentState].pName;
+
+    return HSM_OK;
 }
 
 /**
- * @brief Get the target active state.
+ * @brief Resolve a user signal against the transition table.
  *
- * @param pManager  The HSM manager context.
+ * States are consulted in the order the handlers would see the signal: root to
+ * leaf in pass-through mode, the active state only in current node mode. The
+ * first row whose guard passes wins, and is counted in the manager's hit
+ * counters when it has some.
  *
- * @return target state instance, or HSM_STATE_INSTANCE_INVALID if error.
+ * @return The matched rule, or NULL to fall back to the state handlers.
  */
-hsm_instance_t hsm_getTargetState(hsm_state_manager_t *pManager)
+static const hsm_rule_t *hsm_resolveRule(hsm_state_manager_t *pManager,
+                                         hsm_state_t *pActiveState,
+                                         hsm_state_input_t input,
+                                         const bool passThrough,
+                                         const bool isSession)
 {
-    if (pManager == NULL) {
-        return HSM_STATE_INSTANCE_INVALID;
-    }
-    return pManager->currentState;
+    const hsm_rule_table_t *pTable = &pManager->pMachine->ruleTable;
+    hsm_extension_t *pExtension = HSM_EXTENSION(pManager, isSession);
+    hsm_state_t *pState = NULL;
+
+    do {
+        pState = passThrough ? hsm_findTopmostBelow(pManager, pActiveState, pState, isSession) : pActiveState;
+        hsm_instance_t instance = hsm_getInstance(pManager, pState, isSession);
+
+        for (unsigned short row = fsm_index_find(&pTable->index, pTable->pRules, sizeof(hsm_rule_t), instance, input.signal);
+             (row < pTable->ruleCount) && (pTable->pRules[row].state == instance) && (pTable->pRules[row].signal == input.signal);
+             row++) {
+            const hsm_rule_t *pRule = &pTable->pRules[row];
+
+            HSM_PROCESSING(pManager, isSession) = instance;
+            if ((pRule->pGuard == NULL) || pRule->pGuard(input)) {
+                if ((pExtension != NULL) && (pExtension->pHits != NULL)) {
+                    pExtension->pHits[row]++;
+                }
+                return pRule;
+            }
+        }
+    } while (pState != pActiveState);
+
+    return NULL;
 }
 
 /**
- * @brief Request a state transition.
- *
- * This should be called from within a state handler to request transition
- * to a new state. The actual transition is processed by hsm_dispatch().
- *
- * @param pManager   The HSM manager context.
- * @param nextState  The target state instance.
+ * @brief Notify transducer of state transition.
  *
- * @return HSM_OK on success, error code otherwise.
+ * Every event deferred so far becomes due for recall once the current
+ * dispatch completes.
  */
-signed int hsm_transition(hsm_state_manager_t *pManager, hsm_instance_t nextState)
+static HSM_ALWAYS_INLINE signed int hsm_notifyTransition(hsm_state_manager_t *pManager,
+                                                         hsm_state_t *pFromState,
+                                                         hsm_state_input_t input,
+                                                         const bool hasTransducer,
+                                                         const bool isSession)
 {
-    if (pManager == NULL) {
-        return EOR_INVALID_ARGUMENT;
-    }
+    hsm_extension_t *pExtension = HSM_EXTENSION(pManager, isSession);
 
-    if (nextState >= pManager->stateCount) {
-        return EOR_INVALID_ARGUMENT;
+    if ((pExtension != NULL) && (pExtension->pDeferred != NULL)) {
+        pExtension->recallCount = fsm_spsc_count(pExtension->pDeferred);
+    }
+    if (!hasTransducer) {
+        return HSM_OK;
     }
 
-    pManager->currentState = nextState;
-    return HSM_OK;
+    hsm_instance_t fromInst = (pFromState != NULL) ? hsm_getInstance(pManager, pFromState, isSession) : HSM_STATE_INSTANCE_ROOT;
+
+    return HSM_TRANSDUCER(pManager, isSession)(HSM_STATES(pManager, isSession), fromInst, HSM_CURRENT(pManager, isSession), input);
 }
 
 /**
- * @brief Dispatch an event to the state machine.
+ * @brief Dispatch one event without tracing, the manager has already been validated.
  *
  * This is the main processing function that:
  * 1. On first call: enters from root through hierarchy to initial state
  * 2. Dispatches the input signal to current state handler
  * 3. If handler requested transition: exits old states, enters new states
  *
- * @param pManager  The HSM manager context.
- * @param input     The event to dispatch (signal + optional user context).
- *
- * @return HSM_OK on success, error code otherwise.
+ * The mode, transducer presence and manager kind are compile-time constants
+ * in each of the HSM_DISPATCH_VARIANT() instances, so their tests fold out of
+ * the loop. A session variant reads the definition and the runtime through
+ * the handle's pointers and has no attachments to test. pActiveState is the
+ * current state's row from hsm_getActiveState(), which batched callers
+ * resolve once per run of events without a transition.
  */
-signed int hsm_dispatch(hsm_state_manager_t *pManager, hsm_state_input_t input)
+static HSM_ALWAYS_INLINE signed int hsm_dispatchCore(hsm_state_manager_t *pManager,
+                                                     hsm_state_t *pActiveState,
+                                                     hsm_state_input_t input,
+                                                     const bool passThrough,
+                                                     const bool hasTransducer,
+                                                     const bool isSession)
 {
-    if (pManager == NULL) {
-        return EOR_INVALID_ARGUMENT;
-    }
-
     hsm_state_t *pCurrentState = NULL;
     hsm_state_t *pWorkingState = NULL;
     hsm_state_t *pEntryTarget = NULL;
-    hsm_state_t *pActiveState = NULL;
+    const hsm_transition_path_t *pEntryPath = NULL;
+    unsigned short entryIndex = 0u;
     hsm_state_input_t savedInput = {0};
     bool isInitialEntry = false;
+    bool isConsumed = false;
 
     /* Determine starting point */
-    if (hsm_isAtRoot(pManager)) {
+    if (pActiveState == NULL) {
         /* First dispatch: start from initial state, will enter from root */
-        pWorkingState = hsm_getState(pManager, pManager->processingState);
+        pWorkingState = hsm_getState(pManager, HSM_PROCESSING(pManager, isSession), isSession);
         isInitialEntry = true;
     } else {
         /* Normal operation: process from current state */
-        pCurrentState = hsm_getState(pManager, pManager->currentState);
+        pCurrentState = pActiveState;
         pWorkingState = pCurrentState;
-        pActiveState = pCurrentState;
     }
     savedInput = input;
 
+    /* Transition table: a matching rule consumes the user signal before any handler sees it */
+    if ((HSM_MACHINE(pManager, isSession) != NULL) && (pManager->pMachine->ruleTable.pRules != NULL) && (pActiveState != NULL) &&
+        (input.signal >= HSM_SIGNAL_USER_DEFINE)) {
+        const hsm_rule_t *pRule = hsm_resolveRule(pManager, pActiveState, input, passThrough, isSession);
+
+        if (pRule != NULL) {
+            if (pRule->pAction != NULL) {
+                pRule->pAction(input);
+            }
+            if (pRule->target != HSM_STATE_INSTANCE_INVALID) {
+                HSM_CURRENT(pManager, isSession) = pRule->target;
+            }
+            if (HSM_CURRENT(pManager, isSession) == hsm_getInstance(pManager, pActiveState, isSession)) {
+                return HSM_ACTION_DONE;
+            }
+            isConsumed = true;
+        }
+    }
+
     /* Main state processing loop */
-    while ((pCurrentState != pEntryTarget) || hsm_isAtRoot(pManager)) {
+    while ((pCurrentState != pEntryTarget) || hsm_isAtRoot(pManager, isSession)) {
         /* Walk up to find topmost ancestor below entry target */
-        pWorkingState = hsm_findTopmostBelow(pWorkingState, pEntryTarget);
+        if (pEntryPath != NULL) {
+            pWorkingState = hsm_getState(pManager, pEntryPath->entryList[entryIndex++], isSession);
+        } else {
+            pWorkingState = hsm_findTopmostBelow(pManager, pWorkingState, pEntryTarget, isSession);
+        }
 
-        if (!hsm_isAtRoot(pManager)) {
+        if (isConsumed) {
+            /* Signal already handled by the transition table, go straight to the transition */
+        } else if (!hsm_isAtRoot(pManager, isSession)) {
             /* System signals (ENTRY, INIT, EXIT) or pass-through mode: dispatch to all states in hierarchy */
-            if ((input.signal < HSM_SIGNAL_USER_DEFINE) || pManager->passThroughMode) {
+            if (passThrough || (input.signal < HSM_SIGNAL_USER_DEFINE)) {
                 /* Call state handler (for system signals or pass-through mode) */
-                if (hsm_invokeHandler(pManager, pWorkingState, input)) {
+                if (hsm_invokeHandler(pManager, pWorkingState, input, isSession)) {
                     return EOR_FAULT_ERROR;
                 }
             } else {
                 /* Current node mode with user-defined signal: dispatch only to active state */
                 if (pActiveState != NULL && pActiveState == pWorkingState) {
-                    if (hsm_invokeHandler(pManager, pWorkingState, input)) {
+                    if (hsm_invokeHandler(pManager, pWorkingState, input, isSession)) {
                         return EOR_FAULT_ERROR;
                     }
                 }
             }
         } else {
             /* First iteration: commit initial state */
-            pManager->currentState = pManager->processingState;
+            HSM_CURRENT(pManager, isSession) = HSM_PROCESSING(pManager, isSession);
         }
 
         /* After reaching target state with ENTRY signal, send INIT */
         if ((pWorkingState == pCurrentState) && (input.signal == HSM_SIGNAL_ENTRY)) {
             input.signal = HSM_SIGNAL_INIT;
-            if (hsm_invokeHandler(pManager, pWorkingState, input)) {
+            if (hsm_invokeHandler(pManager, pWorkingState, input, isSession)) {
                 return EOR_FAULT_ERROR;
             }
 
             /* On initial entry, also dispatch the original user signal */
             if (isInitialEntry && (savedInput.signal != HSM_SIGNAL_INIT)) { 
-                if (hsm_invokeHandler(pManager, pWorkingState, savedInput)) {
+                if (hsm_invokeHandler(pManager, pWorkingState, savedInput, isSession)) {
                     return EOR_FAULT_ERROR;
                 }
             }
         }
 
         /* Check if state handler requested a transition */
-        hsm_state_t *pNewState = hsm_getState(pManager, pManager->currentState);
+        hsm_state_t *pNewState = hsm_getState(pManager, HSM_CURRENT(pManager, isSession), isSession);
 
         if (pCurrentState != pNewState) {
             /* Transition requested: find LCA and perform exit/entry sequence */
-            hsm_state_t *pLCA = hsm_findLCA(pCurrentState, pNewState);
+            const hsm_transition_path_t *pPath = hsm_findTransitionPath(pManager, pCurrentState, pNewState, isSession);
+            hsm_state_t *pLCA = NULL;
+
+            if (pPath != NULL) {
+                pLCA = (pPath->lca != HSM_STATE_INSTANCE_ROOT) ? hsm_getState(pManager, pPath->lca, isSession) : NULL;
+            } else {
+                pLCA = hsm_findLCA(pManager, pCurrentState, pNewState, isSession);
+            }
 
             /* Save input for next transition */
             if (input.signal != HSM_SIGNAL_INIT) {
@@ -396,12 +612,16 @@ signed int hsm_dispatch(hsm_state_manager_t *pManager, hsm_state_input_t input)
             }
 
             /* Notify transducer of transition */
-            if (hsm_notifyTransition(pManager, pCurrentState, savedInput) != HSM_OK) {
+            if (hsm_notifyTransition(pManager, pCurrentState, savedInput, hasTransducer, isSession) != HSM_OK) {
                 return EOR_FAULT_ERROR;
             }
 
             /* Exit states from current up to LCA */
-            if (hsm_exitToLCA(pManager, pCurrentState, pLCA, pNewState, input) != HSM_OK) {
+            if (pPath != NULL) {
+                if (hsm_exitCachedPath(pManager, pPath, input) != HSM_OK) {
+                    return EOR_FAULT_ERROR;
+                }
+            } else if (hsm_exitToLCA(pManager, pCurrentState, pLCA, pNewState, input, isSession) != HSM_OK) {
                 return EOR_FAULT_ERROR;
             }
 
@@ -409,6 +629,9 @@ signed int hsm_dispatch(hsm_state_manager_t *pManager, hsm_state_input_t input)
             input.signal = HSM_SIGNAL_ENTRY;
             pCurrentState = pNewState;
             pEntryTarget = pLCA;
+            pEntryPath = pPath;
+            entryIndex = 0u;
+            isConsumed = false;
         } else {
             /* No transition: we're done with this state */
             pEntryTarget = pWorkingState;
@@ -419,3 +642,1279 @@ signed int hsm_dispatch(hsm_state_manager_t *pManager, hsm_state_input_t input)
 
     return HSM_ACTION_DONE;
 }
+
+/* One dispatch loop per mode, transducer presence and manager kind */
+#define HSM_DISPATCH_VARIANT(name, passThrough, hasTransducer, isSession)                                                                  \
+    static signed int name(hsm_state_manager_t *pManager, hsm_state_t *pActiveState, hsm_state_input_t input)                              \
+    {                                                                                                                                      \
+        return hsm_dispatchCore(pManager, pActiveState, input, (passThrough), (hasTransducer), (isSession));                               \
+    }
+
+HSM_DISPATCH_VARIANT(hsm_runPassThrough, true, true, false)
+HSM_DISPATCH_VARIANT(hsm_runPassThroughBare, true, false, false)
+HSM_DISPATCH_VARIANT(hsm_runCurrentNode, false, true, false)
+HSM_DISPATCH_VARIANT(hsm_runCurrentNodeBare, false, false, false)
+HSM_DISPATCH_VARIANT(hsm_runSessionPassThrough, true, true, true)
+HSM_DISPATCH_VARIANT(hsm_runSessionPassThroughBare, true, false, true)
+HSM_DISPATCH_VARIANT(hsm_runSessionCurrentNode, false, true, true)
+HSM_DISPATCH_VARIANT(hsm_runSessionCurrentNodeBare, false, false, true)
+
+/* Manager dispatch loops, indexed by [passThroughMode][pTransducer != NULL] */
+static const hsm_dispatch_run_t s_hsmRuns[2][2] = {
+    {hsm_runCurrentNodeBare, hsm_runCurrentNode},
+    {hsm_runPassThroughBare, hsm_runPassThrough},
+};
+
+/* Session dispatch loops of hsm_dispatchMachine(), indexed the same way */
+static const hsm_dispatch_run_t s_hsmSessionRuns[2][2] = {
+    {hsm_runSessionCurrentNodeBare, hsm_runSessionCurrentNode},
+    {hsm_runSessionPassThroughBare, hsm_runSessionPassThrough},
+};
+
+/**
+ * @brief Publish the manager's current state and queue depth into its metrics slot.
+ */
+static inline void hsm_publishMetrics(hsm_state_manager_t *pManager, unsigned int dispatches, unsigned int transitions)
+{
+    hsm_extension_t *pExtension = pManager->pExtension;
+    unsigned int depth = 0u;
+
+    if (pExtension->pQueue != NULL) {
+        depth += fsm_spsc_count(pExtension->pQueue);
+    }
+    if (pExtension->pInbox != NULL) {
+        depth += fsm_mpsc_count(pExtension->pInbox);
+    }
+    fsm_metrics_publish(pExtension->pMetrics, pManager->currentState, dispatches, transitions, depth);
+}
+
+static signed int hsm_recallDeferred(hsm_state_manager_t *pManager);
+
+/**
+ * @brief Dispatch one event from an already resolved current state row.
+ *
+ * Records the event when tracing or metrics are compiled in. Events deferred
+ * before a transition the event caused are dispatched again right after it,
+ * ahead of anything still queued.
+ */
+static inline signed int hsm_dispatchFrom(hsm_state_manager_t *pManager, hsm_state_t *pActiveState, hsm_state_input_t input)
+{
+#if FSM_TRACE_ENABLE || FSM_METRICS_ENABLE
+    hsm_instance_t from = pManager->currentState;
+#endif
+#if FSM_TRACE_ENABLE
+    uint64_t start = fsm_trace_begin();
+#endif
+    signed int ret = s_hsmRuns[pManager->passThroughMode][pManager->pTransducer != NULL](pManager, pActiveState, input);
+    hsm_extension_t *pExtension = pManager->pExtension;
+
+#if FSM_TRACE_ENABLE
+    fsm_trace_write(pManager, FSM_TRACE_KIND_HSM, start, from, pManager->currentState, input.signal, ret);
+#endif
+    if (pExtension == NULL) {
+        return ret;
+    }
+#if FSM_METRICS_ENABLE
+    if (pExtension->pMetrics != NULL) {
+        hsm_publishMetrics(pManager, 1u, (pManager->currentState != from) ? 1u : 0u);
+    }
+#endif
+    if ((pExtension->recallCount != 0u) && !pExtension->isRecalling && (ret == HSM_OK)) {
+        ret = hsm_recallDeferred(pManager);
+    }
+    return ret;
+}
+
+/**
+ * @brief Dispatch one event, see hsm_dispatchFrom().
+ */
+static inline signed int hsm_dispatchInput(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    return hsm_dispatchFrom(pManager, hsm_getActiveState(pManager, false), input);
+}
+
+/**
+ * @brief Dispatch the deferred events due for recall, oldest first.
+ *
+ * Only the events deferred before the transition are recalled; one deferred
+ * again by the state it reaches waits for the next transition, so a state
+ * that keeps deferring never loops.
+ */
+static signed int hsm_recallDeferred(hsm_state_manager_t *pManager)
+{
+    hsm_extension_t *pExtension = pManager->pExtension;
+    signed int ret = HSM_OK;
+
+    pExtension->isRecalling = true;
+    while ((pExtension->recallCount != 0u) && (ret == HSM_OK)) {
+        hsm_state_input_t input;
+
+        pExtension->recallCount--;
+        if (!fsm_spsc_pop(pExtension->pDeferred, &input)) {
+            break;
+        }
+        ret = hsm_dispatchInput(pManager, input);
+        if (pExtension->pPool != NULL && input.pUserContext != NULL) {
+            fsm_pool_release(pExtension->pPool, input.pUserContext);
+        }
+    }
+    pExtension->recallCount = 0u;
+    pExtension->isRecalling = false;
+
+    return ret;
+}
+
+/**
+ * @brief Dispatch an event taken from a queue, then drop the queue's reference on a pooled payload.
+ */
+static inline signed int hsm_dispatchQueued(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    signed int ret = hsm_dispatchInput(pManager, input);
+
+    if (pManager->pExtension != NULL && pManager->pExtension->pPool != NULL && input.pUserContext != NULL) {
+        fsm_pool_release(pManager->pExtension->pPool, input.pUserContext);
+    }
+    return ret;
+}
+
+/**
+ * @brief Prefetch the state row the manager will dispatch to next.
+ */
+static inline void hsm_prefetchManager(const hsm_state_manager_t *pManager)
+{
+    const hsm_compact_table_t *pCompact = HSM_TABLE(pManager, false, pCompact);
+
+    if (pManager->currentState >= pManager->stateCount) {
+        return;
+    }
+    if (pCompact != NULL) {
+        HSM_PREFETCH(&pCompact->pHandlers[pManager->currentState]);
+    } else {
+        HSM_PREFETCH(&pManager->pStates[pManager->currentState]);
+    }
+}
+
+/*============================================================================
+ * Public API Implementation
+ *============================================================================*/
+
+/**
+ * @brief Initialize a new HSM manager.
+ *
+ * The manager has no compiled tables and no attachments; use
+ * hsm_initMachine() for a manager over a compiled definition and
+ * hsm_setExtension() before attaching queues, timers and the like.
+ *
+ * @param pManager        The HSM manager context to initialize.
+ * @param pStateList      Array of state definitions.
+ * @param stateCount      Number of states in the array.
+ * @param initialState    The initial state instance to start in.
+ * @param passThrough     True: pass through mode, false: current node mode.
+ * @param pTransducer     Optional callback for state transitions (can be NULL).
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_init(hsm_state_manager_t *pManager,
+                    const hsm_state_t *pStateList,
+                    unsigned short stateCount,
+                    hsm_instance_t initialState,
+                    bool passThrough,
+                    hsm_transducer_t pTransducer)
+{
+    if (pManager == NULL || pStateList == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pManager->pStates = pStateList;
+    pManager->stateCount = stateCount;
+    pManager->currentState = HSM_STATE_INSTANCE_ROOT;
+    pManager->processingState = initialState;
+    pManager->passThroughMode = passThrough;
+    pManager->pTransducer = pTransducer;
+    pManager->pMachine = NULL;
+    pManager->pRuntime = NULL;
+    pManager->pExtension = NULL;
+
+    return HSM_OK;
+}
+
+/**
+ * @brief Initialize a shared machine definition.
+ *
+ * The definition holds everything managers and sessions of one machine have
+ * in common: the state table, mode, transducer and, once the compile calls
+ * have run, the compiled tables. It has no pointer into itself, so it may be
+ * copied, and is only read by dispatch, so any number of threads can share it.
+ *
+ * @param pMachine      The machine definition to initialize.
+ * @param pStateList    Array of state definitions.
+ * @param stateCount    Number of states in the array.
+ * @param initialState  The initial state instance to start in.
+ * @param passThrough   True: pass through mode, false: current node mode.
+ * @param pTransducer   Optional callback for state transitions (can be NULL).
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_defineMachine(hsm_machine_t *pMachine,
+                             const hsm_state_t *pStateList,
+                             unsigned short stateCount,
+                             hsm_instance_t initialState,
+                             bool passThrough,
+                             hsm_transducer_t pTransducer)
+{
+    if (pMachine == NULL || pStateList == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    memset(pMachine, 0, sizeof(*pMachine));
+    pMachine->pStates = pStateList;
+    pMachine->stateCount = stateCount;
+    pMachine->initialState = initialState;
+    pMachine->passThroughMode = passThrough;
+    pMachine->pTransducer = pTransducer;
+    pMachine->pRun = s_hsmSessionRuns[passThrough][pTransducer != NULL];
+
+    return HSM_OK;
+}
+
+/**
+ * @brief Compile the state table hierarchy into root-to-state paths.
+ *
+ * Walks every state's pParent chain once and stores the result in pPaths, so
+ * transitions resolve the LCA by index arithmetic instead of pointer chasing.
+ * The same pPaths buffer can be shared by every definition of this state table.
+ *
+ * @param pMachine  The machine definition, initialized by hsm_defineMachine().
+ * @param pPaths    Storage for stateCount compiled paths.
+ *
+ * @return HSM_OK on success, EOR_INVALID_DATA if the table is malformed or
+ *         deeper than HSM_DEPTH_MAX, error code otherwise.
+ */
+signed int hsm_compile(hsm_machine_t *pMachine, hsm_state_path_t *pPaths)
+{
+    if (pMachine == NULL || pPaths == NULL || pMachine->pStates == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    const hsm_state_t *pFirst = &pMachine->pStates[0];
+    const hsm_state_t *pLast = &pMachine->pStates[pMachine->stateCount];
+
+    for (unsigned short i = 0u; i < pMachine->stateCount; i++) {
+        const hsm_state_t *pState = &pMachine->pStates[i];
+        hsm_state_path_t *pPath = &pPaths[i];
+        hsm_instance_t chain[HSM_DEPTH_MAX];
+        unsigned short levels = 0u;
+
+        if (pState->instance != i) {
+            return EOR_INVALID_DATA;
+        }
+
+        /* Collect leaf-to-root, bounded so a cyclic table can't spin forever */
+        while (pState != NULL) {
+            if ((pState < pFirst) || (pState >= pLast) || (levels >= HSM_DEPTH_MAX)) {
+                return EOR_INVALID_DATA;
+            }
+            chain[levels++] = (hsm_instance_t)(pState - pFirst);
+            pState = pState->pParent;
+        }
+
+        pPath->depth = (unsigned short)(levels - 1u);
+        for (unsigned short level = 0u; level < levels; level++) {
+            pPath->path[level] = chain[levels - 1u - level];
+        }
+    }
+
+    pMachine->pPaths = pPaths;
+    return HSM_OK;
+}
+
+/**
+ * @brief Compile the state table into a compact, index-based layout.
+ *
+ * Dispatch only needs each state's parent and handlers, yet every hsm_state_t
+ * row also carries its instance, id and name. The compact table keeps the
+ * parents as 16-bit instances and the handlers in a dense array, so a deep or
+ * large table costs a fraction of the cache lines to walk. The hsm_state_t rows
+ * are left as cold metadata, read only for names, ids and the transducer.
+ *
+ * @param pMachine   The machine definition, initialized by hsm_defineMachine().
+ * @param pTable     The compact table to build, can be attached to other definitions
+ *                   of the same state table with hsm_setCompactTable().
+ * @param pParents   Storage for stateCount parent instances.
+ * @param pHandlers  Storage for stateCount handler rows.
+ *
+ * @return HSM_OK on success, EOR_INVALID_DATA if the table is malformed, error code otherwise.
+ */
+signed int hsm_compileTable(hsm_machine_t *pMachine,
+                            hsm_compact_table_t *pTable,
+                            hsm_instance_t *pParents,
+                            hsm_state_handlers_t *pHandlers)
+{
+    if (pMachine == NULL || pTable == NULL || pParents == NULL || pHandlers == NULL || pMachine->pStates == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    const hsm_state_t *pFirst = &pMachine->pStates[0];
+    const hsm_state_t *pLast = &pMachine->pStates[pMachine->stateCount];
+
+    for (unsigned short i = 0u; i < pMachine->stateCount; i++) {
+        const hsm_state_t *pState = &pMachine->pStates[i];
+
+        if ((pState->instance != i) || ((pState->pHandler == NULL) && (pState->pHandlerEx == NULL)) ||
+            ((pState->pParent != NULL) && ((pState->pParent < pFirst) || (pState->pParent >= pLast)))) {
+            return EOR_INVALID_DATA;
+        }
+
+        pParents[i] = (pState->pParent != NULL) ? (hsm_instance_t)(pState->pParent - pFirst) : HSM_STATE_INSTANCE_INVALID;
+        pHandlers[i].pHandler = pState->pHandler;
+        pHandlers[i].pHandlerEx = pState->pHandlerEx;
+    }
+
+    pTable->pParents = pParents;
+    pTable->pHandlers = pHandlers;
+    pTable->stateCount = pMachine->stateCount;
+
+    pMachine->pCompact = pTable;
+    return HSM_OK;
+}
+
+/**
+ * @brief Attach a compact table built by hsm_compileTable() for the same state table.
+ *
+ * @param pMachine  The machine definition.
+ * @param pTable    The compact table, or NULL to dispatch from the hsm_state_t rows.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setCompactTable(hsm_machine_t *pMachine, const hsm_compact_table_t *pTable)
+{
+    if (pMachine == NULL || (pTable != NULL && pTable->stateCount != pMachine->stateCount)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pMachine->pCompact = pTable;
+    return HSM_OK;
+}
+
+/**
+ * @brief Register the signals each state's handler reacts to.
+ *
+ * A state whose mask bit is clear for a signal is skipped by the dispatcher,
+ * including ENTRY, INIT and EXIT, so a mask must name every signal the handler
+ * acts on. Signals at or above HSM_SIGNAL_MASK_BITS are always delivered.
+ *
+ * @param pMachine      The machine definition.
+ * @param pSignalMasks  One mask per state, indexed by instance, or NULL to
+ *                      deliver every signal to every handler.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setSignalMasks(hsm_machine_t *pMachine, const hsm_signal_mask_t *pSignalMasks)
+{
+    if (pMachine == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pMachine->pSignalMasks = pSignalMasks;
+    return HSM_OK;
+}
+
+/**
+ * @brief Compile a declarative transition table into the machine definition.
+ *
+ * When a user signal arrives, the table is consulted before any handler. A
+ * matching rule whose guard passes runs its action and transitions to its
+ * target with the usual EXIT/ENTRY/INIT sequence, and no handler receives the
+ * user signal itself. Signals without a matching rule go to the handlers as
+ * before. A rule targeting the active state runs its action only. Rule hits
+ * are counted per manager, see hsm_setRuleHits().
+ *
+ * @param pMachine   The machine definition, initialized by hsm_defineMachine().
+ * @param pRules     Rule rows, rows sharing (state, signal) must be adjacent.
+ * @param ruleCount  Number of rule rows.
+ * @param pSlots     Lookup slot storage (see fsm_index_build()).
+ * @param slotCount  Number of slots in pSlots.
+ *
+ * @return HSM_OK on success, EOR_INVALID_DATA if a rule is malformed, error code otherwise.
+ */
+signed int hsm_compileRules(hsm_machine_t *pMachine,
+                            const hsm_rule_t *pRules,
+                            unsigned short ruleCount,
+                            unsigned short *pSlots,
+                            unsigned int slotCount)
+{
+    if (pMachine == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    for (unsigned short i = 0u; (pRules != NULL) && (i < ruleCount); i++) {
+        if ((pRules[i].signal < HSM_SIGNAL_USER_DEFINE) ||
+            ((pRules[i].target != HSM_STATE_INSTANCE_INVALID) && (pRules[i].target >= pMachine->stateCount))) {
+            return EOR_INVALID_DATA;
+        }
+    }
+
+    hsm_rule_table_t *pTable = &pMachine->ruleTable;
+    signed int ret = fsm_index_build(&pTable->index, pSlots, slotCount, pRules, ruleCount, sizeof(hsm_rule_t), pMachine->stateCount);
+    if (ret != HSM_OK) {
+        return ret;
+    }
+
+    pTable->pRules = pRules;
+    pTable->ruleCount = ruleCount;
+    return HSM_OK;
+}
+
+/**
+ * @brief Initialize a manager over a shared machine definition.
+ *
+ * The manager dispatches with the definition's compiled tables and keeps its
+ * own state, like one set up by hsm_init(). The definition must outlive it
+ * and not change while it is in use.
+ *
+ * @param pManager  The HSM manager context to initialize.
+ * @param pMachine  The machine definition.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_initMachine(hsm_state_manager_t *pManager, const hsm_machine_t *pMachine)
+{
+    if (pMachine == NULL ||
+        hsm_init(pManager, pMachine->pStates, pMachine->stateCount, pMachine->initialState, pMachine->passThroughMode,
+                 pMachine->pTransducer) != HSM_OK) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pManager->pMachine = pMachine;
+    return HSM_OK;
+}
+
+/**
+ * @brief Give the manager storage for its per-instance attachments.
+ *
+ * The queues, inbox, profile, metrics, timers, pool, deferred ring,
+ * transition cache and rule hit counters of a manager live in its extension,
+ * so managers without any stay small. The extension is cleared; the calls
+ * attaching those features fail with EOR_INVALID_ARGUMENT until it is set.
+ * Attach it before the first dispatch.
+ *
+ * @param pManager    The HSM manager context.
+ * @param pExtension  The extension, owned by this manager only, or NULL to detach.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setExtension(hsm_state_manager_t *pManager, hsm_extension_t *pExtension)
+{
+    if (pManager == NULL || hsm_isSession(pManager)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if (pExtension != NULL) {
+        memset(pExtension, 0, sizeof(*pExtension));
+    }
+    pManager->pExtension = pExtension;
+    return HSM_OK;
+}
+
+/**
+ * @brief Attach a transition path cache to the manager.
+ *
+ * Each distinct (from, to) transition stores its exit and entry sequence in
+ * one slot the first time it runs; later runs replay the stored sequence
+ * without recomputing the LCA or walking the hierarchy.
+ *
+ * @param pManager   The HSM manager context, with an extension.
+ * @param pCache     Cache slots, or NULL to disable caching.
+ * @param cacheSize  Number of slots in pCache.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setTransitionCache(hsm_state_manager_t *pManager, hsm_transition_path_t *pCache, unsigned short cacheSize)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || (pCache != NULL && cacheSize == 0u)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    for (unsigned short i = 0u; (pCache != NULL) && (i < cacheSize); i++) {
+        pCache[i].from = HSM_STATE_INSTANCE_INVALID;
+    }
+
+    pManager->pExtension->pCache = pCache;
+    pManager->pExtension->cacheSize = (pCache != NULL) ? cacheSize : 0u;
+    return HSM_OK;
+}
+
+/**
+ * @brief Count the rule hits of this manager.
+ *
+ * Every rule of the definition's transition table taken by this manager
+ * increments its counter. The counters belong to the manager, so the
+ * definition stays read-only.
+ *
+ * @param pManager  The HSM manager context, with an extension and a definition.
+ * @param pHits     One counter per rule row, zeroed here, or NULL to stop counting.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setRuleHits(hsm_state_manager_t *pManager, unsigned int *pHits)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || (pHits != NULL && pManager->pMachine == NULL)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    for (unsigned short i = 0u; (pHits != NULL) && (i < pManager->pMachine->ruleTable.ruleCount); i++) {
+        pHits[i] = 0u;
+    }
+
+    pManager->pExtension->pHits = pHits;
+    return HSM_OK;
+}
+
+/**
+ * @brief Check if a state instance is valid.
+ *
+ * @param pManager  The HSM manager context.
+ * @param instance  The state instance to validate.
+ *
+ * @return HSM_OK if valid, error code otherwise.
+ */
+signed int hsm_state_isValid(hsm_state_manager_t *pManager, hsm_instance_t instance)
+{
+    if (pManager == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+    return (instance < HSM_STATE_COUNT(pManager, hsm_isSession(pManager))) ? HSM_OK : EOR_INVALID_DATA;
+}
+
+/**
+ * @brief Get the name of a state.
+ *
+ * @param pManager  The HSM manager context.
+ * @param instance  The state instance.
+ *
+ * @return State name string, or NULL if invalid.
+ */
+const char *hsm_state_getName(hsm_state_manager_t *pManager, hsm_instance_t instance)
+{
+    if (pManager == NULL || hsm_state_isValid(pManager, instance) != HSM_OK) {
+        return NULL;
+    }
+    return HSM_STATES(pManager, hsm_isSession(pManager))[instance].pName;
+}
+
+/**
+ * @brief Get the user-defined ID of a state.
+ *
+ * @param pManager  The HSM manager context.
+ * @param instance  The state instance.
+ *
+ * @return State ID, or error code if invalid.
+ */
+signed int hsm_state_getId(hsm_state_manager_t *pManager, hsm_instance_t instance)
+{
+    if (pManager == NULL || hsm_state_isValid(pManager, instance) != HSM_OK) {
+        return EOR_INVALID_ARGUMENT;
+    }
+    return (signed int)HSM_STATES(pManager, hsm_isSession(pManager))[instance].id;
+}
+
+/**
+ * @brief Get the state currently being processed.
+ *
+ * @param pManager  The HSM manager context.
+ *
+ * @return Processing state instance, or HSM_STATE_INSTANCE_INVALID if error.
+ */
+hsm_instance_t hsm_getProcessingState(hsm_state_manager_t *pManager)
+{
+    if (pManager == NULL) {
+        return HSM_STATE_INSTANCE_INVALID;
+    }
+    return HSM_PROCESSING(pManager, hsm_isSession(pManager));
+}
+
+/**
+ * @brief Get the name of the current state.
+ *
+ * @param pManager  The HSM manager context.
+ *
+ * @return Current state name, or NULL if error.
+ */
+const char *hsm_getCurrentStateName(hsm_state_manager_t *pManager)
+{
+    if (pManager == NULL) {
+        return NULL;
+    }
+    return HSM_STATES(pManager, hsm_isSession(pManager))[HSM_PROCESSING(pManager, hsm_isSession(pManager))].pName;
+}
+
+/**
+ * @brief Get the name of the target state.
+ *
+ * @param pManager  The HSM manager context.
+ *
+ * @return Target state name, or NULL if error.
+ */
+const char *hsm_getTargetStateName(hsm_state_manager_t *pManager)
+{
+    if (pManager == NULL) {
+        return NULL;
+    }
+    return HSM_STATES(pManager, hsm_isSession(pManager))[HSM_CURRENT(pManager, hsm_isSession(pManager))].pName;
+}
+
+/**
+ * @brief Get the target active state.
+ *
+ * @param pManager  The HSM manager context.
+ *
+ * @return target state instance, or HSM_STATE_INSTANCE_INVALID if error.
+ */
+hsm_instance_t hsm_getTargetState(hsm_state_manager_t *pManager)
+{
+    if (pManager == NULL) {
+        return HSM_STATE_INSTANCE_INVALID;
+    }
+    return HSM_CURRENT(pManager, hsm_isSession(pManager));
+}
+
+/**
+ * @brief Request a state transition.
+ *
+ * This should be called from within a state handler to request transition
+ * to a new state. The actual transition is processed by hsm_dispatch().
+ *
+ * @param pManager   The HSM manager context.
+ * @param nextState  The target state instance.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_transition(hsm_state_manager_t *pManager, hsm_instance_t nextState)
+{
+    if (pManager == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if (nextState >= HSM_STATE_COUNT(pManager, hsm_isSession(pManager))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    HSM_CURRENT(pManager, hsm_isSession(pManager)) = nextState;
+    return HSM_OK;
+}
+
+/**
+ * @brief Dispatch an event to the state machine.
+ *
+ * @param pManager  The HSM manager context.
+ * @param input     The event to dispatch (signal + optional user context).
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_dispatch(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    if (pManager == NULL || hsm_isSession(pManager)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    return hsm_dispatchInput(pManager, input);
+}
+
+/**
+ * @brief Dispatch an array of events to one state machine.
+ *
+ * Equivalent to calling hsm_dispatch() for each event in order. The argument
+ * checks are done once for the whole array, and the root check and current
+ * state row lookup once per run of events that leave the state unchanged.
+ *
+ * @param pManager  The HSM manager context.
+ * @param pInputs   The events to dispatch.
+ * @param count     Number of events.
+ *
+ * @return Number of events dispatched, or error code if a dispatch failed
+ *         (the events before it were dispatched).
+ */
+signed int hsm_dispatchMany(hsm_state_manager_t *pManager, const hsm_state_input_t *pInputs, unsigned int count)
+{
+    if (pManager == NULL || hsm_isSession(pManager) || (pInputs == NULL && count != 0u)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    hsm_instance_t active = pManager->currentState;
+    hsm_state_t *pActiveState = hsm_getActiveState(pManager, false);
+
+    for (unsigned int i = 0u; i < count; i++) {
+        if (pManager->currentState != active) {
+            active = pManager->currentState;
+            pActiveState = hsm_getActiveState(pManager, false);
+        }
+        if (hsm_dispatchFrom(pManager, pActiveState, pInputs[i]) != HSM_OK) {
+            return EOR_FAULT_ERROR;
+        }
+    }
+
+    return (signed int)count;
+}
+
+/**
+ * @brief Dispatch an array of (manager, event) pairs.
+ *
+ * Pairs run in order. While one runs, the manager two pairs ahead and the
+ * state row of the next one are prefetched, so a batch spread over many
+ * managers doesn't wait on a cache miss per event.
+ *
+ * @param pPairs  The pairs to dispatch, every manager must be non-NULL.
+ * @param count   Number of pairs.
+ *
+ * @return Number of pairs dispatched, or error code if a dispatch failed
+ *         (the pairs before it were dispatched).
+ */
+signed int hsm_dispatchBatch(const hsm_dispatch_pair_t *pPairs, unsigned int count)
+{
+    if (pPairs == NULL && count != 0u) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    for (unsigned int i = 0u; i < count; i++) {
+        if (pPairs[i].pManager == NULL || hsm_isSession(pPairs[i].pManager)) {
+            return EOR_INVALID_ARGUMENT;
+        }
+    }
+
+    if (count > 1u) {
+        HSM_PREFETCH(pPairs[1].pManager);
+    }
+    for (unsigned int i = 0u; i < count; i++) {
+        if (i + 2u < count) {
+            HSM_PREFETCH(pPairs[i + 2u].pManager);
+        }
+        if (i + 1u < count) {
+            hsm_prefetchManager(pPairs[i + 1u].pManager);
+        }
+        if (hsm_dispatchInput(pPairs[i].pManager, pPairs[i].input) != HSM_OK) {
+            return EOR_FAULT_ERROR;
+        }
+    }
+
+    return (signed int)count;
+}
+
+/**
+ * @brief Attach an event queue to the manager.
+ *
+ * Producers hand events over with hsm_post() from one thread, while the thread
+ * owning the manager runs them with hsm_drain().
+ *
+ * @param pManager  The HSM manager context.
+ * @param pQueue    A ring of hsm_state_input_t elements, or NULL to detach.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setQueue(hsm_state_manager_t *pManager, fsm_spsc_t *pQueue)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || (pQueue != NULL && pQueue->elemSize != sizeof(hsm_state_input_t))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pManager->pExtension->pQueue = pQueue;
+    return HSM_OK;
+}
+
+/**
+ * @brief Queue an event for the next hsm_drain(), producer side only.
+ *
+ * @param pManager  The HSM manager context.
+ * @param input     The event to queue.
+ *
+ * @return HSM_OK on success, EOR_FAULT_ERROR if the queue is full, error code otherwise.
+ */
+signed int hsm_post(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || pManager->pExtension->pQueue == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    return fsm_spsc_push(pManager->pExtension->pQueue, &input) ? HSM_OK : EOR_FAULT_ERROR;
+}
+
+/**
+ * @brief Dispatch a batch of queued events, consumer side only.
+ *
+ * Events are dispatched in place, run to completion one after another, and
+ * their slots are handed back to the producer once for the whole batch.
+ *
+ * @param pManager   The HSM manager context.
+ * @param maxEvents  Maximum number of events to dispatch.
+ *
+ * @return Number of events dispatched, or error code if a dispatch failed
+ *         (the failing event is consumed).
+ */
+signed int hsm_drain(hsm_state_manager_t *pManager, unsigned int maxEvents)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || pManager->pExtension->pQueue == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    fsm_spsc_t *pQueue = pManager->pExtension->pQueue;
+    unsigned int count = fsm_spsc_readable(pQueue);
+    count = (count < maxEvents) ? count : maxEvents;
+
+    for (unsigned int i = 0u; i < count; i++) {
+        hsm_state_input_t input = *(const hsm_state_input_t *)fsm_spsc_at(pQueue, i);
+
+        if (hsm_dispatchQueued(pManager, input) != HSM_OK) {
+            fsm_spsc_consume(pQueue, i + 1u);
+            return EOR_FAULT_ERROR;
+        }
+    }
+
+    fsm_spsc_consume(pQueue, count);
+    return (signed int)count;
+}
+
+/**
+ * @brief Attach a multi-producer inbox to the manager.
+ *
+ * Unlike the queue set by hsm_setQueue(), any number of threads may post to
+ * the inbox concurrently without locks.
+ *
+ * @param pManager  The HSM manager context.
+ * @param pInbox    A ring of hsm_state_input_t elements, or NULL to detach.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setInbox(hsm_state_manager_t *pManager, fsm_mpsc_t *pInbox)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || (pInbox != NULL && pInbox->elemSize != sizeof(hsm_state_input_t))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pManager->pExtension->pInbox = pInbox;
+    return HSM_OK;
+}
+
+/**
+ * @brief Post an event to the manager's inbox, from any thread.
+ *
+ * @param pManager  The HSM manager context.
+ * @param input     The event to post.
+ *
+ * @return HSM_OK on success, EOR_FAULT_ERROR if the inbox is full, error code otherwise.
+ */
+signed int hsm_postInbox(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || pManager->pExtension->pInbox == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    return fsm_mpsc_push(pManager->pExtension->pInbox, &input) ? HSM_OK : EOR_FAULT_ERROR;
+}
+
+/**
+ * @brief Dispatch a batch of events from the inbox.
+ *
+ * Any thread may call it; if another thread is already draining, the call
+ * returns 0 immediately, so events are always dispatched one at a time and
+ * run to completion.
+ *
+ * @param pManager   The HSM manager context.
+ * @param maxEvents  Maximum number of events to dispatch.
+ *
+ * @return Number of events dispatched, or error code if a dispatch failed
+ *         (the failing event is consumed).
+ */
+signed int hsm_drainInbox(hsm_state_manager_t *pManager, unsigned int maxEvents)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || pManager->pExtension->pInbox == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    fsm_mpsc_t *pInbox = pManager->pExtension->pInbox;
+    if (!fsm_mpsc_acquire(pInbox)) {
+        return 0;
+    }
+
+    signed int ret = HSM_OK;
+    unsigned int count = fsm_mpsc_readable(pInbox, maxEvents);
+    unsigned int done = 0u;
+
+    while (done < count) {
+        hsm_state_input_t input = *(const hsm_state_input_t *)fsm_mpsc_at(pInbox, done);
+
+        done++;
+        if (hsm_dispatchQueued(pManager, input) != HSM_OK) {
+            ret = EOR_FAULT_ERROR;
+            break;
+        }
+    }
+
+    fsm_mpsc_consume(pInbox, done);
+    fsm_mpsc_release(pInbox);
+    return (ret != HSM_OK) ? ret : (signed int)done;
+}
+
+/**
+ * @brief Dispatch one event through an untyped manager pointer.
+ *
+ * Matches fsm_dispatch_t, so an executor can run HSM managers whose inbox
+ * holds hsm_state_input_t elements. The event is treated as queued: a pooled
+ * payload is released once dispatched.
+ *
+ * @param pManager  The HSM manager context.
+ * @param pInput    The event, a hsm_state_input_t.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_dispatchEvent(void *pManager, const void *pInput)
+{
+    if (pManager == NULL || pInput == NULL || hsm_isSession((const hsm_state_manager_t *)pManager)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    return hsm_dispatchQueued((hsm_state_manager_t *)pManager, *(const hsm_state_input_t *)pInput);
+}
+
+/**
+ * @brief Attach a handler latency profile to the manager.
+ *
+ * Every handler call is then counted and timed into the profile cell of its
+ * state and signal; calls skipped by the signal masks are not. The hooks only
+ * exist when FSM_PROFILE_ENABLE is set, otherwise the profile stays empty.
+ *
+ * @param pManager  The HSM manager context.
+ * @param pProfile  The profile, initialized by fsm_profile_init(), or NULL to detach.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setProfile(hsm_state_manager_t *pManager, fsm_profile_t *pProfile)
+{
+    if (pManager == NULL || pManager->pExtension == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pManager->pExtension->pProfile = pProfile;
+    return HSM_OK;
+}
+
+/**
+ * @brief Publish the manager into a shared-memory metrics slot.
+ *
+ * After every dispatch the slot gets the current state, the dispatch and
+ * state change counts and the queue and inbox depth, for a monitor to poll.
+ * The hooks only exist when FSM_METRICS_ENABLE is set; attaching publishes
+ * the current state once either way.
+ *
+ * @param pManager  The HSM manager context.
+ * @param pSlot     A slot from fsm_metrics_claim(), or NULL to detach.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setMetrics(hsm_state_manager_t *pManager, fsm_metrics_slot_t *pSlot)
+{
+    if (pManager == NULL || pManager->pExtension == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pManager->pExtension->pMetrics = pSlot;
+    if (pSlot != NULL) {
+        hsm_publishMetrics(pManager, 0u, 0u);
+    }
+    return HSM_OK;
+}
+
+/**
+ * @brief Give the manager timers for state timeouts.
+ *
+ * A state handler arms a timeout on ENTRY with hsm_armTimeout(); it is
+ * cancelled automatically when the state is exited, so a timeout is only
+ * ever delivered to the state that armed it.
+ *
+ * @param pManager    The HSM manager context.
+ * @param pWheel      The wheel driving the timers, or NULL to detach.
+ * @param pTimers     Timer storage, one per state that may hold a timeout at the same time.
+ * @param timerCount  Number of timers in pTimers.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setTimers(hsm_state_manager_t *pManager, fsm_timer_wheel_t *pWheel, fsm_timer_t *pTimers, unsigned short timerCount)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || (pWheel != NULL && (pTimers == NULL || timerCount == 0u))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    hsm_extension_t *pExtension = pManager->pExtension;
+
+    for (unsigned short i = 0u; i < pExtension->timerCount; i++) {
+        fsm_timer_cancel(pExtension->pWheel, &pExtension->pTimers[i]);
+    }
+
+    pExtension->pWheel = pWheel;
+    pExtension->pTimers = (pWheel != NULL) ? pTimers : NULL;
+    pExtension->timerCount = (pWheel != NULL) ? timerCount : 0u;
+    for (unsigned short i = 0u; i < pExtension->timerCount; i++) {
+        fsm_timer_init(&pTimers[i], pManager);
+    }
+
+    return HSM_OK;
+}
+
+/**
+ * @brief Arm a timeout for the state whose handler is running, typically on ENTRY.
+ *
+ * Arming again from the same state restarts its timeout.
+ *
+ * @param pManager  The HSM manager context.
+ * @param ticks     The delay, in wheel ticks.
+ * @param input     The event delivered when the timeout expires.
+ *
+ * @return HSM_OK on success, EOR_FAULT_ERROR if every timer is held by another state, error code otherwise.
+ */
+signed int hsm_armTimeout(hsm_state_manager_t *pManager, uint64_t ticks, hsm_state_input_t input)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || pManager->pExtension->pWheel == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    hsm_extension_t *pExtension = pManager->pExtension;
+    fsm_timer_t *pTimer = NULL;
+    for (unsigned short i = 0u; i < pExtension->timerCount; i++) {
+        if (fsm_timer_isExpired(&pExtension->pTimers[i])) {
+            /* Still linked in the batch being delivered, a timeout armed now supersedes it */
+            if (pExtension->pTimers[i].owner == pManager->processingState) {
+                pExtension->pTimers[i].owner = FSM_TIMER_OWNER_NONE;
+            }
+            continue;
+        }
+        if (pExtension->pTimers[i].owner == pManager->processingState) {
+            pTimer = &pExtension->pTimers[i];
+            break;
+        }
+        if (pTimer == NULL && pExtension->pTimers[i].owner == FSM_TIMER_OWNER_NONE) {
+            pTimer = &pExtension->pTimers[i];
+        }
+    }
+    if (pTimer == NULL) {
+        return EOR_FAULT_ERROR;
+    }
+
+    pTimer->owner = pManager->processingState;
+    pTimer->signal = input.signal;
+    pTimer->pContext = input.pUserContext;
+    return fsm_timer_arm(pExtension->pWheel, pTimer, ticks);
+}
+
+/**
+ * @brief Cancel the timeout of the state whose handler is running.
+ *
+ * @param pManager  The HSM manager context.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_cancelTimeout(hsm_state_manager_t *pManager)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || pManager->pExtension->pWheel == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    hsm_cancelStateTimers(pManager->pExtension, pManager->processingState);
+    return HSM_OK;
+}
+
+/**
+ * @brief Dispatch a batch of expired timeouts returned by fsm_timer_advance().
+ *
+ * Every timer must belong to an HSM manager. A timeout whose state was exited
+ * by an earlier dispatch of the same batch is dropped. The timers left in the
+ * batch are skipped by hsm_armTimeout() until they are walked, so handlers may
+ * arm timeouts freely while it runs.
+ *
+ * @param pExpired  The expired list.
+ *
+ * @return Number of timeouts dispatched, or EOR_FAULT_ERROR if a dispatch failed.
+ */
+signed int hsm_dispatchTimeouts(fsm_timer_t *pExpired)
+{
+    signed int ret = HSM_OK;
+    signed int count = 0;
+
+    while (pExpired != NULL) {
+        fsm_timer_t *pNext = pExpired->pNext;
+
+        pExpired->expired = 0u;
+        if (pExpired->owner != FSM_TIMER_OWNER_NONE) {
+            hsm_state_input_t input = {.signal = pExpired->signal, .pUserContext = pExpired->pContext};
+
+            pExpired->owner = FSM_TIMER_OWNER_NONE;
+            if (hsm_dispatchInput((hsm_state_manager_t *)pExpired->pMachine, input) != HSM_OK) {
+                ret = EOR_FAULT_ERROR;
+            }
+            count++;
+        }
+        pExpired = pNext;
+    }
+
+    return (ret != HSM_OK) ? ret : count;
+}
+
+/**
+ * @brief Let the manager release pooled payloads of queued events.
+ *
+ * Every event taken from the queue, the inbox or an executor carries one
+ * reference on its payload when pUserContext points into the pool; it is
+ * released once the event is dispatched. Posting the same payload to several
+ * managers takes one fsm_pool_retain() per extra post. Events passed to
+ * hsm_dispatch() directly stay owned by the caller.
+ *
+ * @param pManager  The HSM manager context.
+ * @param pPool     The pool, or NULL to leave payloads alone.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setPool(hsm_state_manager_t *pManager, fsm_pool_t *pPool)
+{
+    if (pManager == NULL || pManager->pExtension == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pManager->pExtension->pPool = pPool;
+    return HSM_OK;
+}
+
+/**
+ * @brief Give the manager a ring to hold deferred events.
+ *
+ * @param pManager   The HSM manager context.
+ * @param pDeferred  A ring of hsm_state_input_t elements, or NULL to detach.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_setDeferQueue(hsm_state_manager_t *pManager, fsm_spsc_t *pDeferred)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || (pDeferred != NULL && pDeferred->elemSize != sizeof(hsm_state_input_t))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pManager->pExtension->pDeferred = pDeferred;
+    pManager->pExtension->recallCount = 0u;
+    return HSM_OK;
+}
+
+/**
+ * @brief Hold an event until the machine changes state, from a state handler.
+ *
+ * When the next transition completes, every event deferred until then is
+ * dispatched again in deferral order, before hsm_dispatch() returns. A pooled
+ * payload is retained while the event waits.
+ *
+ * @param pManager  The HSM manager context.
+ * @param input     The event being handled.
+ *
+ * @return HSM_OK on success, EOR_FAULT_ERROR if the ring is full, error code otherwise.
+ */
+signed int hsm_defer(hsm_state_manager_t *pManager, hsm_state_input_t input)
+{
+    if (pManager == NULL || pManager->pExtension == NULL || pManager->pExtension->pDeferred == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    hsm_extension_t *pExtension = pManager->pExtension;
+
+    if (!fsm_spsc_push(pExtension->pDeferred, &input)) {
+        return EOR_FAULT_ERROR;
+    }
+    if (pExtension->pPool != NULL && input.pUserContext != NULL && fsm_pool_owns(pExtension->pPool, input.pUserContext)) {
+        fsm_pool_retain(input.pUserContext);
+    }
+    return HSM_OK;
+}
+
+/**
+ * @brief Put a runtime in the machine's initial state, to be entered by the first dispatch.
+ *
+ * @param pMachine  The machine definition.
+ * @param pRuntime  The runtime to initialize.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_initRuntime(const hsm_machine_t *pMachine, hsm_runtime_t *pRuntime)
+{
+    if (pMachine == NULL || pRuntime == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pRuntime->currentState = HSM_STATE_INSTANCE_ROOT;
+    pRuntime->processingState = pMachine->initialState;
+    return HSM_OK;
+}
+
+/**
+ * @brief Dispatch an event to one instance of a shared machine definition.
+ *
+ * Behaves as hsm_dispatch() on a manager over the definition. The dispatch
+ * loop reads the definition and writes the runtime in place. Manager-aware
+ * handlers receive a handle that only points at both, valid for the duration
+ * of the dispatch: hsm_transition() and the getters work on it, the calls
+ * needing an extension return EOR_INVALID_ARGUMENT, and it must not be kept.
+ *
+ * @param pMachine  The machine definition.
+ * @param pRuntime  The instance to dispatch to.
+ * @param input     The event to dispatch.
+ *
+ * @return HSM_OK on success, error code otherwise.
+ */
+signed int hsm_dispatchMachine(const hsm_machine_t *pMachine, hsm_runtime_t *pRuntime, hsm_state_input_t input)
+{
+    if (pMachine == NULL || pRuntime == NULL) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    hsm_state_manager_t session = {.pMachine = pMachine, .pRuntime = pRuntime};
+#if FSM_TRACE_ENABLE
+    hsm_instance_t from = pRuntime->currentState;
+    uint64_t start = fsm_trace_begin();
+#endif
+    signed int ret = pMachine->pRun(&session, hsm_getActiveState(&session, true), input);
+
+#if FSM_TRACE_ENABLE
+    fsm_trace_write(pRuntime, FSM_TRACE_KIND_HSM, start, from, pRuntime->currentState, input.signal, ret);
+#endif
+    return ret;
+}
+
+/**
+ * @brief Arena constructor for HSM managers, pass it to fsm_arena_init().
+ *
+ * The new manager starts from the prototype manager, set up with hsm_init()
+ * or hsm_initMachine() but never dispatched, so it starts from the initial
+ * state and shares the prototype's definition. The prototype's extension is
+ * never shared: when the slot's per-instance storage is sized with
+ * HSM_ARENA_EXTRA_SIZE(), a fresh extension is carved from it, given the
+ * prototype's pool, and the rest becomes an event ring attached as with
+ * hsm_setQueue(). Profiles and rule hit counters are not safe to share, as
+ * arenas of several threads may build from one prototype: a slot starts
+ * without them, attach its own with hsm_setProfile() or hsm_setRuleHits().
+ *
+ * @param pObject     The slot's manager.
+ * @param pExtra      The slot's per-instance storage, or NULL.
+ * @param extraSize   Bytes of pExtra, see HSM_ARENA_EXTRA_SIZE().
+ * @param pPrototype  The prototype manager.
+ */
+void hsm_arenaConstruct(void *pObject, void *pExtra, size_t extraSize, const void *pPrototype)
+{
+    hsm_state_manager_t *pManager = (hsm_state_manager_t *)pObject;
+    const hsm_state_manager_t *pSource = (const hsm_state_manager_t *)pPrototype;
+    size_t header = FSM_ARENA_ROUND(sizeof(hsm_extension_t));
+
+    *pManager = *pSource;
+    pManager->pRuntime = NULL;
+    pManager->pExtension = NULL;
+    if ((pExtra == NULL) || (extraSize < header)) {
+        return;
+    }
+
+    (void)hsm_setExtension(pManager, (hsm_extension_t *)pExtra);
+    if (pSource->pExtension != NULL) {
+        pManager->pExtension->pPool = pSource->pExtension->pPool;
+    }
+    pManager->pExtension->pQueue = fsm_arena_carveQueue((unsigned char *)pExtra + header, extraSize - header, sizeof(hsm_state_input_t));
+}
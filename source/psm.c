@@ -6,10 +6,180 @@
  **/
 #include <stdint.h>
 #include "psm.h"
+#include "fsm_queue.h"
+#include "fsm_trace.h"
+#include "fsm_profile.h"
+#include "fsm_metrics.h"
+#include "fsm_timer.h"
+#include "fsm_pool.h"
+#include "fsm_arena.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PSM_PREFETCH(p) __builtin_prefetch((p), 0, 3)
+#else
+#define PSM_PREFETCH(p) ((void)(p))
+#endif
+
+_Static_assert(offsetof(psm_rule_t, signal) == offsetof(fsm_index_key_t, signal), "psm_rule_t must start with an fsm_index_key_t");
+
+/*
+ * The definition and runtime fields of a PSM manager. The session manager of
+ * psm_activities_machine() only points to the shared definition and the
+ * runtime, other managers hold them inline; isSession is a constant in each
+ * psm_activities_step() caller.
+ */
+#define PSM_STATES(pStateManager, isSession)     ((isSession) ? ((pStateManager)->pMachine->pInitState) : ((pStateManager)->pInitState))
+#define PSM_NUMBER(pStateManager, isSession)     ((isSession) ? ((pStateManager)->pMachine->number) : ((pStateManager)->number))
+#define PSM_TRANSDUCER(pStateManager, isSession)                                                                                           \
+    ((isSession) ? ((pStateManager)->pMachine->pTransucerFunc) : ((pStateManager)->pTransucerFunc))
+#define PSM_PREVIOUS(pStateManager, isSession)   (*((isSession) ? (&(pStateManager)->pRuntime->previous) : (&(pStateManager)->previous)))
+#define PSM_CURRENT(pStateManager, isSession)    (*((isSession) ? (&(pStateManager)->pRuntime->current) : (&(pStateManager)->current)))
+#define PSM_MACHINE(pStateManager, isSession)    (((isSession) || ((pStateManager)->pMachine)) ? ((pStateManager)->pMachine) : (NULL))
+#define PSM_EXTENSION(pStateManager, isSession)  ((isSession) ? ((psm_extension_t *)NULL) : ((pStateManager)->pExtension))
+
+/**
+ * @brief Check if the PSM manager is the session manager of psm_activities_machine().
+ *
+ * @param pStateManager The PSM manager context pointer.
+ *
+ * @return The value of true for a session manager.
+ */
+static inline bool psm_session_is(const psm_state_manager_t *pStateManager)
+{
+    return (pStateManager->pRuntime) ? (true) : (false);
+}
+
+/**
+ * @brief Get a state's entry functions, from the compact table when one is attached.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param instance The state instance.
+ * @param isSession The manager is a session manager.
+ *
+ * @return The entry functions.
+ */
+static inline psm_entry_t psm_entry_resolve(const psm_state_manager_t *pStateManager, psm_instance_t instance, const bool isSession)
+{
+    const psm_machine_t *pMachine = PSM_MACHINE(pStateManager, isSession);
+    psm_entry_t entry;
+
+    if ((pMachine) && (pMachine->pEntries)) {
+        entry = pMachine->pEntries[instance];
+    } else {
+        entry.pEntryFunc = PSM_STATES(pStateManager, isSession)[instance].pEntryFunc;
+        entry.pEntryExFunc = PSM_STATES(pStateManager, isSession)[instance].pEntryExFunc;
+    }
+    return entry;
+}
+
+/**
+ * @brief Call a state's entry function, the manager-aware one when it's set.
+ *
+ * With profiling compiled in, the call is timed into the manager's profile
+ * when one is attached.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param instance The state instance.
+ * @param pEntry The state's entry functions.
+ * @param input The user defined input signal and data context.
+ * @param isSession The manager is a session manager.
+ *
+ * @return The value returned by the entry function.
+ */
+static inline void *psm_entry_call(psm_state_manager_t *pStateManager, psm_instance_t instance, const psm_entry_t *pEntry,
+                                   psm_state_input_t input, const bool isSession)
+{
+#if FSM_PROFILE_ENABLE
+    psm_extension_t *pExtension = PSM_EXTENSION(pStateManager, isSession);
+
+    if ((pExtension) && (pExtension->pProfile)) {
+        uint64_t start = FSM_PROFILE_TIMESTAMP();
+        void *ret = (pEntry->pEntryExFunc) ? (pEntry->pEntryExFunc(pStateManager, input)) : (pEntry->pEntryFunc(input));
+        fsm_profile_record(pExtension->pProfile, instance, input.signal, start);
+        return ret;
+    }
+#else
+    (void)instance;
+    (void)isSession;
+#endif
+    if (pEntry->pEntryExFunc) {
+        return pEntry->pEntryExFunc(pStateManager, input);
+    }
+    return pEntry->pEntryFunc(input);
+}
+
+/**
+ * @brief Call a state's entry function, see psm_entry_call().
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param instance The state instance.
+ * @param input The user defined input signal and data context.
+ * @param isSession The manager is a session manager.
+ *
+ * @return The value returned by the entry function.
+ */
+static inline void *psm_entry_invoke(psm_state_manager_t *pStateManager, psm_instance_t instance, psm_state_input_t input,
+                                     const bool isSession)
+{
+    psm_entry_t entry = psm_entry_resolve(pStateManager, instance, isSession);
+
+    return psm_entry_call(pStateManager, instance, &entry, input, isSession);
+}
+
+/**
+ * @brief Cancel the timeouts armed by a state, it has been exited.
+ *
+ * @param pExtension The PSM manager extension.
+ * @param instance The state instance.
+ */
+static inline void psm_timeout_release(psm_extension_t *pExtension, psm_instance_t instance)
+{
+    for (unsigned short i = 0u; i < pExtension->timerNumber; i++) {
+        if (pExtension->pTimers[i].owner == instance) {
+            fsm_timer_cancel(pExtension->pWheel, &pExtension->pTimers[i]);
+            pExtension->pTimers[i].owner = FSM_TIMER_OWNER_NONE;
+        }
+    }
+}
+
+/**
+ * @brief Resolve the input signal against the current state's transition rules.
+ *
+ * The rule taken is counted in the manager's hit counters when it has some.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param input The user defined input signal and data context.
+ * @param isSession The manager is a session manager.
+ *
+ * @return The first rule whose guard passes, or NULL to run the state entry function.
+ */
+static inline const psm_rule_t *psm_rule_resolve(psm_state_manager_t *pStateManager, psm_state_input_t input, const bool isSession)
+{
+    const psm_rule_table_t *pRuleTable = &pStateManager->pMachine->ruleTable;
+    psm_extension_t *pExtension = PSM_EXTENSION(pStateManager, isSession);
+    psm_instance_t current = PSM_CURRENT(pStateManager, isSession);
+
+    for (unsigned short row = fsm_index_find(&pRuleTable->index, pRuleTable->pRules, sizeof(psm_rule_t), current, input.signal);
+         (row < pRuleTable->number) && (pRuleTable->pRules[row].current == current) && (pRuleTable->pRules[row].signal == input.signal);
+         row++) {
+        const psm_rule_t *pRule = &pRuleTable->pRules[row];
+        if ((!pRule->pGuardFunc) || pRule->pGuardFunc(input)) {
+            if ((pExtension) && (pExtension->pHits)) {
+                pExtension->pHits[row]++;
+            }
+            return pRule;
+        }
+    }
+
+    return NULL;
+}
 
 /**
  * @brief Initialize a new PSM manager object.
  *
+ * The manager has no compiled tables and no attachments, see psm_machine_init()
+ * and psm_extension_attach().
+ *
  * @param pInitManager The PSM manager context pointer.
  * @param pInitStateList The user PSM state list table.
  * @param initInstance The first start state' instance.
@@ -38,7 +208,224 @@ signed int psm_init(psm_state_manager_t *pInitManager, const psm_state_t *pInitS
     pInitManager->previous = PSM_STATE_INSTANCE_INVALID;
     pInitManager->exit_signal = PSM_SIGNAL_UNKNOWN;
     pInitManager->pTransucerFunc = pTransucerFunc;
+    pInitManager->pMachine = NULL;
+    pInitManager->pRuntime = NULL;
+    pInitManager->pExtension = NULL;
+
+    return 0;
+}
+
+/**
+ * @brief Initialize a shared PSM machine definition.
+ *
+ * The definition holds what the managers and sessions of one machine have in
+ * common: the state list, the transducer and, once compiled, the entry array
+ * and the rule table. It has no pointer into itself, so it can be copied, and
+ * running inputs only reads it, so any number of threads can share it.
+ *
+ * @param pMachine The machine definition to initialize.
+ * @param pInitStateList The user PSM state list table.
+ * @param number The number of states.
+ * @param initInstance The first start state' instance.
+ * @param pTransucerFunc The transucer function pointer for state transition handler.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_machine_define(psm_machine_t *pMachine, const psm_state_t *pInitStateList, unsigned short number,
+                              psm_instance_t initInstance, pPsmTransducerFunc_t pTransucerFunc)
+{
+    if ((!pMachine) || (!pInitStateList)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if (initInstance >= number) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    memset(pMachine, 0, sizeof(*pMachine));
+    pMachine->pInitState = pInitStateList;
+    pMachine->number = number;
+    pMachine->initInstance = initInstance;
+    pMachine->pTransucerFunc = pTransucerFunc;
+
+    return 0;
+}
+
+/**
+ * @brief Compile a declarative transition table into the PSM machine definition.
+ *
+ * Once the initial state was entered, a user signal is looked up in the table
+ * before the current state entry function runs. A rule whose guard passes runs
+ * its action and transitions to its next state through the usual EXIT/ENTRY
+ * sequence, the entry function never receives the signal itself. Signals
+ * without a matching rule go to the entry function as before. Rule hits are
+ * counted per manager, see psm_rules_hits_attach().
+ *
+ * @param pMachine The machine definition.
+ * @param pRules The rule rows, rows sharing (current, signal) must be adjacent.
+ * @param number The number of rule rows.
+ * @param pSlots The lookup slot storage (see fsm_index_build()).
+ * @param slotNumber The number of lookup slots.
+ *
+ * @return The value of compile operation result.
+ */
+signed int psm_rules_compile(psm_machine_t *pMachine, const psm_rule_t *pRules, unsigned short number, unsigned short *pSlots,
+                             unsigned int slotNumber)
+{
+    if (!pMachine) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    for (unsigned short i = 0u; (pRules) && (i < number); i++) {
+        if ((pRules[i].signal < PSM_SIGNAL_USER_DEFINE) ||
+            ((pRules[i].next != PSM_STATE_INSTANCE_INVALID) && (pRules[i].next >= pMachine->number))) {
+            return EOR_INVALID_DATA;
+        }
+    }
+
+    psm_rule_table_t *pRuleTable = &pMachine->ruleTable;
+    signed int ret = fsm_index_build(&pRuleTable->index, pSlots, slotNumber, pRules, number, sizeof(psm_rule_t), pMachine->number);
+    if (ret) {
+        return ret;
+    }
+
+    pRuleTable->pRules = pRules;
+    pRuleTable->number = number;
+    return 0;
+}
+
+/**
+ * @brief Compile the state list into a dense array of entry functions for the PSM machine definition.
+ *
+ * Running an input only needs the entry functions, yet every psm_state_t row
+ * also carries the instance, id and name. With the dense array attached those
+ * rows are left as cold metadata, so a large state list costs a fraction of
+ * the cache lines to run.
+ *
+ * @param pMachine The machine definition.
+ * @param pEntries The storage for number entries, can be shared by definitions of the same state list.
+ *
+ * @return The value of compile operation result.
+ */
+signed int psm_table_compile(psm_machine_t *pMachine, psm_entry_t *pEntries)
+{
+    if ((!pMachine) || (!pEntries)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    for (unsigned short i = 0u; i < pMachine->number; i++) {
+        const psm_state_t *pState = &pMachine->pInitState[i];
+
+        if ((!pState->pEntryFunc) && (!pState->pEntryExFunc)) {
+            return EOR_INVALID_DATA;
+        }
+
+        pEntries[i].pEntryFunc = pState->pEntryFunc;
+        pEntries[i].pEntryExFunc = pState->pEntryExFunc;
+    }
+
+    pMachine->pEntries = pEntries;
+    return 0;
+}
+
+/**
+ * @brief Attach a dense entry array built by psm_table_compile() for the same state list.
+ *
+ * @param pMachine The machine definition.
+ * @param pEntries The entry array, or NULL to run from the psm_state_t rows.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_table_attach(psm_machine_t *pMachine, const psm_entry_t *pEntries)
+{
+    if (!pMachine) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pMachine->pEntries = pEntries;
+    return 0;
+}
+
+/**
+ * @brief Initialize a PSM manager over a shared machine definition.
+ *
+ * The manager runs with the definition's compiled tables and keeps its own
+ * state, as one set up by psm_init(). The definition must outlive it and not
+ * change while it is in use.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pMachine The machine definition.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_machine_init(psm_state_manager_t *pStateManager, const psm_machine_t *pMachine)
+{
+    if (!pMachine) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    signed int ret = psm_init(pStateManager, pMachine->pInitState, pMachine->number, pMachine->initInstance, pMachine->pTransucerFunc);
+    if (ret) {
+        return ret;
+    }
+
+    pStateManager->pMachine = pMachine;
+    return 0;
+}
+
+/**
+ * @brief Give the PSM manager storage for its per-instance attachments.
+ *
+ * The queues, inbox, profile, metrics, timers, pool, deferred ring and rule
+ * hit counters of a manager live in its extension, so managers without any
+ * stay small. The extension is cleared; the calls attaching those features
+ * fail with EOR_INVALID_ARGUMENT until it is set. Attach it before the first
+ * input.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pExtension The extension, owned by this manager only, or NULL to detach.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_extension_attach(psm_state_manager_t *pStateManager, psm_extension_t *pExtension)
+{
+    if ((!pStateManager) || (psm_session_is(pStateManager))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if (pExtension) {
+        memset(pExtension, 0, sizeof(*pExtension));
+    }
+    pStateManager->pExtension = pExtension;
+    return 0;
+}
+
+/**
+ * @brief Count the rule hits of this PSM manager.
+ *
+ * Every rule of the definition's transition table taken by this manager
+ * increments its counter, the definition itself stays read-only.
+ *
+ * @param pStateManager The PSM manager context pointer, with an extension and a definition.
+ * @param pHits One counter per rule row, zeroed here, or NULL to stop counting.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_rules_hits_attach(psm_state_manager_t *pStateManager, unsigned int *pHits)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if ((pHits) && (!pStateManager->pMachine)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    for (unsigned short i = 0u; (pHits) && (i < pStateManager->pMachine->ruleTable.number); i++) {
+        pHits[i] = 0u;
+    }
 
+    pStateManager->pExtension->pHits = pHits;
     return 0;
 }
 
@@ -55,7 +442,7 @@ signed int psm_state_inst_isInvalid(psm_state_manager_t *pStateManager, psm_inst
     if (!pStateManager) {
         return EOR_INVALID_ARGUMENT;
     }
-    return ((instance < pStateManager->number) ? (0) : (EOR_INVALID_DATA));
+    return ((instance < PSM_NUMBER(pStateManager, psm_session_is(pStateManager))) ? (0) : (EOR_INVALID_DATA));
 }
 
 /**
@@ -74,7 +461,7 @@ const char *psm_state_nameGet(psm_state_manager_t *pStateManager, psm_instance_t
     if (psm_state_inst_isInvalid(pStateManager, instance)) {
         return NULL;
     }
-    return pStateManager->pInitState[instance].pName;
+    return PSM_STATES(pStateManager, psm_session_is(pStateManager))[instance].pName;
 }
 
 /**
@@ -93,7 +480,7 @@ signed int psm_state_idGet(psm_state_manager_t *pStateManager, psm_instance_t in
     if (psm_state_inst_isInvalid(pStateManager, instance)) {
         return EOR_INVALID_ARGUMENT;
     }
-    return pStateManager->pInitState[instance].id;
+    return PSM_STATES(pStateManager, psm_session_is(pStateManager))[instance].id;
 }
 
 /**
@@ -108,78 +495,846 @@ psm_instance_t psm_inst_current_get(psm_state_manager_t *pStateManager)
     if (!pStateManager) {
         return PSM_STATE_INSTANCE_INVALID;
     }
-    return pStateManager->current;
+    return PSM_CURRENT(pStateManager, psm_session_is(pStateManager));
 }
 
 /**
- * @brief The PSM state schedule process.
+ * @brief The PSM state schedule process, the manager has already been checked.
+ *
+ * A session manager reads the definition and writes the runtime through its
+ * pointers and has no attachments; isSession is a constant in each caller, so
+ * only one side is compiled into it.
  *
  * @param pStateManager The PSM manager context pointer.
+ * @param pActive The current state's entry functions, or NULL to look them up.
  * @param input The user defined input signal and data context.
+ * @param isSession The manager is a session manager.
  *
  * @return The value of operation result.
  */
-signed int psm_activities(psm_state_manager_t *pStateManager, psm_state_input_t input)
+static inline signed int psm_activities_step(psm_state_manager_t *pStateManager, const psm_entry_t *pActive, psm_state_input_t input,
+                                             const bool isSession)
 {
-    if (!pStateManager) {
-        return EOR_INVALID_ARGUMENT;
+    const psm_machine_t *pMachine = PSM_MACHINE(pStateManager, isSession);
+    psm_extension_t *pExtension = PSM_EXTENSION(pStateManager, isSession);
+
+    if ((pMachine) && (pMachine->ruleTable.pRules) && (input.signal >= PSM_SIGNAL_USER_DEFINE) &&
+        (PSM_PREVIOUS(pStateManager, isSession) == PSM_CURRENT(pStateManager, isSession))) {
+        const psm_rule_t *pRule = psm_rule_resolve(pStateManager, input, isSession);
+        if (pRule) {
+            if (pRule->pActionFunc) {
+                pRule->pActionFunc(input);
+            }
+            if (pRule->next != PSM_STATE_INSTANCE_INVALID) {
+                PSM_CURRENT(pStateManager, isSession) = pRule->next;
+            }
+            if (PSM_CURRENT(pStateManager, isSession) == PSM_PREVIOUS(pStateManager, isSession)) {
+                return 0;
+            }
+        }
     }
 
     pPsmEntryFunc_t pNextEntry = NULL;
     do {
-        if (pStateManager->previous != pStateManager->current) {
-            pStateManager->exit_signal = input.signal;
+        if (PSM_PREVIOUS(pStateManager, isSession) != PSM_CURRENT(pStateManager, isSession)) {
+            psm_signal_t exitSignal = input.signal;
+
+            pActive = NULL;
             input.signal = PSM_SIGNAL_EXIT;
-            if (pStateManager->previous != PSM_STATE_INSTANCE_INVALID) {
-                void *ret = pStateManager->pInitState[pStateManager->previous].pEntryFunc(input);
+            if (PSM_PREVIOUS(pStateManager, isSession) != PSM_STATE_INSTANCE_INVALID) {
+                void *ret = psm_entry_invoke(pStateManager, PSM_PREVIOUS(pStateManager, isSession), input, isSession);
                 if (ret == (void *)(uintptr_t)PSM_FAULT_ERROR) {
                     break;
                 }
+                if ((pExtension) && (pExtension->pWheel)) {
+                    psm_timeout_release(pExtension, PSM_PREVIOUS(pStateManager, isSession));
+                }
             }
 
-            if (pStateManager->pTransucerFunc) {
-                if (pStateManager->pTransucerFunc(pStateManager->pInitState, pStateManager->previous, pStateManager->current, input) ==
-                    PSM_FAULT_ERROR) {
+            if (PSM_TRANSDUCER(pStateManager, isSession)) {
+                if (PSM_TRANSDUCER(pStateManager, isSession)(PSM_STATES(pStateManager, isSession), PSM_PREVIOUS(pStateManager, isSession),
+                                                             PSM_CURRENT(pStateManager, isSession), input) == PSM_FAULT_ERROR) {
                     break;
                 }
             }
 
             input.signal = PSM_SIGNAL_ENTRY;
-            if (pStateManager->previous == PSM_STATE_INSTANCE_INVALID) {
-                void *ret = pStateManager->pInitState[pStateManager->current].pEntryFunc(input);
+            if (PSM_PREVIOUS(pStateManager, isSession) == PSM_STATE_INSTANCE_INVALID) {
+                void *ret = psm_entry_invoke(pStateManager, PSM_CURRENT(pStateManager, isSession), input, isSession);
                 if (ret == (void *)(uintptr_t)PSM_FAULT_ERROR) {
                     break;
                 }
-                input.signal = pStateManager->exit_signal;
+                input.signal = exitSignal;
             }
 
-            pStateManager->previous = pStateManager->current;
+            PSM_PREVIOUS(pStateManager, isSession) = PSM_CURRENT(pStateManager, isSession);
+            if ((pExtension) && (pExtension->pDeferred)) {
+                pExtension->recallNumber = fsm_spsc_count(pExtension->pDeferred);
+            }
         }
 
-        pNextEntry = (pPsmEntryFunc_t)pStateManager->pInitState[pStateManager->current].pEntryFunc(input);
+        void *ret = (pActive) ? (psm_entry_call(pStateManager, PSM_CURRENT(pStateManager, isSession), pActive, input, isSession))
+                              : (psm_entry_invoke(pStateManager, PSM_CURRENT(pStateManager, isSession), input, isSession));
+        pNextEntry = (pPsmEntryFunc_t)ret;
     } while (pNextEntry && (pNextEntry != (void *)(uintptr_t)PSM_FAULT_ERROR));
 
     return ((pNextEntry != (void *)(uintptr_t)PSM_FAULT_ERROR) ? (0) : (EOR_FAULT_ERROR));
 }
 
 /**
- * @brief The PSM state transition.
+ * @brief Publish the current state and queue depth into the metrics slot.
  *
  * @param pStateManager The PSM manager context pointer.
- * @param next The expected state instance.
+ * @param dispatches The inputs run since the last publication.
+ * @param transitions The state changes since the last publication.
+ */
+static inline void psm_metrics_publish(psm_state_manager_t *pStateManager, unsigned int dispatches, unsigned int transitions)
+{
+    psm_extension_t *pExtension = pStateManager->pExtension;
+    unsigned int depth = 0u;
+
+    if (pExtension->pQueue) {
+        depth += fsm_spsc_count(pExtension->pQueue);
+    }
+    if (pExtension->pInbox) {
+        depth += fsm_mpsc_count(pExtension->pInbox);
+    }
+    fsm_metrics_publish(pExtension->pMetrics, pStateManager->current, dispatches, transitions, depth);
+}
+
+static signed int psm_defer_recall(psm_state_manager_t *pStateManager);
+
+/**
+ * @brief Run one input, recording it when tracing or metrics are compiled in.
+ *
+ * Inputs deferred before a transition the input caused are run again right
+ * after it, ahead of anything still queued.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pActive The current state's entry functions, or NULL to look them up.
+ * @param input The user defined input signal and data context.
  *
  * @return The value of operation result.
  */
-void *psm_transition(psm_state_manager_t *pStateManager, psm_instance_t next)
+static inline signed int psm_activities_run(psm_state_manager_t *pStateManager, const psm_entry_t *pActive, psm_state_input_t input)
 {
-    if (!pStateManager) {
-        return (void *)(uintptr_t)PSM_FAULT_ERROR;
+#if FSM_TRACE_ENABLE || FSM_METRICS_ENABLE
+    psm_instance_t from = pStateManager->current;
+#endif
+#if FSM_TRACE_ENABLE
+    uint64_t start = fsm_trace_begin();
+#endif
+    signed int ret = psm_activities_step(pStateManager, pActive, input, false);
+    psm_extension_t *pExtension = pStateManager->pExtension;
+
+#if FSM_TRACE_ENABLE
+    fsm_trace_write(pStateManager, FSM_TRACE_KIND_PSM, start, from, pStateManager->current, input.signal, ret);
+#endif
+    if (!pExtension) {
+        return ret;
     }
+#if FSM_METRICS_ENABLE
+    if (pExtension->pMetrics) {
+        psm_metrics_publish(pStateManager, 1u, (pStateManager->current != from) ? (1u) : (0u));
+    }
+#endif
+    if ((pExtension->recallNumber) && (!pExtension->isRecalling) && (!ret)) {
+        ret = psm_defer_recall(pStateManager);
+    }
+    return ret;
+}
 
-    if (next >= pStateManager->number) {
-        return (void *)(uintptr_t)PSM_FAULT_ERROR;
+/**
+ * @brief Run the deferred inputs due for recall, oldest first.
+ *
+ * Only the inputs deferred before the transition are recalled; one deferred
+ * again by the state it reaches waits for the next transition.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ *
+ * @return The value of operation result.
+ */
+static signed int psm_defer_recall(psm_state_manager_t *pStateManager)
+{
+    psm_extension_t *pExtension = pStateManager->pExtension;
+    signed int ret = 0;
+
+    pExtension->isRecalling = true;
+    while ((pExtension->recallNumber) && (!ret)) {
+        psm_state_input_t input;
+
+        pExtension->recallNumber--;
+        if (!fsm_spsc_pop(pExtension->pDeferred, &input)) {
+            break;
+        }
+        ret = psm_activities_run(pStateManager, NULL, input);
+        if ((pExtension->pPool) && (input.pUserContext)) {
+            fsm_pool_release(pExtension->pPool, input.pUserContext);
+        }
+    }
+    pExtension->recallNumber = 0u;
+    pExtension->isRecalling = false;
+
+    return ret;
+}
+
+/**
+ * @brief Run an input taken from a queue, then drop the queue's reference on a pooled payload.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param input The queued input.
+ *
+ * @return The value of operation result.
+ */
+static inline signed int psm_activities_queued(psm_state_manager_t *pStateManager, psm_state_input_t input)
+{
+    signed int ret = psm_activities_run(pStateManager, NULL, input);
+
+    if ((pStateManager->pExtension) && (pStateManager->pExtension->pPool) && (input.pUserContext)) {
+        fsm_pool_release(pStateManager->pExtension->pPool, input.pUserContext);
     }
+    return ret;
+}
+
+/**
+ * @brief The PSM state schedule process.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param input The user defined input signal and data context.
+ *
+ * @return The value of operation result.
+ */
+signed int psm_activities(psm_state_manager_t *pStateManager, psm_state_input_t input)
+{
+    if ((!pStateManager) || (psm_session_is(pStateManager))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    return psm_activities_run(pStateManager, NULL, input);
+}
 
-    pStateManager->current = next;
-    return (void *)pStateManager->pInitState[next].pEntryFunc;
+/**
+ * @brief Run an array of inputs through one PSM manager.
+ *
+ * Same as calling psm_activities() for each input in order. The argument
+ * checks are done once, and the current state's entry functions are looked
+ * up once per run of inputs that leave the state unchanged.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pInputs The inputs to process.
+ * @param number The number of inputs.
+ *
+ * @return The number of processed inputs, or EOR_FAULT_ERROR if an activity failed.
+ */
+signed int psm_activities_many(psm_state_manager_t *pStateManager, const psm_state_input_t *pInputs, unsigned int number)
+{
+    if ((!pStateManager) || (psm_session_is(pStateManager)) || ((!pInputs) && (number))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    psm_instance_t active = PSM_STATE_INSTANCE_INVALID;
+    psm_entry_t entry = {0};
+
+    for (unsigned int i = 0u; i < number; i++) {
+        if (pStateManager->current != active) {
+            active = pStateManager->current;
+            entry = psm_entry_resolve(pStateManager, active, false);
+        }
+        if (psm_activities_run(pStateManager, &entry, pInputs[i])) {
+            return EOR_FAULT_ERROR;
+        }
+    }
+
+    return (signed int)number;
+}
+
+/**
+ * @brief Run an array of (manager, input) pairs.
+ *
+ * While one pair runs, the manager two pairs ahead and the current state row
+ * of the next one are prefetched.
+ *
+ * @param pPairs The pairs to process, every manager must be valid.
+ * @param number The number of pairs.
+ *
+ * @return The number of processed pairs, or EOR_FAULT_ERROR if an activity failed.
+ */
+signed int psm_activities_batch(const psm_activities_pair_t *pPairs, unsigned int number)
+{
+    if ((!pPairs) && (number)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    for (unsigned int i = 0u; i < number; i++) {
+        if ((!pPairs[i].pStateManager) || (psm_session_is(pPairs[i].pStateManager))) {
+            return EOR_INVALID_ARGUMENT;
+        }
+    }
+
+    if (number > 1u) {
+        PSM_PREFETCH(pPairs[1].pStateManager);
+    }
+    for (unsigned int i = 0u; i < number; i++) {
+        if (i + 2u < number) {
+            PSM_PREFETCH(pPairs[i + 2u].pStateManager);
+        }
+        if (i + 1u < number) {
+            const psm_state_manager_t *pNext = pPairs[i + 1u].pStateManager;
+            if (pNext->current < pNext->number) {
+                PSM_PREFETCH(&pNext->pInitState[pNext->current]);
+            }
+        }
+        if (psm_activities_run(pPairs[i].pStateManager, NULL, pPairs[i].input)) {
+            return EOR_FAULT_ERROR;
+        }
+    }
+
+    return (signed int)number;
+}
+
+/**
+ * @brief The PSM state transition.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param next The expected state instance.
+ *
+ * @return The value of operation result.
+ */
+void *psm_transition(psm_state_manager_t *pStateManager, psm_instance_t next)
+{
+    if (!pStateManager) {
+        return (void *)(uintptr_t)PSM_FAULT_ERROR;
+    }
+
+    const bool isSession = psm_session_is(pStateManager);
+    if (next >= PSM_NUMBER(pStateManager, isSession)) {
+        return (void *)(uintptr_t)PSM_FAULT_ERROR;
+    }
+
+    PSM_CURRENT(pStateManager, isSession) = next;
+    if (PSM_STATES(pStateManager, isSession)[next].pEntryExFunc) {
+        return (void *)PSM_STATES(pStateManager, isSession)[next].pEntryExFunc;
+    }
+    return (void *)PSM_STATES(pStateManager, isSession)[next].pEntryFunc;
+}
+
+/**
+ * @brief Attach an event queue to the PSM manager.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pQueue The ring of psm_state_input_t elements, or NULL to detach.
+ *
+ * @return The value of operation result.
+ */
+signed int psm_queue_attach(psm_state_manager_t *pStateManager, fsm_spsc_t *pQueue)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if ((pQueue) && (pQueue->elemSize != sizeof(psm_state_input_t))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pStateManager->pExtension->pQueue = pQueue;
+    return 0;
+}
+
+/**
+ * @brief Queue an input for the next psm_queue_drain(), producer side only.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param input The user defined input signal and data context.
+ *
+ * @return The value of 0 on success, EOR_FAULT_ERROR if the queue is full.
+ */
+signed int psm_queue_post(psm_state_manager_t *pStateManager, psm_state_input_t input)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension) || (!pStateManager->pExtension->pQueue)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    return (fsm_spsc_push(pStateManager->pExtension->pQueue, &input)) ? (0) : (EOR_FAULT_ERROR);
+}
+
+/**
+ * @brief Run a batch of queued inputs through psm_activities(), consumer side only.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param maxNumber The maximum number of inputs to process.
+ *
+ * @return The number of processed inputs, or EOR_FAULT_ERROR if an activity failed.
+ */
+signed int psm_queue_drain(psm_state_manager_t *pStateManager, unsigned int maxNumber)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension) || (!pStateManager->pExtension->pQueue)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    fsm_spsc_t *pQueue = pStateManager->pExtension->pQueue;
+    unsigned int number = fsm_spsc_readable(pQueue);
+    number = (number < maxNumber) ? (number) : (maxNumber);
+
+    for (unsigned int i = 0u; i < number; i++) {
+        psm_state_input_t input = *(const psm_state_input_t *)fsm_spsc_at(pQueue, i);
+        if (psm_activities_queued(pStateManager, input)) {
+            fsm_spsc_consume(pQueue, i + 1u);
+            return EOR_FAULT_ERROR;
+        }
+    }
+
+    fsm_spsc_consume(pQueue, number);
+    return (signed int)number;
+}
+
+/**
+ * @brief Attach a multi-producer inbox to the PSM manager.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pInbox The ring of psm_state_input_t elements, or NULL to detach.
+ *
+ * @return The value of operation result.
+ */
+signed int psm_inbox_attach(psm_state_manager_t *pStateManager, fsm_mpsc_t *pInbox)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if ((pInbox) && (pInbox->elemSize != sizeof(psm_state_input_t))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pStateManager->pExtension->pInbox = pInbox;
+    return 0;
+}
+
+/**
+ * @brief Post an input to the PSM inbox, from any thread.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param input The user defined input signal and data context.
+ *
+ * @return The value of 0 on success, EOR_FAULT_ERROR if the inbox is full.
+ */
+signed int psm_inbox_post(psm_state_manager_t *pStateManager, psm_state_input_t input)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension) || (!pStateManager->pExtension->pInbox)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    return (fsm_mpsc_push(pStateManager->pExtension->pInbox, &input)) ? (0) : (EOR_FAULT_ERROR);
+}
+
+/**
+ * @brief Run a batch of inbox inputs through psm_activities().
+ *
+ * Returns 0 at once if another thread is already draining the inbox.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param maxNumber The maximum number of inputs to process.
+ *
+ * @return The number of processed inputs, or EOR_FAULT_ERROR if an activity failed.
+ */
+signed int psm_inbox_drain(psm_state_manager_t *pStateManager, unsigned int maxNumber)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension) || (!pStateManager->pExtension->pInbox)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    fsm_mpsc_t *pInbox = pStateManager->pExtension->pInbox;
+    if (!fsm_mpsc_acquire(pInbox)) {
+        return 0;
+    }
+
+    signed int ret = 0;
+    unsigned int number = fsm_mpsc_readable(pInbox, maxNumber);
+    unsigned int done = 0u;
+
+    while (done < number) {
+        psm_state_input_t input = *(const psm_state_input_t *)fsm_mpsc_at(pInbox, done);
+        done++;
+        if (psm_activities_queued(pStateManager, input)) {
+            ret = EOR_FAULT_ERROR;
+            break;
+        }
+    }
+
+    fsm_mpsc_consume(pInbox, done);
+    fsm_mpsc_release(pInbox);
+    return (ret) ? (ret) : ((signed int)done);
+}
+
+/**
+ * @brief Run one input through psm_activities() from an untyped manager pointer.
+ *
+ * Matches fsm_dispatch_t, so an executor can run PSM managers whose inbox
+ * holds psm_state_input_t elements. The input is treated as queued: a pooled
+ * payload is released once run.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pInput The input, a psm_state_input_t.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_activities_event(void *pStateManager, const void *pInput)
+{
+    if ((!pStateManager) || (!pInput) || (psm_session_is((const psm_state_manager_t *)pStateManager))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    return psm_activities_queued((psm_state_manager_t *)pStateManager, *(const psm_state_input_t *)pInput);
+}
+
+/**
+ * @brief Attach a handler latency profile to the PSM manager.
+ *
+ * Every entry function call is then counted and timed into the profile cell
+ * of its state and signal. The hooks only exist when FSM_PROFILE_ENABLE is
+ * set, otherwise the profile stays empty.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pProfile The profile, initialized by fsm_profile_init(), or NULL to detach.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_profile_attach(psm_state_manager_t *pStateManager, fsm_profile_t *pProfile)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pStateManager->pExtension->pProfile = pProfile;
+    return 0;
+}
+
+/**
+ * @brief Publish the PSM manager into a shared-memory metrics slot.
+ *
+ * After every input the slot gets the current state, the input and state
+ * change counts and the queue and inbox depth, for a monitor to poll. The
+ * hooks only exist when FSM_METRICS_ENABLE is set; attaching publishes the
+ * current state once either way.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pSlot A slot from fsm_metrics_claim(), or NULL to detach.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_metrics_attach(psm_state_manager_t *pStateManager, fsm_metrics_slot_t *pSlot)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pStateManager->pExtension->pMetrics = pSlot;
+    if (pSlot) {
+        psm_metrics_publish(pStateManager, 0u, 0u);
+    }
+    return 0;
+}
+
+/**
+ * @brief Give the PSM manager timers for state timeouts.
+ *
+ * A state entry function arms a timeout on ENTRY with psm_timeout_arm(); it
+ * is cancelled automatically when the state is exited, so a timeout is only
+ * ever delivered to the state that armed it.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pWheel The wheel driving the timers, or NULL to detach.
+ * @param pTimers Timer storage, one per state that may hold a timeout at the same time.
+ * @param number The number of timers in pTimers.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_timers_attach(psm_state_manager_t *pStateManager, fsm_timer_wheel_t *pWheel, fsm_timer_t *pTimers, unsigned short number)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if ((pWheel) && ((!pTimers) || (!number))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    psm_extension_t *pExtension = pStateManager->pExtension;
+    for (unsigned short i = 0u; i < pExtension->timerNumber; i++) {
+        fsm_timer_cancel(pExtension->pWheel, &pExtension->pTimers[i]);
+    }
+
+    pExtension->pWheel = pWheel;
+    pExtension->pTimers = (pWheel) ? (pTimers) : (NULL);
+    pExtension->timerNumber = (pWheel) ? (number) : (0u);
+    for (unsigned short i = 0u; i < pExtension->timerNumber; i++) {
+        fsm_timer_init(&pTimers[i], pStateManager);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Arm a timeout for the current state, typically on ENTRY.
+ *
+ * Arming again from the same state restarts its timeout.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param ticks The delay, in wheel ticks.
+ * @param input The input delivered when the timeout expires.
+ *
+ * @return The value of 0 on success, EOR_FAULT_ERROR if every timer is held by another state, error code otherwise.
+ */
+signed int psm_timeout_arm(psm_state_manager_t *pStateManager, uint64_t ticks, psm_state_input_t input)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension) || (!pStateManager->pExtension->pWheel)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    psm_extension_t *pExtension = pStateManager->pExtension;
+    fsm_timer_t *pTimer = NULL;
+    for (unsigned short i = 0u; i < pExtension->timerNumber; i++) {
+        if (fsm_timer_isExpired(&pExtension->pTimers[i])) {
+            /* Still linked in the batch being run, a timeout armed now supersedes it */
+            if (pExtension->pTimers[i].owner == pStateManager->current) {
+                pExtension->pTimers[i].owner = FSM_TIMER_OWNER_NONE;
+            }
+            continue;
+        }
+        if (pExtension->pTimers[i].owner == pStateManager->current) {
+            pTimer = &pExtension->pTimers[i];
+            break;
+        }
+        if ((!pTimer) && (pExtension->pTimers[i].owner == FSM_TIMER_OWNER_NONE)) {
+            pTimer = &pExtension->pTimers[i];
+        }
+    }
+    if (!pTimer) {
+        return EOR_FAULT_ERROR;
+    }
+
+    pTimer->owner = pStateManager->current;
+    pTimer->signal = input.signal;
+    pTimer->pContext = input.pUserContext;
+    return fsm_timer_arm(pExtension->pWheel, pTimer, ticks);
+}
+
+/**
+ * @brief Cancel the timeout of the current state.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_timeout_cancel(psm_state_manager_t *pStateManager)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension) || (!pStateManager->pExtension->pWheel)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    psm_timeout_release(pStateManager->pExtension, pStateManager->current);
+    return 0;
+}
+
+/**
+ * @brief Run a batch of expired timeouts returned by fsm_timer_advance().
+ *
+ * Every timer must belong to a PSM manager. A timeout whose state was exited
+ * by an earlier input of the same batch is dropped. The timers left in the
+ * batch are skipped by psm_timeout_arm() until they are walked, so entry
+ * functions may arm timeouts freely while it runs.
+ *
+ * @param pExpired The expired list.
+ *
+ * @return The number of timeouts run, or EOR_FAULT_ERROR if an input failed.
+ */
+signed int psm_timeout_run(fsm_timer_t *pExpired)
+{
+    signed int ret = 0;
+    signed int number = 0;
+
+    while (pExpired) {
+        fsm_timer_t *pNext = pExpired->pNext;
+
+        pExpired->expired = 0u;
+        if (pExpired->owner != FSM_TIMER_OWNER_NONE) {
+            psm_state_input_t input = {.signal = pExpired->signal, .pUserContext = pExpired->pContext};
+
+            pExpired->owner = FSM_TIMER_OWNER_NONE;
+            if (psm_activities_run((psm_state_manager_t *)pExpired->pMachine, NULL, input)) {
+                ret = EOR_FAULT_ERROR;
+            }
+            number++;
+        }
+        pExpired = pNext;
+    }
+
+    return (ret) ? (ret) : (number);
+}
+
+/**
+ * @brief Let the PSM manager release pooled payloads of queued inputs.
+ *
+ * Every input taken from the queue, the inbox or an executor carries one
+ * reference on its payload when pUserContext points into the pool; it is
+ * released once the input is run. Posting the same payload to several
+ * managers takes one fsm_pool_retain() per extra post. Inputs passed to
+ * psm_activities() directly stay owned by the caller.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pPool The pool, or NULL to leave payloads alone.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_pool_attach(psm_state_manager_t *pStateManager, fsm_pool_t *pPool)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pStateManager->pExtension->pPool = pPool;
+    return 0;
+}
+
+/**
+ * @brief Give the PSM manager a ring to hold deferred inputs.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param pDeferred The ring of psm_state_input_t elements, or NULL to detach.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_defer_attach(psm_state_manager_t *pStateManager, fsm_spsc_t *pDeferred)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    if ((pDeferred) && (pDeferred->elemSize != sizeof(psm_state_input_t))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pStateManager->pExtension->pDeferred = pDeferred;
+    pStateManager->pExtension->recallNumber = 0u;
+    return 0;
+}
+
+/**
+ * @brief Hold an input until the PSM changes state, from a state entry function.
+ *
+ * When the next transition completes, every input deferred until then is run
+ * again in deferral order, before psm_activities() returns. A pooled payload
+ * is retained while the input waits.
+ *
+ * @param pStateManager The PSM manager context pointer.
+ * @param input The input being handled.
+ *
+ * @return The value of 0 on success, EOR_FAULT_ERROR if the ring is full, error code otherwise.
+ */
+signed int psm_defer(psm_state_manager_t *pStateManager, psm_state_input_t input)
+{
+    if ((!pStateManager) || (!pStateManager->pExtension) || (!pStateManager->pExtension->pDeferred)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    psm_extension_t *pExtension = pStateManager->pExtension;
+    if (!fsm_spsc_push(pExtension->pDeferred, &input)) {
+        return EOR_FAULT_ERROR;
+    }
+    if ((pExtension->pPool) && (input.pUserContext) && (fsm_pool_owns(pExtension->pPool, input.pUserContext))) {
+        fsm_pool_retain(input.pUserContext);
+    }
+    return 0;
+}
+
+/**
+ * @brief Put a runtime in the machine initial state, entered by the first input.
+ *
+ * @param pMachine The machine definition.
+ * @param pRuntime The runtime to initialize.
+ *
+ * @return The value of 0 on success, error code otherwise.
+ */
+signed int psm_runtime_init(const psm_machine_t *pMachine, psm_runtime_t *pRuntime)
+{
+    if ((!pMachine) || (!pRuntime)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    pRuntime->previous = PSM_STATE_INSTANCE_INVALID;
+    pRuntime->current = pMachine->initInstance;
+    return 0;
+}
+
+/**
+ * @brief Run an input through one instance of a shared machine definition.
+ *
+ * Same as psm_activities() on a manager over the definition. The step reads
+ * the definition and writes the runtime in place. Extended entry functions
+ * receive a manager that only points at both, valid for the duration of the
+ * call: psm_transition() and the getters work on it, the calls needing an
+ * extension return EOR_INVALID_ARGUMENT, and it must not be kept.
+ *
+ * @param pMachine The machine definition.
+ * @param pRuntime The instance to run the input on.
+ * @param input The user defined input signal and data context.
+ *
+ * @return The value of operation result.
+ */
+signed int psm_activities_machine(const psm_machine_t *pMachine, psm_runtime_t *pRuntime, psm_state_input_t input)
+{
+    if ((!pMachine) || (!pRuntime)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    psm_state_manager_t session = {.pMachine = pMachine, .pRuntime = pRuntime};
+#if FSM_TRACE_ENABLE
+    psm_instance_t from = pRuntime->current;
+    uint64_t start = fsm_trace_begin();
+#endif
+    signed int ret = psm_activities_step(&session, NULL, input, true);
+
+#if FSM_TRACE_ENABLE
+    fsm_trace_write(pRuntime, FSM_TRACE_KIND_PSM, start, from, pRuntime->current, input.signal, ret);
+#endif
+    return ret;
+}
+
+/**
+ * @brief Arena constructor for PSM managers, pass it to fsm_arena_init().
+ *
+ * The new manager starts from the prototype manager, set up with psm_init()
+ * or psm_machine_init() but never run, so it starts from the initial state
+ * and shares the prototype definition. The prototype extension is never
+ * shared: when the slot per-instance storage is sized with
+ * PSM_ARENA_EXTRA_SIZE(), a fresh extension is carved from it, given the
+ * prototype pool, and the rest becomes an event ring attached as with
+ * psm_queue_attach(). Profiles and rule hit counters are not safe to share,
+ * as arenas of several threads may build from one prototype: a slot starts
+ * without them, attach its own with psm_profile_attach() or
+ * psm_rules_hits_attach().
+ *
+ * @param pObject The slot PSM manager.
+ * @param pExtra The slot per-instance storage, or NULL.
+ * @param extraSize The bytes of pExtra, see PSM_ARENA_EXTRA_SIZE().
+ * @param pPrototype The prototype PSM manager.
+ */
+void psm_arena_construct(void *pObject, void *pExtra, size_t extraSize, const void *pPrototype)
+{
+    psm_state_manager_t *pStateManager = (psm_state_manager_t *)pObject;
+    const psm_state_manager_t *pSource = (const psm_state_manager_t *)pPrototype;
+    size_t header = FSM_ARENA_ROUND(sizeof(psm_extension_t));
+
+    *pStateManager = *pSource;
+    pStateManager->pRuntime = NULL;
+    pStateManager->pExtension = NULL;
+    if ((!pExtra) || (extraSize < header)) {
+        return;
+    }
+
+    (void)psm_extension_attach(pStateManager, (psm_extension_t *)pExtra);
+    if (pSource->pExtension) {
+        pStateManager->pExtension->pPool = pSource->pExtension->pPool;
+    }
+    pStateManager->pExtension->pQueue =
+        fsm_arena_carveQueue((unsigned char *)pExtra + header, extraSize - header, sizeof(psm_state_input_t));
 }
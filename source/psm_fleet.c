@@ -0,0 +1,369 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include <stdint.h>
+#include "psm_fleet.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PSM_FLEET_AVX2 (1)
+#include <immintrin.h>
+#endif
+
+/* Largest table the vector kernel can index: gather offsets are signed 32-bit byte offsets */
+#define PSM_FLEET_TABLE_MAX (0x3FFFFFFFu)
+
+/**
+ * @brief Call a state's entry function, states without one accept every signal.
+ *
+ * @param pFleet The PSM fleet context pointer.
+ * @param pManager The instance's temporary manager.
+ * @param instance The state instance.
+ * @param input The input.
+ *
+ * @return The value returned by the entry function.
+ */
+static void *psm_fleet_entry(const psm_fleet_t *pFleet, psm_state_manager_t *pManager, psm_instance_t instance, psm_state_input_t input)
+{
+    if (pFleet->pInitState[instance].pEntryExFunc) {
+        return pFleet->pInitState[instance].pEntryExFunc(pManager, input);
+    }
+    if (pFleet->pInitState[instance].pEntryFunc) {
+        return pFleet->pInitState[instance].pEntryFunc(input);
+    }
+    return PSM_ACTION_DONE;
+}
+
+/**
+ * @brief Run the exit and entry handlers of an instance that changed state.
+ *
+ * Fleet instances share one state table and have no manager of their own, so a
+ * temporary manager is set up for entries that take one. As in
+ * psm_activities(), an entry function returning psm_transition() moves the
+ * instance on and one returning a continuation is called again, until an
+ * entry function returns PSM_ACTION_DONE.
+ *
+ * @param pFleet The PSM fleet context pointer.
+ * @param pState The instance state, the table's next state on entry, where the entry functions left it on return.
+ * @param from The previous state instance.
+ * @param signal The signal that triggered the transition.
+ * @param pContext The instance user context.
+ *
+ * @return The value of 0 on success, EOR_FAULT_ERROR if a handler failed.
+ */
+static signed int psm_fleet_apply(const psm_fleet_t *pFleet, psm_instance_t *pState, psm_instance_t from, psm_signal_t signal,
+                                  void *pContext)
+{
+    psm_state_manager_t manager;
+    psm_state_input_t input;
+    void *ret = NULL;
+
+    memset(&manager, 0, sizeof(manager));
+    memset(&input, 0, sizeof(input));
+    manager.pInitState = pFleet->pInitState;
+    manager.number = pFleet->number;
+    manager.previous = from;
+    manager.current = *pState;
+
+    input.signal = signal;
+    input.pUserContext = pContext;
+    do {
+        if (manager.previous != manager.current) {
+            manager.exit_signal = input.signal;
+            input.signal = PSM_SIGNAL_EXIT;
+            ret = psm_fleet_entry(pFleet, &manager, manager.previous, input);
+            if (ret == (void *)(uintptr_t)PSM_FAULT_ERROR) {
+                break;
+            }
+
+            if (pFleet->pTransucerFunc) {
+                if (pFleet->pTransucerFunc(pFleet->pInitState, manager.previous, manager.current, input) == (signed int)PSM_FAULT_ERROR) {
+                    ret = (void *)(uintptr_t)PSM_FAULT_ERROR;
+                    break;
+                }
+            }
+
+            input.signal = PSM_SIGNAL_ENTRY;
+            manager.previous = manager.current;
+        }
+
+        ret = psm_fleet_entry(pFleet, &manager, manager.current, input);
+    } while ((ret != (void *)(uintptr_t)PSM_FAULT_ERROR) && ((ret) || (manager.previous != manager.current)));
+
+    *pState = manager.current;
+    return (ret == (void *)(uintptr_t)PSM_FAULT_ERROR) ? (EOR_FAULT_ERROR) : (0);
+}
+
+/**
+ * @brief Step instances [begin, number) one at a time.
+ *
+ * @param pFleet The PSM fleet context pointer.
+ * @param pStates The instance states.
+ * @param pSignals The per instance signals, or NULL to use signal for all.
+ * @param signal The signal used when pSignals is NULL.
+ * @param ppContexts The per instance user contexts, or NULL.
+ * @param begin The first instance to step.
+ * @param number The number of instances.
+ * @param pRet The operation result, set to EOR_FAULT_ERROR if a handler failed.
+ *
+ * @return The number of instances that changed state.
+ */
+static unsigned int psm_fleet_step_scalar(const psm_fleet_t *pFleet, psm_instance_t *pStates, const psm_signal_t *pSignals,
+                                          psm_signal_t signal, void *const *ppContexts, unsigned int begin, unsigned int number,
+                                          signed int *pRet)
+{
+    unsigned int changed = 0u;
+
+    for (unsigned int i = begin; i < number; i++) {
+        psm_instance_t state = pStates[i];
+        psm_signal_t offset = ((pSignals) ? (pSignals[i]) : (signal)) - pFleet->signalBase;
+
+        if ((state >= pFleet->number) || (offset >= pFleet->signalSpan)) {
+            continue;
+        }
+
+        psm_instance_t next = pFleet->pNext[(unsigned int)state * pFleet->signalSpan + offset];
+        if (next == state) {
+            continue;
+        }
+
+        pStates[i] = next;
+        changed++;
+        if (psm_fleet_apply(pFleet, &pStates[i], state, (pSignals) ? (pSignals[i]) : (signal), (ppContexts) ? (ppContexts[i]) : (NULL))) {
+            *pRet = EOR_FAULT_ERROR;
+        }
+    }
+
+    return changed;
+}
+
+#ifdef PSM_FLEET_AVX2
+/**
+ * @brief Step instances eight at a time with AVX2 gathers.
+ *
+ * The table holds 16-bit entries and the gather reads 32-bit words, so each
+ * lane reads its entry plus the following one and keeps the low half; the
+ * table padding keeps the last read in bounds. Lanes whose state or signal is
+ * out of range keep their state.
+ *
+ * @return The number of instances that changed state, *pDone is set to the
+ *         number of instances processed.
+ */
+__attribute__((target("avx2"))) static unsigned int psm_fleet_step_avx2(const psm_fleet_t *pFleet, psm_instance_t *pStates,
+                                                                        const psm_signal_t *pSignals, psm_signal_t signal,
+                                                                        void *const *ppContexts, unsigned int number,
+                                                                        unsigned int *pDone, signed int *pRet)
+{
+    const __m256i base = _mm256_set1_epi32((int)pFleet->signalBase);
+    const __m256i span = _mm256_set1_epi32((int)pFleet->signalSpan);
+    const __m256i spanLast = _mm256_set1_epi32((int)(pFleet->signalSpan - 1u));
+    const __m256i count = _mm256_set1_epi32((int)pFleet->number);
+    const __m256i lowHalf = _mm256_set1_epi32(0xFFFF);
+    __m256i signals = _mm256_set1_epi32((int)signal);
+    unsigned int changed = 0u;
+    unsigned int i = 0u;
+
+    for (; i + 8u <= number; i += 8u) {
+        __m128i previous = _mm_loadu_si128((const __m128i *)(const void *)&pStates[i]);
+        __m256i states = _mm256_cvtepu16_epi32(previous);
+
+        if (pSignals) {
+            signals = _mm256_loadu_si256((const __m256i *)(const void *)&pSignals[i]);
+        }
+
+        __m256i offsets = _mm256_sub_epi32(signals, base);
+        __m256i inSpan = _mm256_cmpeq_epi32(_mm256_min_epu32(offsets, spanLast), offsets);
+        __m256i valid = _mm256_and_si256(inSpan, _mm256_cmpgt_epi32(count, states));
+        if (_mm256_testz_si256(valid, valid)) {
+            continue;
+        }
+
+        __m256i rows = _mm256_add_epi32(_mm256_mullo_epi32(states, span), offsets);
+        __m256i nexts = _mm256_mask_i32gather_epi32(states, (const int *)(const void *)pFleet->pNext, rows, valid, 2);
+        nexts = _mm256_and_si256(nexts, lowHalf);
+
+        unsigned int lanes = (~(unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(nexts, states)))) & 0xFFu;
+        if (!lanes) {
+            continue;
+        }
+
+        psm_instance_t from[8];
+        _mm_storeu_si128((__m128i *)(void *)from, previous);
+        _mm_storeu_si128((__m128i *)(void *)&pStates[i],
+                         _mm_packus_epi32(_mm256_castsi256_si128(nexts), _mm256_extracti128_si256(nexts, 1)));
+
+        while (lanes) {
+            unsigned int lane = (unsigned int)__builtin_ctz(lanes);
+            lanes &= lanes - 1u;
+            changed++;
+            if (psm_fleet_apply(pFleet, &pStates[i + lane], from[lane], (pSignals) ? (pSignals[i + lane]) : (signal),
+                                (ppContexts) ? (ppContexts[i + lane]) : (NULL))) {
+                *pRet = EOR_FAULT_ERROR;
+            }
+        }
+    }
+
+    *pDone = i;
+    return changed;
+}
+
+/**
+ * @brief Check once whether the running CPU supports AVX2.
+ */
+static bool psm_fleet_has_avx2(void)
+{
+    static int s_hasAvx2 = -1;
+
+    if (s_hasAvx2 < 0) {
+        __builtin_cpu_init();
+        s_hasAvx2 = (__builtin_cpu_supports("avx2")) ? (1) : (0);
+    }
+    return (s_hasAvx2 != 0);
+}
+#endif
+
+/**
+ * @brief Step every instance, vector kernel first and scalar for the rest.
+ */
+static signed int psm_fleet_run(const psm_fleet_t *pFleet, psm_instance_t *pStates, const psm_signal_t *pSignals, psm_signal_t signal,
+                                void *const *ppContexts, unsigned int number)
+{
+    if ((!pFleet) || (!pFleet->pNext) || ((!pStates) && (number))) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    signed int ret = 0;
+    unsigned int changed = 0u;
+    unsigned int done = 0u;
+
+#ifdef PSM_FLEET_AVX2
+    if (psm_fleet_has_avx2()) {
+        changed = psm_fleet_step_avx2(pFleet, pStates, pSignals, signal, ppContexts, number, &done, &ret);
+    }
+#endif
+    changed += psm_fleet_step_scalar(pFleet, pStates, pSignals, signal, ppContexts, done, number, &ret);
+
+    return (ret) ? (ret) : ((signed int)changed);
+}
+
+/**
+ * @brief Compile transition rules into a dense fleet next-state table.
+ *
+ * Only pure lookups can be stepped in bulk, so rules with a guard or an action
+ * are rejected. Internal rules (next is PSM_STATE_INSTANCE_INVALID) keep the
+ * state; when rows share a key the first one wins, as in psm_activities().
+ *
+ * @param pFleet The PSM fleet context pointer.
+ * @param pInitStateList The user PSM state list table, shared by all instances.
+ * @param number The number of states.
+ * @param pRules The transition rules.
+ * @param ruleNumber The number of rules.
+ * @param pTable The next-state table storage.
+ * @param tableNumber The table capacity, at least number * signal span + PSM_FLEET_TABLE_PAD.
+ * @param pTransucerFunc The transucer function pointer for state transition handler.
+ *
+ * @return The value of operation result.
+ */
+signed int psm_fleet_compile(psm_fleet_t *pFleet, const psm_state_t *pInitStateList, unsigned short number, const psm_rule_t *pRules,
+                             unsigned short ruleNumber, psm_instance_t *pTable, unsigned int tableNumber,
+                             pPsmTransducerFunc_t pTransucerFunc)
+{
+    if ((!pFleet) || (!pInitStateList) || (!number) || (number >= PSM_STATE_INSTANCE_INVALID) || ((!pRules) && (ruleNumber)) ||
+        (!pTable)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    psm_signal_t low = PSM_SIGNAL_USER_DEFINE;
+    psm_signal_t high = PSM_SIGNAL_USER_DEFINE;
+    for (unsigned short i = 0u; i < ruleNumber; i++) {
+        const psm_rule_t *pRule = &pRules[i];
+
+        if ((pRule->pGuardFunc) || (pRule->pActionFunc) || (pRule->current >= number) || (pRule->signal < PSM_SIGNAL_USER_DEFINE) ||
+            ((pRule->next >= number) && (pRule->next != PSM_STATE_INSTANCE_INVALID))) {
+            return EOR_INVALID_DATA;
+        }
+        if ((!i) || (pRule->signal < low)) {
+            low = pRule->signal;
+        }
+        if ((!i) || (pRule->signal > high)) {
+            high = pRule->signal;
+        }
+    }
+
+    unsigned long long cells = (unsigned long long)number * (unsigned long long)(high - low + 1u);
+    if ((cells + PSM_FLEET_TABLE_PAD > tableNumber) || (cells > PSM_FLEET_TABLE_MAX)) {
+        return EOR_INVALID_DATA;
+    }
+
+    pFleet->pInitState = pInitStateList;
+    pFleet->number = number;
+    pFleet->signalBase = low;
+    pFleet->signalSpan = high - low + 1u;
+    pFleet->pNext = pTable;
+    pFleet->pTransucerFunc = pTransucerFunc;
+
+    for (unsigned int cell = 0u; cell < (unsigned int)cells; cell++) {
+        pTable[cell] = PSM_STATE_INSTANCE_INVALID;
+    }
+    for (unsigned short i = 0u; i < ruleNumber; i++) {
+        unsigned int cell = (unsigned int)pRules[i].current * pFleet->signalSpan + (pRules[i].signal - low);
+        if (pTable[cell] == PSM_STATE_INSTANCE_INVALID) {
+            pTable[cell] = (pRules[i].next != PSM_STATE_INSTANCE_INVALID) ? (pRules[i].next) : (pRules[i].current);
+        }
+    }
+    for (unsigned int cell = 0u; cell < (unsigned int)cells; cell++) {
+        if (pTable[cell] == PSM_STATE_INSTANCE_INVALID) {
+            pTable[cell] = (psm_instance_t)(cell / pFleet->signalSpan);
+        }
+    }
+    for (unsigned int pad = 0u; pad < PSM_FLEET_TABLE_PAD; pad++) {
+        pTable[(unsigned int)cells + pad] = 0u;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Step many instances, each with its own signal.
+ *
+ * Only instances whose state changes run handlers: the old state's entry
+ * function with PSM_SIGNAL_EXIT, the transducer, then the new state's entry
+ * function with PSM_SIGNAL_ENTRY, which may move the instance on as in
+ * psm_activities(). A failing handler doesn't stop the step.
+ *
+ * @param pFleet The PSM fleet context pointer.
+ * @param pStates The current state of each instance, updated in place.
+ * @param pSignals The signal of each instance.
+ * @param ppContexts The user context passed to each instance's handlers, or NULL.
+ * @param number The number of instances.
+ *
+ * @return The number of instances that changed state, or EOR_FAULT_ERROR if a handler failed.
+ */
+signed int psm_fleet_step(const psm_fleet_t *pFleet, psm_instance_t *pStates, const psm_signal_t *pSignals, void *const *ppContexts,
+                          unsigned int number)
+{
+    if ((!pSignals) && (number)) {
+        return EOR_INVALID_ARGUMENT;
+    }
+
+    return psm_fleet_run(pFleet, pStates, pSignals, PSM_SIGNAL_UNKNOWN, ppContexts, number);
+}
+
+/**
+ * @brief Step many instances with the same signal.
+ *
+ * @param pFleet The PSM fleet context pointer.
+ * @param pStates The current state of each instance, updated in place.
+ * @param signal The signal sent to every instance.
+ * @param ppContexts The user context passed to each instance's handlers, or NULL.
+ * @param number The number of instances.
+ *
+ * @return The number of instances that changed state, or EOR_FAULT_ERROR if a handler failed.
+ */
+signed int psm_fleet_broadcast(const psm_fleet_t *pFleet, psm_instance_t *pStates, psm_signal_t signal, void *const *ppContexts,
+                               unsigned int number)
+{
+    return psm_fleet_run(pFleet, pStates, NULL, signal, ppContexts, number);
+}
@@ -0,0 +1,73 @@
+/**
+ * Copyright (c) Riven Zheng (zhengheiot@gmail.com).
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ **/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fsm_trace.h"
+
+/* Largest trace file the decoder reads, newer records win */
+#define DECODE_RECORDS_MAX (1u << 20)
+
+static fsm_trace_record_t s_records[DECODE_RECORDS_MAX];
+
+/**
+ * @brief Print usage.
+ */
+static void decode_usage(const char *pProgram)
+{
+    fprintf(stderr,
+            "usage: %s [--chrome] [--ticks-per-us N] trace.bin\n"
+            "  --chrome           print Chrome trace event JSON instead of text\n"
+            "  --ticks-per-us N   timestamp ticks per microsecond, for --chrome\n",
+            pProgram);
+}
+
+/**
+ * @brief Decode a file written by fsm_trace_save() to stdout.
+ */
+int main(int argc, char **argv)
+{
+    const char *pPath = NULL;
+    bool chrome = false;
+    double ticksPerUs = 0.0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--chrome") == 0) {
+            chrome = true;
+        } else if ((strcmp(argv[i], "--ticks-per-us") == 0) && (i + 1 < argc)) {
+            ticksPerUs = strtod(argv[++i], NULL);
+        } else if ((pPath == NULL) && (argv[i][0] != '-')) {
+            pPath = argv[i];
+        } else {
+            decode_usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (pPath == NULL) {
+        decode_usage(argv[0]);
+        return 1;
+    }
+
+    FILE *pFile = fopen(pPath, "rb");
+    if (pFile == NULL) {
+        fprintf(stderr, "%s: cannot open %s\n", argv[0], pPath);
+        return 1;
+    }
+
+    fsm_trace_ring_t ring;
+    signed int ret = fsm_trace_load(&ring, s_records, DECODE_RECORDS_MAX, pFile);
+    fclose(pFile);
+    if (ret != FSM_OK) {
+        fprintf(stderr, "%s: %s is not a trace written by this build (%d)\n", argv[0], pPath, ret);
+        return 1;
+    }
+
+    ret = chrome ? fsm_trace_dump_chrome(&ring, stdout, ticksPerUs) : fsm_trace_dump_text(&ring, stdout);
+    return (ret == FSM_OK) ? 0 : 1;
+}